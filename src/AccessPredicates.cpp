@@ -0,0 +1,481 @@
+#include <set>
+#include <stdexcept>
+
+#include "MemoCache.h"
+#include "AccessPredicates.h"
+#include "BuiltInFunction.h"
+
+using namespace std;
+
+static TaggedValue createConstant(const shared_ptr<Value>& value) {
+    if (dynamic_pointer_cast<BooleanValue>(value)) {
+        return TaggedValue::makeBoolean(dynamic_pointer_cast<BooleanValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<IntegerValue>(value)) {
+        return TaggedValue::makeInteger(dynamic_pointer_cast<IntegerValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<FloatValue>(value)) {
+        return TaggedValue::makeFloat(dynamic_pointer_cast<FloatValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<CharValue>(value)) {
+        return TaggedValue::makeChar(dynamic_pointer_cast<CharValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<StringValue>(value)) {
+        return TaggedValue::makeString(dynamic_pointer_cast<StringValue>(value)->getValue());
+    }
+    return TaggedValue::makeNull();
+}
+
+AccessPredicates::AccessPredicates(ProgramExecutor& executor, const vector<string>& variables, size_t cacheSize) :
+        executor(executor), dispatchTable(-1), cacheable(true), cacheSize(cacheSize), cacheHits(0), cacheMisses(0) {
+    auto mainFunction = executor.getProgram()->getFunction("main");
+    if (!mainFunction) throw logic_error("No function with name 'main' defined.");
+
+    if (!mainFunction->getArguments().empty()) messageArg = mainFunction->getArguments()[0];
+
+    for (auto& var : variables) {
+        readRoots.emplace_back();
+        writeRoots.emplace_back();
+
+        auto readIt = mainFunction->getReadExpressions().find(var);
+        if (readIt != mainFunction->getReadExpressions().end()) {
+            for (auto& exp : readIt->second) readRoots.back().push_back(compile(exp));
+        }
+
+        auto writeIt = mainFunction->getWriteExpressions().find(var);
+        if (writeIt != mainFunction->getWriteExpressions().end()) {
+            for (auto& exp : writeIt->second) writeRoots.back().push_back(compile(exp));
+        }
+    }
+
+    for (auto& node : nodes) {
+        if (node.op == Load) loadedPaths.push_back(node.fields);
+    }
+
+    buildVariants();
+}
+
+int AccessPredicates::getConstantVariantsCount() const {
+    int res = 0;
+    for (auto& variant : variants) {
+        if (variant.vars.empty()) res += 1;
+    }
+    return res;
+}
+
+pair<VarsSet, VarsSet> AccessPredicates::evaluate(shared_ptr<ExecObject> message) {
+    // constant access sets of the case do not depend on the rest of the message nor on the global state
+    if (dispatchTable >= 0) {
+        auto& variant = variants[findVariant(*message)];
+        if (variant.vars.empty()) return make_pair(variant.reads, variant.writes);
+    }
+
+    if (!cacheable || cacheSize == 0) return compute(move(message));
+
+    // shape of the message - values of the loaded fields, compared by their types and exact values
+    Shape key;
+    key.hash = 0;
+    key.values.reserve(loadedPaths.size());
+    for (auto& path : loadedPaths) {
+        key.values.push_back(path.empty() ? TaggedValue::makeObject(message) : message->getValueByPath(path));
+        key.hash = key.hash * 31 + hashStructure(key.values.back());
+    }
+
+    {
+        lock_guard<mutex> lock(cacheMutex);
+
+        auto cacheIt = cache.find(key);
+        if (cacheIt != cache.end()) {
+            cacheHits += 1;
+            return cacheIt->second;
+        }
+        cacheMisses += 1;
+    }
+
+    auto res = compute(move(message));
+
+    lock_guard<mutex> lock(cacheMutex);
+
+    // starting over when full, traffic has only few shapes so the cache is refilled quickly
+    if (cache.size() >= cacheSize) cache.clear();
+    cache.emplace(move(key), res);
+
+    return res;
+}
+
+bool AccessPredicates::ShapeEqual::operator()(const Shape& left, const Shape& right) const {
+    if (left.hash != right.hash || left.values.size() != right.values.size()) return false;
+
+    for (size_t i = 0; i < left.values.size(); i++) {
+        if (!isStructureEqual(left.values[i], right.values[i])) return false;
+    }
+    return true;
+}
+
+pair<VarsSet, VarsSet> AccessPredicates::compute(shared_ptr<ExecObject> message) const {
+    Frame frame;
+    frame.message = move(message);
+    frame.values.resize(nodes.size());
+    frame.done.resize(nodes.size(), false);
+    frame.dispatched.assign(tables.size(), (int)NOT_DISPATCHED);
+
+    auto res = make_pair(VarsSet(), VarsSet());
+    auto evalVariable = [&](int var) {
+        if (evalRoots(readRoots[var], frame)) res.first.insert(var);
+        if (evalRoots(writeRoots[var], frame)) res.second.insert(var);
+    };
+
+    // variables are visited in the index order, so the sets are only appended
+    if (dispatchTable < 0) {
+        for (int var = 0; var < (int)readRoots.size(); var++) evalVariable(var);
+        return res;
+    }
+
+    // constant parts of the matched variant are completed by the predicates which did not fold
+    int matched = dispatch(dispatchTable, frame);
+    auto& variant = variants[matched < 0 ? variants.size() - 1 : matched];
+    res.first = variant.reads;
+    res.second = variant.writes;
+    for (int var : variant.vars) evalVariable(var);
+    return res;
+}
+
+int AccessPredicates::compile(const shared_ptr<Expression>& expression) {
+    auto compiledIt = compiledExpressions.find(expression.get());
+    if (compiledIt != compiledExpressions.end()) return compiledIt->second;
+
+    int res = compileExpression(expression);
+    compiledExpressions.emplace(expression.get(), res);
+    return res;
+}
+
+int AccessPredicates::compileExpression(const shared_ptr<Expression>& expression) {
+    Node node;
+
+    if (dynamic_pointer_cast<ValueExpression>(expression)) {
+        auto value = dynamic_pointer_cast<ValueExpression>(expression)->getValue();
+
+        if (dynamic_pointer_cast<IdentifierValue>(value)) {
+            auto identifier = dynamic_pointer_cast<IdentifierValue>(value)->getIdentifier();
+            if (identifier->isGlobal()) {
+                // result would depend on the global state, so it cannot be reused for the same message shape
+                cacheable = false;
+
+                node.op = Undetermined;
+                node.path = "Access expression cannot read global variable.";
+
+                string key = "E" + node.path;
+                return addNode(move(node), key);
+            }
+
+            // only the message argument is set when the predicates are evaluated
+            auto name = identifier->getName();
+            if (name != messageArg && name.find(messageArg + ".") != 0) {
+                node.op = Constant;
+                node.constant = TaggedValue::makeNull();
+                return addNode(move(node), "N");
+            }
+
+            node.op = Load;
+            node.path = name == messageArg ? "" : name.substr(messageArg.length() + 1);
+            if (!node.path.empty()) node.fields = Symbols::internPath(node.path);
+
+            string key = "L" + node.path;
+            return addNode(move(node), key);
+        }
+
+        node.op = Constant;
+        node.constant = createConstant(value);
+        return addNode(move(node), "C" + expression->toString());
+    }
+    else if (dynamic_pointer_cast<CallExpression>(expression)) {
+        auto exp = dynamic_pointer_cast<CallExpression>(expression);
+        for (auto& arg : exp->getArguments()) node.args.push_back(compile(arg));
+
+        // dispatched message field is looked up in the table once, other values are compared by the `_eq` call
+        auto caseExp = dynamic_pointer_cast<CaseExpression>(expression);
+        if (caseExp && nodes[node.args[0]].op == Load) {
+            node.op = Case;
+            node.args.resize(1);
+            node.table = addTable(node.args[0], caseExp->getDispatch());
+            node.caseIndex = caseExp->getCaseIndex();
+
+            string key = "S" + to_string(node.table) + " " + to_string(node.caseIndex);
+            return addNode(move(node), key);
+        }
+
+        // callees are resolved by the link step of the executor
+        if (exp->getFunction()) {
+            node.op = Call;
+            node.function = exp->getFunction();
+        }
+        else if (exp->getBuiltInFunction()) {
+            // boolean operations are evaluated in place, other types go to the built-in function
+            node.builtIn = exp->getBuiltInFunction();
+            if (exp->getName() == "_and" && node.args.size() == 2) node.op = And;
+            else if (exp->getName() == "_or" && node.args.size() == 2) node.op = Or;
+            else if (exp->getName() == "_neg" && node.args.size() == 1) node.op = Neg;
+            else node.op = BuiltIn;
+        }
+        else {
+            node.op = Undetermined;
+            node.path = "Function with the name '" + exp->getName() + "' does not exist.";
+
+            string key = "E" + node.path;
+            return addNode(move(node), key);
+        }
+
+        string key = "F" + exp->getName();
+        for (int arg : node.args) key += " " + to_string(arg);
+        return addNode(move(node), key);
+    }
+    else if (dynamic_pointer_cast<ConditionExpression>(expression)) {
+        auto exp = dynamic_pointer_cast<ConditionExpression>(expression);
+
+        node.op = Condition;
+        node.args.push_back(compile(exp->getConditionExpression()));
+        node.args.push_back(compile(exp->getThenExpression()));
+        node.args.push_back(compile(exp->getElseExpression()));
+
+        string key = "?";
+        for (int arg : node.args) key += " " + to_string(arg);
+        return addNode(move(node), key);
+    }
+
+    node.op = Undetermined;
+    node.path = "Cannot execute undetermined expression.";
+
+    string key = "E" + node.path;
+    return addNode(move(node), key);
+}
+
+int AccessPredicates::addNode(Node node, const string& key) {
+    // sharing equal sub-expressions - arguments are already shared, so the key is short
+    auto keyIt = nodeKeys.find(key);
+    if (keyIt != nodeKeys.end()) return keyIt->second;
+
+    nodes.push_back(move(node));
+    nodeKeys[key] = (int)nodes.size() - 1;
+    return (int)nodes.size() - 1;
+}
+
+int AccessPredicates::addTable(int load, const Dispatch* dispatch) {
+    for (int i = 0; i < (int)tables.size(); i++) {
+        if (tables[i].load == load && tables[i].dispatch == dispatch) return i;
+    }
+
+    tables.push_back({ load, dispatch });
+    return (int)tables.size() - 1;
+}
+
+void AccessPredicates::buildVariants() {
+    // variable is selected by the table when every its predicate requires one of the literals
+    auto getGuards = [&](int var, int table, set<int>& guards) {
+        for (auto roots : { &readRoots[var], &writeRoots[var] }) {
+            for (int root : *roots) {
+                int guard = getGuard(root, table);
+                if (guard < 0) return false;
+                guards.insert(guard);
+            }
+        }
+        return true;
+    };
+
+    // table selecting the most variables is used
+    int bestCount = 0;
+    for (int table = 0; table < (int)tables.size(); table++) {
+        int count = 0;
+        for (int var = 0; var < (int)readRoots.size(); var++) {
+            set<int> guards;
+            if (getGuards(var, table, guards) && !guards.empty()) count += 1;
+        }
+
+        if (count > bestCount) {
+            bestCount = count;
+            dispatchTable = table;
+        }
+    }
+    if (dispatchTable < 0) return;
+
+    // variable is in the constant set when one of its predicates folds to true, it is evaluated per message when
+    // none does and some of them do not fold at all
+    int casesCount = tables[dispatchTable].dispatch->getCasesCount();
+    variants.assign(casesCount + 1, Variant());
+    for (int matched = 0; matched <= casesCount; matched++) {
+        auto& variant = variants[matched];
+        vector<int> folded(nodes.size(), (int)NOT_VISITED);
+
+        auto foldRoots = [&](const vector<int>& roots) {
+            int res = FOLDED_FALSE;
+            for (int root : roots) {
+                int value = fold(root, matched < casesCount ? matched : -1, folded);
+                if (value == FOLDED_TRUE) return value;
+                if (value == NOT_FOLDED) res = value;
+            }
+            return res;
+        };
+
+        for (int var = 0; var < (int)readRoots.size(); var++) {
+            int read = foldRoots(readRoots[var]);
+            int write = foldRoots(writeRoots[var]);
+            if (read == NOT_FOLDED || write == NOT_FOLDED) {
+                variant.vars.push_back(var);
+                continue;
+            }
+
+            if (read == FOLDED_TRUE) variant.reads.insert(var);
+            if (write == FOLDED_TRUE) variant.writes.insert(var);
+        }
+    }
+}
+
+int AccessPredicates::getGuard(int index, int table) const {
+    // comparison has to hold for the whole conjunction
+    auto& node = nodes[index];
+    if (node.op == Case && node.table == table) return node.caseIndex;
+    if (node.op != And) return -1;
+
+    int guard = getGuard(node.args[0], table);
+    return guard >= 0 ? guard : getGuard(node.args[1], table);
+}
+
+int AccessPredicates::fold(int index, int matched, vector<int>& folded) const {
+    int& res = folded[index];
+    if (res != NOT_VISITED) return res;
+
+    // only the cases of the dispatch table are known, boolean operations are folded around them
+    auto& node = nodes[index];
+    res = NOT_FOLDED;
+    switch (node.op) {
+        case Constant:
+            if (node.constant.isBoolean()) res = node.constant.getBoolean() ? FOLDED_TRUE : FOLDED_FALSE;
+            break;
+
+        case Case:
+            if (node.table == dispatchTable) res = node.caseIndex == matched ? FOLDED_TRUE : FOLDED_FALSE;
+            break;
+
+        case And:
+        case Or: {
+            int decisive = node.op == Or ? FOLDED_TRUE : FOLDED_FALSE;
+            int left = fold(node.args[0], matched, folded);
+            int right = fold(node.args[1], matched, folded);
+
+            if (left == decisive || right == decisive) res = decisive;
+            else if (left != NOT_FOLDED) res = right;
+            break;
+        }
+
+        case Neg: {
+            int arg = fold(node.args[0], matched, folded);
+            if (arg != NOT_FOLDED) res = arg == FOLDED_TRUE ? FOLDED_FALSE : FOLDED_TRUE;
+            break;
+        }
+
+        case Condition: {
+            int cond = fold(node.args[0], matched, folded);
+            int thenValue = fold(node.args[1], matched, folded);
+            int elseValue = fold(node.args[2], matched, folded);
+
+            if (cond != NOT_FOLDED) res = cond == FOLDED_TRUE ? thenValue : elseValue;
+            else if (thenValue == elseValue) res = thenValue;
+            break;
+        }
+
+        default:
+            break;
+    }
+    return res;
+}
+
+int AccessPredicates::dispatch(int table, Frame& frame) const {
+    int& matched = frame.dispatched[table];
+    if (matched == NOT_DISPATCHED) {
+        // only strings can equal the literals
+        auto& value = eval(tables[table].load, frame);
+        matched = value.isString() ? tables[table].dispatch->findCase(value.getString()) : -1;
+    }
+    return matched;
+}
+
+int AccessPredicates::findVariant(const ExecObject& message) const {
+    // whole message is an object, it cannot equal any literal
+    auto& fields = nodes[tables[dispatchTable].load].fields;
+    if (fields.empty()) return (int)variants.size() - 1;
+
+    auto value = message.getValueByPath(fields);
+    int matched = value.isString() ? tables[dispatchTable].dispatch->findCase(value.getString()) : -1;
+    return matched < 0 ? (int)variants.size() - 1 : matched;
+}
+
+bool AccessPredicates::evalRoots(const vector<int>& roots, Frame& frame) const {
+    for (int root : roots) {
+        auto& res = eval(root, frame);
+        if (!res.isBoolean()) throw logic_error("Access expression does not evaluate to boolean.");
+        if (res.getBoolean()) return true;
+    }
+    return false;
+}
+
+const TaggedValue& AccessPredicates::eval(int index, Frame& frame) const {
+    if (!frame.done[index]) {
+        frame.values[index] = evalNode(nodes[index], frame);
+        frame.done[index] = true;
+    }
+    return frame.values[index];
+}
+
+TaggedValue AccessPredicates::evalNode(const Node& node, Frame& frame) const {
+    switch (node.op) {
+        case Constant:
+            return node.constant;
+
+        case Load:
+            return node.fields.empty() ? TaggedValue::makeObject(frame.message) : frame.message->getValueByPath(node.fields);
+
+        case And:
+        case Or: {
+            auto& left = eval(node.args[0], frame);
+
+            // first operand decides alone
+            if (left.isBoolean() && left.getBoolean() == (node.op == Or)) return left;
+
+            auto& right = eval(node.args[1], frame);
+            if (left.isBoolean() && right.isBoolean()) return right;
+
+            TaggedValue args[] = { left, right };
+            return (*node.builtIn)(BuiltInArguments(args, 2));
+        }
+
+        case Neg: {
+            auto& arg = eval(node.args[0], frame);
+            if (arg.isBoolean()) return TaggedValue::makeBoolean(!arg.getBoolean());
+
+            return (*node.builtIn)(BuiltInArguments(&arg, 1));
+        }
+
+        case BuiltIn:
+        case Call: {
+            vector<TaggedValue> args;
+            for (int arg : node.args) args.push_back(eval(arg, frame));
+
+            if (node.op == BuiltIn) return (*node.builtIn)(BuiltInArguments(args.data(), args.size()));
+
+            // objects modified by the called function are copied on write, the message stays untouched
+            return executor.execCall(*node.function, args);
+        }
+
+        case Case:
+            return TaggedValue::makeBoolean(dispatch(node.table, frame) == node.caseIndex);
+
+        case Condition: {
+            auto& cond = eval(node.args[0], frame);
+            if (!cond.isBoolean()) throw logic_error("Condition expression does not evaluate to boolean.");
+
+            return eval(cond.getBoolean() ? node.args[1] : node.args[2], frame);
+        }
+
+        default:
+            throw logic_error(node.path);
+    }
+}
@@ -0,0 +1,167 @@
+#ifndef ACCESS_PREDICATES_H
+#define ACCESS_PREDICATES_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "VarsSet.h"
+#include "ProgramExecutor.h"
+
+class BuiltInFunction;
+
+// Read / write predicates of the main function compiled into one program. Equal sub-expressions of all the
+// predicates become one node, nodes are evaluated lazily (at most once per message) and the results are
+// written directly into the access sets.
+// Results are cached by the values of the message fields the predicates load - messages of the same shape
+// get the same access sets.
+// Cases of the dispatches built by the optimizer (the message type handlers) look the message field up in the
+// table of the dispatch once per message. Predicates are partially evaluated for every case of one table in
+// advance - a message of the case with the constant access sets is scheduled by the lookup alone, the other
+// cases evaluate only the variables whose predicates do not fold.
+class AccessPredicates {
+public:
+    static constexpr size_t DEFAULT_CACHE_SIZE = 1024;
+
+    AccessPredicates(ProgramExecutor&, const std::vector<std::string>&, size_t cacheSize = DEFAULT_CACHE_SIZE);
+
+    int getNodesCount() const {
+        return (int)nodes.size();
+    }
+
+    // cases of the dispatch table (and the values without a case) with all the predicates folded
+    int getVariantsCount() const {
+        return (int)variants.size();
+    }
+
+    int getConstantVariantsCount() const;
+
+    bool isCacheable() const {
+        return cacheable;
+    }
+
+    long long getCacheHits() const {
+        return cacheHits;
+    }
+
+    long long getCacheMisses() const {
+        return cacheMisses;
+    }
+
+    // evaluation through the cache and the direct one
+    std::pair<VarsSet, VarsSet> evaluate(std::shared_ptr<ExecObject>);
+    std::pair<VarsSet, VarsSet> compute(std::shared_ptr<ExecObject>) const;
+
+private:
+    enum Op {
+        Constant, Load, And, Or, Neg, BuiltIn, Call, Condition, Case, Undetermined
+    };
+
+    struct Node {
+        Op op;
+        std::vector<int> args;
+        TaggedValue constant;
+        std::string path;
+        FieldPath fields;
+        const BuiltInFunction* builtIn = NULL;
+        const Function* function = NULL;
+
+        // case of the dispatch table
+        int table = -1;
+        int caseIndex = -1;
+    };
+
+    // dispatch of the loaded message field
+    struct CaseTable {
+        int load;
+        const Dispatch* dispatch;
+    };
+
+    // access sets of the messages of one case - constant parts and the variables evaluated per message
+    struct Variant {
+        VarsSet reads;
+        VarsSet writes;
+        std::vector<int> vars;
+    };
+
+    // per message evaluation state
+    struct Frame {
+        std::shared_ptr<ExecObject> message;
+        std::vector<TaggedValue> values;
+        std::vector<bool> done;
+
+        // matched case of every table, NOT_DISPATCHED before the lookup
+        std::vector<int> dispatched;
+    };
+
+    // values of the loaded message fields, messages of the same shape get the same access sets
+    struct Shape {
+        std::vector<TaggedValue> values;
+        size_t hash;
+    };
+
+    struct ShapeHash {
+        size_t operator()(const Shape& shape) const {
+            return shape.hash;
+        }
+    };
+
+    struct ShapeEqual {
+        bool operator()(const Shape&, const Shape&) const;
+    };
+
+    static constexpr int NOT_DISPATCHED = -2;
+
+    // results of the folding
+    static constexpr int FOLDED_FALSE = 0;
+    static constexpr int FOLDED_TRUE = 1;
+    static constexpr int NOT_FOLDED = -1;
+    static constexpr int NOT_VISITED = -2;
+
+    int compile(const std::shared_ptr<Expression>&);
+    int compileExpression(const std::shared_ptr<Expression>&);
+    int addNode(Node, const std::string&);
+    int addTable(int, const Dispatch*);
+    void buildVariants();
+    int getGuard(int, int) const;
+    int fold(int, int, std::vector<int>&) const;
+
+    int dispatch(int, Frame&) const;
+    int findVariant(const ExecObject&) const;
+
+    const TaggedValue& eval(int, Frame&) const;
+    TaggedValue evalNode(const Node&, Frame&) const;
+    bool evalRoots(const std::vector<int>&, Frame&) const;
+
+    ProgramExecutor& executor;
+    std::string messageArg;
+
+    std::vector<Node> nodes;
+    std::map<std::string, int> nodeKeys;
+
+    // expressions of the analyzer are shared, every one is compiled once
+    std::unordered_map<const Expression*, int> compiledExpressions;
+
+    std::vector<std::vector<int> > readRoots;
+    std::vector<std::vector<int> > writeRoots;
+
+    // table selecting the variant, the last variant is for the values without a case
+    std::vector<CaseTable> tables;
+    int dispatchTable;
+    std::vector<Variant> variants;
+
+    // message fields loaded by the predicates, predicates reading global state are not cached
+    std::vector<FieldPath> loadedPaths;
+    bool cacheable;
+
+    size_t cacheSize;
+    std::mutex cacheMutex;
+    std::unordered_map<Shape, std::pair<VarsSet, VarsSet>, ShapeHash, ShapeEqual> cache;
+    long long cacheHits;
+    long long cacheMisses;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+#include "AllocationCounter.h"
+
+using namespace std;
+
+#ifdef COUNT_ALLOCATIONS
+
+static atomic<long long> allocationsCount(0);
+
+void* operator new(size_t size) {
+    allocationsCount.fetch_add(1, memory_order_relaxed);
+
+    void* res = malloc(size ? size : 1);
+    if (!res) throw bad_alloc();
+    return res;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+bool AllocationCounter::isEnabled() {
+    return true;
+}
+
+long long AllocationCounter::getCount() {
+    return allocationsCount.load(memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::isEnabled() {
+    return false;
+}
+
+long long AllocationCounter::getCount() {
+    return 0;
+}
+
+#endif
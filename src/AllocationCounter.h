@@ -0,0 +1,15 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+// Heap allocations of the whole process reported by the benchmarks. Counting replaces the global operator new and
+// makes every allocation of every thread touch one shared counter, so it is compiled in only with the
+// COUNT_ALLOCATIONS option and the regular builds do not pay for it.
+class AllocationCounter {
+public:
+    static bool isEnabled();
+
+    // number of the allocations so far, zero when counting is not compiled in
+    static long long getCount();
+};
+
+#endif
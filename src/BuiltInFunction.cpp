@@ -7,353 +7,252 @@
 
 using namespace std;
 
-BuiltInFunction::BuiltInFunction(string name, int argsCount, function<shared_ptr<ExecValue>(const BuiltInArguments&)> func) :
-        name(move(name)), argsCount(argsCount), func(move(func)) {
-};
-
-shared_ptr<ExecValue> BuiltInFunction::operator()(const BuiltInArguments& args) const {
+TaggedValue BuiltInFunction::operator()(const BuiltInArguments& args) const {
     if (args.size() != argsCount) {
-        throw logic_error("Wrong arguments count for the function '" + name + "'.");
+        throw logic_error("Wrong arguments count for the function '" + string(name) + "'.");
     }
 
     auto res = func(args);
-    if (!res) throw logic_error("Wrong arguments types for the function '" + name + "'.");
+    if (res.isUndefined()) throw logic_error("Wrong arguments types for the function '" + string(name) + "'.");
 
     return res;
 }
 
-std::map<std::string, BuiltInFunction> BUILT_IN_FUNCTIONS;
+static bool isSameType(const BuiltInArguments& args, TaggedValue::Type type) {
+    return args[0].getType() == type && args[1].getType() == type;
+}
+
+// equality checking
+static TaggedValue isEqual(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Boolean)) return TaggedValue::makeBoolean(args[0].getBoolean() == args[1].getBoolean());
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeBoolean(args[0].getInteger() == args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeBoolean(args[0].getFloat() == args[1].getFloat());
+    if (isSameType(args, TaggedValue::Char)) return TaggedValue::makeBoolean(args[0].getChar() == args[1].getChar());
+    if (isSameType(args, TaggedValue::String)) return TaggedValue::makeBoolean(args[0].getString() == args[1].getString());
+    if (isSameType(args, TaggedValue::Null)) return TaggedValue::makeBoolean(true);
 
-void addBuiltInFunction(const std::string& name, int argsCount, std::function<std::shared_ptr<ExecValue>(const BuiltInArguments&)> func) {
-    BUILT_IN_FUNCTIONS[name] = BuiltInFunction(name, argsCount, std::move(func));
+    return TaggedValue::makeBoolean(false);
 }
 
-void initBuiltInFunctions() {
-    // equality checking
-    addBuiltInFunction("_eq", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecBoolean>(0) && args.get<ExecBoolean>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecBoolean>(0)->getValue() == args.get<ExecBoolean>(1)->getValue())
-            );
-        }
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecInteger>(0)->getValue() == args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecFloat>(0)->getValue() == args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        if (args.get<ExecChar>(0) && args.get<ExecChar>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecChar>(0)->getValue() == args.get<ExecChar>(1)->getValue())
-            );
-        }
-        if (args.get<ExecString>(0) && args.get<ExecString>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecString>(0)->getValue() == args.get<ExecString>(1)->getValue())
-            );
-        }
-        if (args.get<ExecNull>(0) && args.get<ExecNull>(1)) {
-            return static_pointer_cast<ExecValue>(make_shared<ExecBoolean>(true));
-        }
+static TaggedValue builtInNeq(const BuiltInArguments& args) {
+    return TaggedValue::makeBoolean(!isEqual(args).getBoolean());
+}
 
-        return static_pointer_cast<ExecValue>(make_shared<ExecBoolean>(false));
-    });
-    addBuiltInFunction("_neq", 2, [](const BuiltInArguments& args) {
-        auto res = dynamic_pointer_cast<ExecBoolean>(BUILT_IN_FUNCTIONS["_eq"](args));
-        if (!res) return static_pointer_cast<ExecValue>(make_shared<ExecBoolean>(false));
-        return static_pointer_cast<ExecValue>(make_shared<ExecBoolean>(!res->getValue()));
-    });
-
-    // scalar types comparing
-    addBuiltInFunction("_lt", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecInteger>(0)->getValue() < args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecFloat>(0)->getValue() < args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        if (args.get<ExecChar>(0) && args.get<ExecChar>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecChar>(0)->getValue() < args.get<ExecChar>(1)->getValue())
-            );
-        }
+// scalar types comparing
+static TaggedValue builtInLt(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeBoolean(args[0].getInteger() < args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeBoolean(args[0].getFloat() < args[1].getFloat());
+    if (isSameType(args, TaggedValue::Char)) return TaggedValue::makeBoolean(args[0].getChar() < args[1].getChar());
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_gt", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecInteger>(0)->getValue() > args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecFloat>(0)->getValue() > args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        if (args.get<ExecChar>(0) && args.get<ExecChar>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecChar>(0)->getValue() > args.get<ExecChar>(1)->getValue())
-            );
-        }
+    return TaggedValue();
+}
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_leqt", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecInteger>(0)->getValue() <= args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecFloat>(0)->getValue() <= args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        if (args.get<ExecChar>(0) && args.get<ExecChar>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecChar>(0)->getValue() <= args.get<ExecChar>(1)->getValue())
-            );
-        }
+static TaggedValue builtInGt(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeBoolean(args[0].getInteger() > args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeBoolean(args[0].getFloat() > args[1].getFloat());
+    if (isSameType(args, TaggedValue::Char)) return TaggedValue::makeBoolean(args[0].getChar() > args[1].getChar());
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_geqt", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecInteger>(0)->getValue() >= args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecFloat>(0)->getValue() >= args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        if (args.get<ExecChar>(0) && args.get<ExecChar>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecChar>(0)->getValue() >= args.get<ExecChar>(1)->getValue())
-            );
-        }
+    return TaggedValue();
+}
 
-        return shared_ptr<ExecValue>();
-    });
+static TaggedValue builtInLeqt(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeBoolean(args[0].getInteger() <= args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeBoolean(args[0].getFloat() <= args[1].getFloat());
+    if (isSameType(args, TaggedValue::Char)) return TaggedValue::makeBoolean(args[0].getChar() <= args[1].getChar());
 
-    // integer-only arithmetic
-    addBuiltInFunction("_mod", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue() % args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        return shared_ptr<ExecValue>();
-    });
-
-    // integer / floating-point arithmetic
-    addBuiltInFunction("_add", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue() + args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecFloat>(args.get<ExecFloat>(0)->getValue() + args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_sub", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue() - args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecFloat>(args.get<ExecFloat>(0)->getValue() - args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_mul", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue() * args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecFloat>(args.get<ExecFloat>(0)->getValue() * args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_div", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue() / args.get<ExecInteger>(1)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0) && args.get<ExecFloat>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecFloat>(args.get<ExecFloat>(0)->getValue() / args.get<ExecFloat>(1)->getValue())
-            );
-        }
-        return shared_ptr<ExecValue>();
-    });
-
-    // boolean logic
-    addBuiltInFunction("_and", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecBoolean>(0) && args.get<ExecBoolean>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecBoolean>(0)->getValue() && args.get<ExecBoolean>(1)->getValue())
-            );
-        }
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue() & args.get<ExecInteger>(1)->getValue())
-            );
-        }
+    return TaggedValue();
+}
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_or", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecBoolean>(0) && args.get<ExecBoolean>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecBoolean>(0)->getValue() || args.get<ExecBoolean>(1)->getValue())
-            );
-        }
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue() | args.get<ExecInteger>(1)->getValue())
-            );
-        }
+static TaggedValue builtInGeqt(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeBoolean(args[0].getInteger() >= args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeBoolean(args[0].getFloat() >= args[1].getFloat());
+    if (isSameType(args, TaggedValue::Char)) return TaggedValue::makeBoolean(args[0].getChar() >= args[1].getChar());
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_xor", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecBoolean>(0) && args.get<ExecBoolean>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(args.get<ExecBoolean>(0)->getValue() ^ args.get<ExecBoolean>(1)->getValue())
-            );
-        }
-        if (args.get<ExecInteger>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue() ^ args.get<ExecInteger>(1)->getValue())
-            );
-        }
+    return TaggedValue();
+}
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_neg", 1, [](const BuiltInArguments& args) {
-        if (args.get<ExecBoolean>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecBoolean>(!args.get<ExecBoolean>(0)->getValue())
-            );
-        }
-        if (args.get<ExecInteger>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(~args.get<ExecInteger>(0)->getValue())
-            );
-        }
+// integer-only arithmetic
+static TaggedValue builtInMod(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeInteger(args[0].getInteger() % args[1].getInteger());
 
-        return shared_ptr<ExecValue>();
-    });
+    return TaggedValue();
+}
 
-    // string manipulation
-    addBuiltInFunction("_length", 1, [](const BuiltInArguments& args) {
-        if (args.get<ExecString>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecString>(0)->getValue().length())
-            );
-        }
+// integer / floating-point arithmetic
+static TaggedValue builtInAdd(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeInteger(args[0].getInteger() + args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeFloat(args[0].getFloat() + args[1].getFloat());
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_ch", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecString>(0) && args.get<ExecInteger>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecChar>(args.get<ExecString>(0)->getValue()[args.get<ExecInteger>(1)->getValue()])
-            );
-        }
+    return TaggedValue();
+}
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_con", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecString>(0) && args.get<ExecString>(1)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecString>(args.get<ExecString>(0)->getValue() + args.get<ExecString>(1)->getValue())
-            );
-        }
+static TaggedValue builtInSub(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeInteger(args[0].getInteger() - args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeFloat(args[0].getFloat() - args[1].getFloat());
 
-        return shared_ptr<ExecValue>();
-    });
+    return TaggedValue();
+}
 
-    // conversion and utilities
-    addBuiltInFunction("_integer", 1, [](const BuiltInArguments& args) {
-        if (args.get<ExecBoolean>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecBoolean>(0)->getValue())
-            );
-        }
-        if (args.get<ExecInteger>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecFloat>(0)->getValue())
-            );
-        }
-        if (args.get<ExecChar>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecChar>(0)->getValue())
-            );
-        }
+static TaggedValue builtInMul(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeInteger(args[0].getInteger() * args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeFloat(args[0].getFloat() * args[1].getFloat());
 
-        return shared_ptr<ExecValue>();
-    });
-    addBuiltInFunction("_float", 1, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecInteger>(0)->getValue())
-            );
-        }
-        if (args.get<ExecFloat>(0)) {
-            return static_pointer_cast<ExecValue>(
-                    make_shared<ExecInteger>(args.get<ExecFloat>(0)->getValue())
-            );
+    return TaggedValue();
+}
+
+static TaggedValue builtInDiv(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeInteger(args[0].getInteger() / args[1].getInteger());
+    if (isSameType(args, TaggedValue::Float)) return TaggedValue::makeFloat(args[0].getFloat() / args[1].getFloat());
+
+    return TaggedValue();
+}
+
+// boolean logic
+static TaggedValue builtInAnd(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Boolean)) return TaggedValue::makeBoolean(args[0].getBoolean() && args[1].getBoolean());
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeInteger(args[0].getInteger() & args[1].getInteger());
+
+    return TaggedValue();
+}
+
+static TaggedValue builtInOr(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Boolean)) return TaggedValue::makeBoolean(args[0].getBoolean() || args[1].getBoolean());
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeInteger(args[0].getInteger() | args[1].getInteger());
+
+    return TaggedValue();
+}
+
+static TaggedValue builtInXor(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::Boolean)) return TaggedValue::makeBoolean(args[0].getBoolean() ^ args[1].getBoolean());
+    if (isSameType(args, TaggedValue::Integer)) return TaggedValue::makeInteger(args[0].getInteger() ^ args[1].getInteger());
+
+    return TaggedValue();
+}
+
+static TaggedValue builtInNeg(const BuiltInArguments& args) {
+    if (args[0].isBoolean()) return TaggedValue::makeBoolean(!args[0].getBoolean());
+    if (args[0].isInteger()) return TaggedValue::makeInteger(~args[0].getInteger());
+
+    return TaggedValue();
+}
+
+// string manipulation
+static TaggedValue builtInLength(const BuiltInArguments& args) {
+    if (args[0].isString()) return TaggedValue::makeInteger(args[0].getString().length());
+
+    return TaggedValue();
+}
+
+static TaggedValue builtInCh(const BuiltInArguments& args) {
+    if (args[0].isString() && args[1].isInteger()) return TaggedValue::makeChar(args[0].getString()[args[1].getInteger()]);
+
+    return TaggedValue();
+}
+
+static TaggedValue builtInCon(const BuiltInArguments& args) {
+    if (isSameType(args, TaggedValue::String)) return TaggedValue::makeString(args[0].getString() + args[1].getString());
+
+    return TaggedValue();
+}
+
+// conversion and utilities
+static TaggedValue builtInInteger(const BuiltInArguments& args) {
+    if (args[0].isBoolean()) return TaggedValue::makeInteger(args[0].getBoolean());
+    if (args[0].isInteger()) return TaggedValue::makeInteger(args[0].getInteger());
+    if (args[0].isFloat()) return TaggedValue::makeInteger((long long)args[0].getFloat());
+    if (args[0].isChar()) return TaggedValue::makeInteger(args[0].getChar());
+
+    return TaggedValue();
+}
+
+static TaggedValue builtInFloat(const BuiltInArguments& args) {
+    if (args[0].isInteger()) return TaggedValue::makeInteger(args[0].getInteger());
+    if (args[0].isFloat()) return TaggedValue::makeInteger((long long)args[0].getFloat());
+
+    return TaggedValue();
+}
+
+static TaggedValue builtInSleep(const BuiltInArguments& args) {
+    if (args[0].isInteger()) {
+        // doing busy wait
+        long long int time = args[0].getInteger();
+
+        // doing busy wait to better simulate processing!
+        auto start = chrono::high_resolution_clock::now();
+        while (true) {
+            auto curr = chrono::high_resolution_clock::now();
+            chrono::duration<double, milli> elapsed = curr - start;
+            if (elapsed.count() >= time) break;
         }
 
-        return shared_ptr<ExecValue>();
-    });
+        // returning passed value
+        return args[1];
+    }
 
-    addBuiltInFunction("_sleep", 2, [](const BuiltInArguments& args) {
-        if (args.get<ExecInteger>(0)) {
-            // doing busy wait
-            long long int time = args.get<ExecInteger>(0)->getValue();
+    return TaggedValue();
+}
+
+// registry is an immutable table, the slots of its perfect hash are found by the compiler
+static constexpr BuiltInFunction BUILT_IN_FUNCTIONS[] = {
+    BuiltInFunction("_eq", 2, isEqual),
+    BuiltInFunction("_neq", 2, builtInNeq),
+    BuiltInFunction("_lt", 2, builtInLt),
+    BuiltInFunction("_gt", 2, builtInGt),
+    BuiltInFunction("_leqt", 2, builtInLeqt),
+    BuiltInFunction("_geqt", 2, builtInGeqt),
+    BuiltInFunction("_mod", 2, builtInMod),
+    BuiltInFunction("_add", 2, builtInAdd),
+    BuiltInFunction("_sub", 2, builtInSub),
+    BuiltInFunction("_mul", 2, builtInMul),
+    BuiltInFunction("_div", 2, builtInDiv),
+    BuiltInFunction("_and", 2, builtInAnd),
+    BuiltInFunction("_or", 2, builtInOr),
+    BuiltInFunction("_xor", 2, builtInXor),
+    BuiltInFunction("_neg", 1, builtInNeg),
+    BuiltInFunction("_length", 1, builtInLength),
+    BuiltInFunction("_ch", 2, builtInCh),
+    BuiltInFunction("_con", 2, builtInCon),
+    BuiltInFunction("_integer", 1, builtInInteger),
+    BuiltInFunction("_float", 1, builtInFloat),
+    BuiltInFunction("_sleep", 2, builtInSleep, false),
+};
+
+static constexpr size_t BUILT_INS_COUNT = sizeof(BUILT_IN_FUNCTIONS) / sizeof(BUILT_IN_FUNCTIONS[0]);
+static constexpr size_t HASH_SIZE = 64;
+
+// FNV-1a, the high bits are folded in as the low bits alone repeat for every 64 seeds
+static constexpr unsigned hashName(const char* name, unsigned seed) {
+    unsigned res = 2166136261u ^ (seed * 2654435761u);
+    for (; *name; name++) res = (res ^ (unsigned char)*name) * 16777619u;
+    return res ^ (res >> 16);
+}
 
-            // doing busy wait to better simulate processing!
-            auto start = chrono::high_resolution_clock::now();
-            while (true) {
-                auto curr = chrono::high_resolution_clock::now();
-                chrono::duration<double, milli> elapsed = curr - start;
-                if (elapsed.count() >= time) break;
-            }
+struct BuiltInSlots {
+    unsigned seed;
+    int slots[HASH_SIZE];
+};
+
+// first seed without collisions - each name gets its own slot
+static constexpr BuiltInSlots findBuiltInSlots() {
+    for (unsigned seed = 0; ; seed++) {
+        BuiltInSlots res { seed, { } };
+        for (size_t i = 0; i < HASH_SIZE; i++) res.slots[i] = -1;
 
-            // returning passed value
-            return args.get<ExecValue>(1);
+        bool collision = false;
+        for (size_t i = 0; i < BUILT_INS_COUNT && !collision; i++) {
+            auto& slot = res.slots[hashName(BUILT_IN_FUNCTIONS[i].getName(), seed) % HASH_SIZE];
+            if (slot >= 0) collision = true;
+            slot = (int)i;
         }
+        if (!collision) return res;
+    }
+}
+
+static constexpr BuiltInSlots BUILT_IN_SLOTS = findBuiltInSlots();
+
+const BuiltInFunction* findBuiltInFunction(const string& name) {
+    int slot = BUILT_IN_SLOTS.slots[hashName(name.c_str(), BUILT_IN_SLOTS.seed) % HASH_SIZE];
+    if (slot < 0 || name != BUILT_IN_FUNCTIONS[slot].getName()) return nullptr;
 
-        return shared_ptr<ExecValue>();
-    });
+    return &BUILT_IN_FUNCTIONS[slot];
 }
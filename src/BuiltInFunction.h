@@ -1,56 +1,59 @@
 #ifndef BUILTIN_FUNCTION_H
 #define BUILTIN_FUNCTION_H
 
-#include <map>
 #include <vector>
 #include <string>
 #include <memory>
 #include <functional>
 
-class ExecValue;
+#include "ProgramExecutor.h"
 
+// arguments are only referenced - they are kept by the caller (e.g. in the registers of the VM)
 class BuiltInArguments {
 public:
-    explicit BuiltInArguments(std::vector<std::shared_ptr<ExecValue> > args) : args(std::move(args)) { }
+    BuiltInArguments(const TaggedValue* args, size_t count) : args(args), count(count) { }
 
     size_t size() const {
-        return args.size();
+        return count;
     }
 
-    template<class T> std::shared_ptr<T> get(size_t index) const {
-        return std::dynamic_pointer_cast<T>(args[index]);
+    const TaggedValue& operator[](size_t index) const {
+        return args[index];
     }
 
 private:
-    std::vector<std::shared_ptr<ExecValue> > args;
+    const TaggedValue* args;
+    size_t count;
 };
 
 class BuiltInFunction {
 public:
-    BuiltInFunction() = default;
-    BuiltInFunction(std::string, int, std::function<std::shared_ptr<ExecValue>(const BuiltInArguments&)>);
+    constexpr BuiltInFunction(const char* name, int argsCount, TaggedValue (*func)(const BuiltInArguments&), bool pure = true) :
+            name(name), argsCount(argsCount), func(func), pure(pure) { }
 
-    std::shared_ptr<ExecValue> operator()(const BuiltInArguments&) const;
+    TaggedValue operator()(const BuiltInArguments&) const;
 
-    bool isDefined() const {
-        return (bool)func;
-    }
-
-    const std::string& getName() const {
+    constexpr const char* getName() const {
         return name;
     }
 
-    int getArgsCount() const {
+    constexpr int getArgsCount() const {
         return argsCount;
     }
 
+    // result depends only on the arguments and there are no side effects (like the delay of the sleeping)
+    constexpr bool isPure() const {
+        return pure;
+    }
+
 private:
-    std::string name;
+    const char* name;
     int argsCount;
-    std::function<std::shared_ptr<ExecValue>(const BuiltInArguments&)> func;
+    TaggedValue (*func)(const BuiltInArguments&);
+    bool pure;
 };
 
-void initBuiltInFunctions();
-extern std::map<std::string, BuiltInFunction> BUILT_IN_FUNCTIONS;
+// built-in functions are an immutable registry, so it can be read from any thread - returns null for unknown name
+const BuiltInFunction* findBuiltInFunction(const std::string&);
 
 #endif
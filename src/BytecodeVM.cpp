@@ -0,0 +1,400 @@
+#include <stdexcept>
+
+#include "MemoCache.h"
+#include "BytecodeVM.h"
+#include "BuiltInFunction.h"
+
+using namespace std;
+
+static TaggedValue createConstant(const shared_ptr<Value>& value) {
+    if (dynamic_pointer_cast<BooleanValue>(value)) {
+        return TaggedValue::makeBoolean(dynamic_pointer_cast<BooleanValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<IntegerValue>(value)) {
+        return TaggedValue::makeInteger(dynamic_pointer_cast<IntegerValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<FloatValue>(value)) {
+        return TaggedValue::makeFloat(dynamic_pointer_cast<FloatValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<CharValue>(value)) {
+        return TaggedValue::makeChar(dynamic_pointer_cast<CharValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<StringValue>(value)) {
+        return TaggedValue::makeString(dynamic_pointer_cast<StringValue>(value)->getValue());
+    }
+    return TaggedValue::makeNull();
+}
+
+BytecodeVM::BytecodeVM(ProgramExecutor& executor) : executor(executor), executedStatements(0) {
+    auto& programFunctions = executor.getProgram()->getFunctions();
+
+    // indexes first, so the calls can be resolved in any order
+    functions.resize(programFunctions.size());
+    for (int i = 0; i < (int)programFunctions.size(); i++) {
+        functions[i].function = programFunctions[i];
+        functionIndexes.emplace(programFunctions[i].get(), i);
+    }
+
+    for (auto& function : functions) compileFunction(function);
+}
+
+int BytecodeVM::getInstructionsCount() const {
+    int res = 0;
+    for (auto& function : functions) res += (int)function.code.size();
+    return res;
+}
+
+shared_ptr<ExecValue> BytecodeVM::exec(const Function& function, shared_ptr<ExecValue> arg,
+                                       shared_ptr<ExecObject> readGlobal, shared_ptr<ExecObject> writeGlobal) {
+    auto indexIt = functionIndexes.find(&function);
+    if (indexIt == functionIndexes.end()) throw logic_error("Function named '" + function.getName() + "' is not compiled.");
+
+    auto& mainFunction = functions[indexIt->second];
+
+    ArenaVector<TaggedValue> registers(mainFunction.registersCount);
+    for (int i = 0; i < mainFunction.argsCount; i++) registers[i] = TaggedValue::unbox(arg);
+
+    return run(indexIt->second, registers, readGlobal, writeGlobal).box();
+}
+
+TaggedValue BytecodeVM::execCall(const Function& function, const vector<TaggedValue>& args) {
+    if (function.getArguments().size() != args.size()) {
+        throw logic_error("Bad arguments count for the function named '" + function.getName() + "'.");
+    }
+
+    auto indexIt = functionIndexes.find(&function);
+    if (indexIt == functionIndexes.end()) throw logic_error("Function named '" + function.getName() + "' is not compiled.");
+
+    ArenaVector<TaggedValue> registers(functions[indexIt->second].registersCount);
+    copy(args.begin(), args.end(), registers.begin());
+
+    // functions called from expressions cannot touch the global state
+    return run(indexIt->second, registers, shared_ptr<ExecObject>(), shared_ptr<ExecObject>());
+}
+
+TaggedValue BytecodeVM::run(int index, ArenaVector<TaggedValue>& registers,
+                            const shared_ptr<ExecObject>& readGlobal,
+                            const shared_ptr<ExecObject>& writeGlobal) {
+    ArenaVector<Frame> frames;
+
+    // arguments of the called pure functions, the result is cached under them when the function returns
+    ArenaVector<TaggedValue> memoArgs;
+    auto memo = executor.memoCache.get();
+
+    const CompiledFunction* function = &functions[index];
+    const Instruction* code = function->code.data();
+    size_t pc = 0;
+    size_t base = 0;
+
+    long long statements = 0;
+    TaggedValue res;
+
+    // function reached by a tail call of the first frame returns null instead of nothing, same as the skipped return
+    bool tailCalled = false;
+
+    while (true) {
+        const Instruction& ins = code[pc++];
+
+        switch (ins.op) {
+            case LoadConstant:
+                registers[base + ins.a] = constants[ins.b];
+                break;
+
+            case LoadLocal: {
+                auto& reg = registers[base + ins.b];
+
+                // objects are shared, they are copied only when they are modified later
+                if (ins.c < 0) registers[base + ins.a] = reg.isUndefined() ? TaggedValue::makeNull() : reg;
+                else if (reg.isObject()) registers[base + ins.a] = reg.getObject()->getValueByPath(paths[ins.c].fields);
+                else if (reg.isNull()) registers[base + ins.a] = TaggedValue::makeNull();
+                else throw logic_error("Bad return -> non-object value exists in the path.");
+                break;
+            }
+
+            case LoadGlobal:
+                if (!readGlobal) throw logic_error("Function called from expression cannot read global variables.");
+
+                registers[base + ins.a] = executor.loadGlobal(readGlobal, paths[ins.b].fields);
+                break;
+
+            case StoreLocal: {
+                auto& value = registers[base + ins.c];
+                if (value.isUndefined()) value = TaggedValue::makeNull();
+
+                auto& reg = registers[base + ins.a];
+                if (ins.b < 0) reg = move(value);
+                else {
+                    if (reg.isNull()) reg = TaggedValue::makeObject(make_shared<ExecObject>());
+
+                    if (!reg.isObject()) throw logic_error("Bad assignment -> non-object value exists in the path.");
+                    reg.getMutableObject()->setValueByPath(paths[ins.b].fields, move(value));
+                }
+
+                statements += 1;
+                break;
+            }
+
+            case StoreGlobal:
+                if (!writeGlobal) throw logic_error("Function called from expression cannot write global variables.");
+
+                executor.storeGlobal(writeGlobal, paths[ins.a].fields, move(registers[base + ins.b]));
+
+                statements += 1;
+                break;
+
+            case CallBuiltIn:
+                // arguments are passed directly from the registers
+                registers[base + ins.a] = (*builtIns[ins.b])(BuiltInArguments(registers.data() + base + ins.c, (size_t)ins.d));
+                break;
+
+            case Call: {
+                const CompiledFunction* memoized = nullptr;
+                if (memo && functions[ins.b].function->isPure()) {
+                    auto args = registers.data() + base + ins.c;
+                    if (memo->find(*functions[ins.b].function, args, (size_t)ins.d, registers[base + ins.a])) break;
+
+                    memoArgs.insert(memoArgs.end(), args, args + ins.d);
+                    memoized = &functions[ins.b];
+                }
+
+                frames.push_back({ function, pc, base, ins.a, memoized });
+
+                // arguments are moved to the first registers of the new frame
+                size_t callerBase = base;
+                base += function->registersCount;
+                function = &functions[ins.b];
+                code = function->code.data();
+                pc = 0;
+
+                registers.resize(base + function->registersCount);
+                for (int i = 0; i < ins.d; i++) registers[base + i] = move(registers[callerBase + ins.c + i]);
+                break;
+            }
+
+            case TailCall: {
+                // arguments are moved to the first registers of the frame, the rest is cleared for the callee
+                size_t oldCount = function->registersCount;
+                function = &functions[ins.b];
+                code = function->code.data();
+                pc = 0;
+
+                if (ins.c != 0) {
+                    for (int i = 0; i < ins.d; i++) registers[base + i] = move(registers[base + ins.c + i]);
+                }
+                for (size_t i = ins.d; i < oldCount; i++) registers[base + i] = TaggedValue();
+                registers.resize(base + function->registersCount);
+
+                if (frames.empty()) tailCalled = true;
+                break;
+            }
+
+            case JumpIfFalse: {
+                auto& cond = registers[base + ins.a];
+                if (!cond.isBoolean()) throw logic_error("Condition value does not evaluate to boolean.");
+                if (!cond.getBoolean()) pc = (size_t)ins.b;
+
+                statements += 1;
+                break;
+            }
+
+            case JumpTable: {
+                // only strings can equal the literals of the cases
+                auto& value = registers[base + ins.a];
+                auto& table = jumpTables[ins.b];
+
+                int index = value.isString() ? table.dispatch->findCase(value.getString()) : -1;
+                pc = (size_t)(index < 0 ? table.end : table.cases[index]);
+
+                statements += 1;
+                break;
+            }
+
+            case Jump:
+                pc = (size_t)ins.a;
+                break;
+
+            case ReturnValue:
+            case ReturnNull: {
+                if (ins.op == ReturnValue) {
+                    res = move(registers[base + ins.a]);
+                    statements += 1;
+                }
+                else if (frames.empty() && tailCalled) res = TaggedValue::makeNull();
+                else res = TaggedValue();
+
+                if (frames.empty()) {
+                    executedStatements += statements;
+                    return res;
+                }
+
+                registers.resize(base);
+
+                auto& frame = frames.back();
+                if (frame.memoized) {
+                    size_t argsCount = frame.memoized->argsCount;
+                    memo->insert(*frame.memoized->function, memoArgs.data() + memoArgs.size() - argsCount, argsCount, res);
+                    memoArgs.resize(memoArgs.size() - argsCount);
+                }
+
+                function = frame.function;
+                code = function->code.data();
+                pc = frame.pc;
+                base = frame.base;
+                registers[base + frame.result] = move(res);
+
+                frames.pop_back();
+                break;
+            }
+
+        }
+    }
+}
+
+void BytecodeVM::compileFunction(CompiledFunction& compiled) {
+    auto& function = compiled.function;
+
+    // locals take the first registers (arguments are the first slots), temporaries are at the end
+    Scope scope;
+    scope.tempsBase = function->getSlotsCount();
+    scope.tempsCount = 0;
+
+    for (auto& statement : function->getStatements()) compileStatement(statement, scope, compiled.code);
+    compiled.code.push_back({ ReturnNull, 0, 0, 0, 0 });
+
+    compiled.argsCount = (int)function->getArguments().size();
+    compiled.registersCount = scope.tempsBase + scope.tempsCount;
+}
+
+void BytecodeVM::compileStatement(const shared_ptr<Statement>& statement, Scope& scope, vector<Instruction>& code) {
+    int temp = scope.tempsBase;
+    scope.tempsCount = max(scope.tempsCount, 1);
+
+    if (dynamic_pointer_cast<Return>(statement)) {
+        compileValue(dynamic_pointer_cast<Return>(statement)->getValue(), temp, code);
+        code.push_back({ ReturnValue, temp, 0, 0, 0 });
+    }
+    else if (dynamic_pointer_cast<Condition>(statement)) {
+        auto cond = dynamic_pointer_cast<Condition>(statement);
+        compileValue(cond->getConditionValue(), temp, code);
+
+        size_t condJump = code.size();
+        code.push_back({ JumpIfFalse, temp, 0, 0, 0 });
+
+        for (auto& condStatement : cond->getThenStatements()) compileStatement(condStatement, scope, code);
+
+        if (cond->getElseStatements().empty()) {
+            code[condJump].b = (int)code.size();
+            return;
+        }
+
+        size_t endJump = code.size();
+        code.push_back({ Jump, 0, 0, 0, 0 });
+        code[condJump].b = (int)code.size();
+
+        for (auto& condStatement : cond->getElseStatements()) compileStatement(condStatement, scope, code);
+        code[endJump].a = (int)code.size();
+    }
+    else if (dynamic_pointer_cast<Dispatch>(statement)) {
+        auto dispatch = dynamic_pointer_cast<Dispatch>(statement);
+        compileValue(dispatch->getValue(), temp, code);
+
+        int table = (int)jumpTables.size();
+        jumpTables.push_back({ dispatch.get(), vector<int>(), 0 });
+        code.push_back({ JumpTable, temp, table, 0, 0 });
+
+        // every case except the last one jumps over the following ones
+        vector<size_t> endJumps;
+        for (int i = 0; i < dispatch->getCasesCount(); i++) {
+            jumpTables[table].cases.push_back((int)code.size());
+            for (auto& caseStatement : dispatch->getCaseStatements(i)) compileStatement(caseStatement, scope, code);
+
+            if (i + 1 < dispatch->getCasesCount()) {
+                endJumps.push_back(code.size());
+                code.push_back({ Jump, 0, 0, 0, 0 });
+            }
+        }
+
+        jumpTables[table].end = (int)code.size();
+        for (auto endJump : endJumps) code[endJump].a = (int)code.size();
+    }
+    else if (dynamic_pointer_cast<ConstantAssignment>(statement)) {
+        auto assign = dynamic_pointer_cast<ConstantAssignment>(statement);
+        compileValue(assign->getValue(), temp, code);
+        compileStore(assign->getTarget(), temp, code);
+    }
+    else if (dynamic_pointer_cast<IdentifierAssignment>(statement)) {
+        auto assign = dynamic_pointer_cast<IdentifierAssignment>(statement);
+        compileValue(assign->getValue(), temp, code);
+        compileStore(assign->getTarget(), temp, code);
+    }
+    else if (dynamic_pointer_cast<CallAssignment>(statement)) {
+        auto assign = dynamic_pointer_cast<CallAssignment>(statement);
+        auto& args = assign->getFunctionArgs();
+
+        // callee and the arguments count are checked by the link step of the executor
+        auto function = assign->getFunction();
+        auto builtInFunction = assign->getBuiltInFunction();
+
+        // arguments are evaluated into consecutive temporaries, the result replaces the first one
+        scope.tempsCount = max(scope.tempsCount, (int)args.size());
+        for (int i = 0; i < (int)args.size(); i++) compileValue(args[i], temp + i, code);
+
+        if (function && assign->isTailCall()) {
+            // returning the stored result is left to the callee
+            code.push_back({ TailCall, 0, functionIndexes[function], temp, (int)args.size() });
+            return;
+        }
+
+        if (function) {
+            code.push_back({ Call, temp, functionIndexes[function], temp, (int)args.size() });
+        }
+        else {
+            auto builtInPos = find(builtIns.begin(), builtIns.end(), builtInFunction);
+            if (builtInPos == builtIns.end()) builtInPos = builtIns.insert(builtIns.end(), builtInFunction);
+
+            code.push_back({ CallBuiltIn, temp, (int)(builtInPos - builtIns.begin()), temp, (int)args.size() });
+        }
+
+        compileStore(assign->getTarget(), temp, code);
+    }
+}
+
+void BytecodeVM::compileStore(const shared_ptr<Identifier>& target, int src, vector<Instruction>& code) {
+    if (target->isGlobal()) {
+        code.push_back({ StoreGlobal, addPath(*target), src, 0, 0 });
+        return;
+    }
+
+    int path = target->getFieldPath().empty() ? -1 : addPath(*target);
+    code.push_back({ StoreLocal, target->getSlot(), path, src, 0 });
+}
+
+int BytecodeVM::compileValue(const shared_ptr<Value>& value, int dst, vector<Instruction>& code) {
+    if (dynamic_pointer_cast<IdentifierValue>(value)) {
+        auto identifier = dynamic_pointer_cast<IdentifierValue>(value)->getIdentifier();
+
+        if (identifier->isGlobal()) {
+            code.push_back({ LoadGlobal, dst, addPath(*identifier), 0, 0 });
+            return dst;
+        }
+
+        int path = identifier->getFieldPath().empty() ? -1 : addPath(*identifier);
+        code.push_back({ LoadLocal, dst, identifier->getSlot(), path, 0 });
+        return dst;
+    }
+
+    constants.push_back(createConstant(value));
+    code.push_back({ LoadConstant, dst, (int)constants.size() - 1, 0, 0 });
+    return dst;
+}
+
+int BytecodeVM::addPath(const Identifier& identifier) {
+    auto& fields = identifier.getFieldPath();
+    auto pathPos = find_if(paths.begin(), paths.end(), [&](const Path& path) {
+        return path.fields == fields && path.name == identifier.getName();
+    });
+    if (pathPos != paths.end()) return (int)(pathPos - paths.begin());
+
+    paths.push_back({ fields, identifier.getName() });
+    return (int)paths.size() - 1;
+}
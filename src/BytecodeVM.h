@@ -0,0 +1,115 @@
+#ifndef BYTECODE_VM_H
+#define BYTECODE_VM_H
+
+#include <map>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "ProgramExecutor.h"
+
+class BuiltInFunction;
+
+// Program compiled into flat bytecode of a register machine. Called functions and built-in functions are resolved
+// by the compiler, local variables use the slots resolved by the analyzer - root of every local variable is
+// a register of the function frame, the rest of a dotted name is a path of interned fields into the object in the
+// register.
+// Calls do not recurse on the C++ stack, frames of the called functions are pushed to the VM stack.
+class BytecodeVM {
+public:
+    explicit BytecodeVM(ProgramExecutor&);
+
+    // runs the main or its specialized variant chosen by the executor
+    std::shared_ptr<ExecValue> exec(const Function&, std::shared_ptr<ExecValue>, std::shared_ptr<ExecObject>, std::shared_ptr<ExecObject>);
+    TaggedValue execCall(const Function&, const std::vector<TaggedValue>&);
+
+    long long getExecutedStatements() const {
+        return executedStatements;
+    }
+
+    int getInstructionsCount() const;
+
+private:
+    enum OpCode {
+        LoadConstant,   // a = constants[b]
+        LoadLocal,      // a = register b (at path c)
+        LoadGlobal,     // a = global at path b
+        StoreLocal,     // register a (at path b) = c
+        StoreGlobal,    // global at path a = b
+        CallBuiltIn,    // a = builtIns[b](registers c .. c + d - 1)
+        Call,           // a = functions[b](registers c .. c + d - 1)
+        TailCall,       // return functions[b](registers c .. c + d - 1), the frame is reused
+        JumpIfFalse,    // if not a, continue at b
+        JumpTable,      // continue at the case of a in jumpTables[b]
+        Jump,           // continue at a
+        ReturnValue,    // return a
+        ReturnNull      // return without value
+    };
+
+    struct Instruction {
+        OpCode op;
+        int a, b, c, d;
+    };
+
+    struct CompiledFunction {
+        std::shared_ptr<Function> function;
+        int argsCount;
+        int registersCount;
+        std::vector<Instruction> code;
+    };
+
+    // state of the function being compiled, temporaries follow the slots of the locals
+    struct Scope {
+        int tempsBase;
+        int tempsCount;
+    };
+
+    // targets of the cases of the dispatch, values without a case continue at the end
+    struct JumpTarget {
+        const Dispatch* dispatch;
+        std::vector<int> cases;
+        int end;
+    };
+
+    // global paths keep the name for the runtime callbacks
+    struct Path {
+        FieldPath fields;
+        std::string name;
+    };
+
+    // suspended caller on the VM stack
+    struct Frame {
+        const CompiledFunction* function;
+        size_t pc;
+        size_t base;
+        int result;
+
+        // called function whose result is cached, its arguments are on the top of the memo arguments stack
+        const CompiledFunction* memoized;
+    };
+
+    void compileFunction(CompiledFunction&);
+    void compileStatement(const std::shared_ptr<Statement>&, Scope&, std::vector<Instruction>&);
+    void compileStore(const std::shared_ptr<Identifier>&, int, std::vector<Instruction>&);
+    int compileValue(const std::shared_ptr<Value>&, int, std::vector<Instruction>&);
+
+    int addPath(const Identifier&);
+
+    TaggedValue run(int, ArenaVector<TaggedValue>&,
+            const std::shared_ptr<ExecObject>&, const std::shared_ptr<ExecObject>&);
+
+    ProgramExecutor& executor;
+
+    std::vector<CompiledFunction> functions;
+    std::map<const Function*, int> functionIndexes;
+
+    std::vector<TaggedValue> constants;
+    std::vector<const BuiltInFunction*> builtIns;
+    std::vector<Path> paths;
+    std::vector<JumpTarget> jumpTables;
+
+    std::atomic<long long> executedStatements;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef FIELD_TABLE_H
+#define FIELD_TABLE_H
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+// Fields of an object keyed by the interned names, kept in the insertion order. Objects usually have only a few
+// fields, so the first INLINE_SIZE fields are stored inline and searched linearly. Bigger objects move the fields
+// to the heap and find them through an open addressing index. Fields are never removed.
+template <class T> class FieldTable {
+public:
+    static constexpr size_t INLINE_SIZE = 4;
+
+    struct Field {
+        int id;
+        T value;
+    };
+
+    FieldTable() : count(0) { }
+
+    FieldTable(const FieldTable& other) : count(0) {
+        *this = other;
+    }
+
+    FieldTable& operator=(const FieldTable& other) {
+        if (this == &other) return *this;
+
+        count = other.count;
+        if (count <= INLINE_SIZE) {
+            std::copy(other.begin(), other.end(), inlineFields);
+            std::fill(inlineFields + count, inlineFields + INLINE_SIZE, Field { 0, T() });
+            heapFields.clear();
+            index.clear();
+        }
+        else {
+            // stale inline values would keep their objects alive
+            std::fill(inlineFields, inlineFields + INLINE_SIZE, Field { 0, T() });
+            heapFields = other.heapFields;
+            index = other.index;
+        }
+        return *this;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    const Field* begin() const {
+        return count <= INLINE_SIZE ? inlineFields : heapFields.data();
+    }
+
+    const Field* end() const {
+        return begin() + count;
+    }
+
+    Field* begin() {
+        return count <= INLINE_SIZE ? inlineFields : heapFields.data();
+    }
+
+    Field* end() {
+        return begin() + count;
+    }
+
+    const T* find(int id) const {
+        int pos = position(id);
+        return pos < 0 ? nullptr : &begin()[pos].value;
+    }
+
+    // value of the field, missing field is added with the default value
+    T& operator[](int id) {
+        int pos = position(id);
+        if (pos >= 0) return begin()[pos].value;
+
+        if (count < INLINE_SIZE) {
+            inlineFields[count] = { id, T() };
+            return inlineFields[count++].value;
+        }
+
+        if (count == INLINE_SIZE) {
+            heapFields.reserve(INLINE_SIZE * 2);
+            for (auto& field : inlineFields) heapFields.push_back(std::move(field));
+        }
+
+        heapFields.push_back({ id, T() });
+        count += 1;
+
+        // index is kept at most half full
+        if (index.size() < count * 2) rebuildIndex();
+        else insertIndex(count - 1);
+
+        return heapFields.back().value;
+    }
+
+private:
+    static size_t hash(int id) {
+        return (size_t)id * 2654435761u;
+    }
+
+    int position(int id) const {
+        if (count <= INLINE_SIZE) {
+            for (size_t i = 0; i < count; i++) {
+                if (inlineFields[i].id == id) return (int)i;
+            }
+            return -1;
+        }
+
+        // index stores positions + 1, zero is an empty bucket
+        size_t mask = index.size() - 1;
+        for (size_t bucket = hash(id) & mask; index[bucket]; bucket = (bucket + 1) & mask) {
+            if (heapFields[index[bucket] - 1].id == id) return index[bucket] - 1;
+        }
+        return -1;
+    }
+
+    void rebuildIndex() {
+        size_t size = 16;
+        while (size < count * 4) size *= 2;
+
+        index.assign(size, 0);
+        for (size_t i = 0; i < count; i++) insertIndex(i);
+    }
+
+    void insertIndex(size_t pos) {
+        size_t mask = index.size() - 1;
+        size_t bucket = hash(heapFields[pos].id) & mask;
+        while (index[bucket]) bucket = (bucket + 1) & mask;
+        index[bucket] = (int)pos + 1;
+    }
+
+    size_t count;
+    Field inlineFields[INLINE_SIZE];
+    std::vector<Field> heapFields;
+    std::vector<int> index;
+};
+
+#endif
@@ -15,8 +15,8 @@ static bool resultHasName(shared_ptr<ExecValue> res, u32string name) {
     return nameObj->getValue() == name;
 }
 
-GuiRuntime::GuiRuntime(const std::string& filePath, Scheduler::Type type, int workers) :
-        ProgramRuntime(filePath, type, workers) {
+GuiRuntime::GuiRuntime(const std::string& filePath, Scheduler::Type type, int workers, bool optimized) :
+        ProgramRuntime(filePath, type, workers, optimized) {
     // registering messages
     registerMessageGenerator("guiUpdate", 1, [] {
         return generateMessage(U"guiUpdate", U"gui");
@@ -5,7 +5,7 @@
 
 class GuiRuntime : public ProgramRuntime {
 public:
-    explicit GuiRuntime(const std::string& filePath, Scheduler::Type type, int workers);
+    explicit GuiRuntime(const std::string& filePath, Scheduler::Type type, int workers, bool optimized = true);
 
 protected:
     std::shared_ptr<ExecObject> createInitMessage() const override;
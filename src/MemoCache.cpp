@@ -0,0 +1,173 @@
+#include <cstring>
+#include <functional>
+
+#include "MemoCache.h"
+
+using namespace std;
+
+static size_t combineHash(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+// floats are compared by their bits, so zero and negative zero (dividing to the different infinities) differ
+static long long getFloatBits(double value) {
+    long long res;
+    memcpy(&res, &value, sizeof(res));
+    return res;
+}
+
+size_t hashStructure(const TaggedValue& value) {
+    // undefined value is read as null
+    auto type = value.isNull() ? TaggedValue::Null : value.getType();
+    size_t res = combineHash(0, type);
+
+    switch (type) {
+        case TaggedValue::Boolean: return combineHash(res, value.getBoolean());
+        case TaggedValue::Integer: return combineHash(res, hash<long long>()(value.getInteger()));
+        case TaggedValue::Float: return combineHash(res, hash<long long>()(getFloatBits(value.getFloat())));
+        case TaggedValue::Char: return combineHash(res, value.getChar());
+        case TaggedValue::String: return combineHash(res, hash<u32string>()(value.getString()));
+        case TaggedValue::Object: {
+            // fields are summed up, so the insertion order does not change the hash
+            size_t fields = 0;
+            for (auto& field : value.getObject()->getFields()) {
+                fields += combineHash(hash<int>()(field.id), hashStructure(field.value));
+            }
+            return combineHash(res, fields);
+        }
+        default: return res;
+    }
+}
+
+bool isStructureEqual(const TaggedValue& left, const TaggedValue& right) {
+    if (left.isNull() || right.isNull()) return left.isNull() && right.isNull();
+    if (left.getType() != right.getType()) return false;
+
+    switch (left.getType()) {
+        case TaggedValue::Boolean: return left.getBoolean() == right.getBoolean();
+        case TaggedValue::Integer: return left.getInteger() == right.getInteger();
+        case TaggedValue::Float: return getFloatBits(left.getFloat()) == getFloatBits(right.getFloat());
+        case TaggedValue::Char: return left.getChar() == right.getChar();
+        case TaggedValue::String: return left.getString() == right.getString();
+        case TaggedValue::Object: {
+            // shared object is equal without comparing the fields
+            auto leftObj = left.getObject(), rightObj = right.getObject();
+            if (leftObj == rightObj) return true;
+
+            auto& leftFields = leftObj->getFields();
+            auto& rightFields = rightObj->getFields();
+            if (leftFields.size() != rightFields.size()) return false;
+
+            for (auto& field : leftFields) {
+                auto rightValue = rightFields.find(field.id);
+                if (!rightValue || !isStructureEqual(field.value, *rightValue)) return false;
+            }
+            return true;
+        }
+        default: return false;
+    }
+}
+
+bool MemoCache::KeyEqual::operator()(const Key& left, const Key& right) const {
+    if (left.hash != right.hash || left.function != right.function || left.count != right.count) return false;
+
+    for (size_t i = 0; i < left.count; i++) {
+        if (!isStructureEqual(left.args[i], right.args[i])) return false;
+    }
+    return true;
+}
+
+MemoCache::MemoCache(size_t capacity) : shardCapacity(max<size_t>(1, capacity / SHARDS_COUNT)) {
+}
+
+MemoCache::Key MemoCache::makeKey(const Function& function, const TaggedValue* args, size_t count) {
+    size_t res = hash<const Function*>()(&function);
+    for (size_t i = 0; i < count; i++) res = combineHash(res, hashStructure(args[i]));
+
+    // spreading the bits, the shard is selected by the high ones
+    res *= 0x9e3779b97f4a7c15ull;
+    return { &function, args, count, res ^ (res >> 32) };
+}
+
+bool MemoCache::find(const Function& function, const TaggedValue* args, size_t count, TaggedValue& res) {
+    auto key = makeKey(function, args, count);
+    auto& shard = getShard(key.hash);
+
+    lock_guard<mutex> lock(shard.mutex);
+    auto entryIt = shard.index.find(key);
+    if (entryIt == shard.index.end()) {
+        shard.misses += 1;
+        return false;
+    }
+
+    shard.hits += 1;
+    shard.entries.splice(shard.entries.begin(), shard.entries, entryIt->second);
+    res = entryIt->second->result;
+    return true;
+}
+
+void MemoCache::insert(const Function& function, const TaggedValue* args, size_t count, const TaggedValue& result) {
+    auto key = makeKey(function, args, count);
+    auto& shard = getShard(key.hash);
+
+    lock_guard<mutex> lock(shard.mutex);
+
+    // another worker could cache the same call in the meantime
+    if (shard.index.find(key) != shard.index.end()) return;
+
+    if (shard.entries.size() >= shardCapacity) {
+        auto& last = shard.entries.back();
+        shard.index.erase({ last.function, last.args.data(), last.args.size(), last.hash });
+        shard.entries.pop_back();
+        shard.evictions += 1;
+    }
+
+    shard.entries.push_front({ &function, vector<TaggedValue>(args, args + count), key.hash, result });
+    auto& entry = shard.entries.front();
+    shard.index.emplace(Key { entry.function, entry.args.data(), entry.args.size(), entry.hash }, shard.entries.begin());
+}
+
+size_t MemoCache::getSize() const {
+    size_t res = 0;
+    for (auto& shard : shards) {
+        lock_guard<mutex> lock(shard.mutex);
+        res += shard.entries.size();
+    }
+    return res;
+}
+
+long long MemoCache::getHits() const {
+    long long res = 0;
+    for (auto& shard : shards) {
+        lock_guard<mutex> lock(shard.mutex);
+        res += shard.hits;
+    }
+    return res;
+}
+
+long long MemoCache::getMisses() const {
+    long long res = 0;
+    for (auto& shard : shards) {
+        lock_guard<mutex> lock(shard.mutex);
+        res += shard.misses;
+    }
+    return res;
+}
+
+long long MemoCache::getEvictions() const {
+    long long res = 0;
+    for (auto& shard : shards) {
+        lock_guard<mutex> lock(shard.mutex);
+        res += shard.evictions;
+    }
+    return res;
+}
+
+void MemoCache::clear() {
+    for (auto& shard : shards) {
+        lock_guard<mutex> lock(shard.mutex);
+        shard.index.clear();
+        shard.entries.clear();
+        shard.hits = shard.misses = shard.evictions = 0;
+    }
+}
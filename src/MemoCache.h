@@ -0,0 +1,96 @@
+#ifndef MEMO_CACHE_H
+#define MEMO_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <unordered_map>
+
+#include "ProgramExecutor.h"
+
+// Results of the pure functions (marked by the analyzer) keyed by the called function and the structure of the
+// argument values. The cache is shared by all the workers, so it is split into shards by the hash of the call - every
+// shard has its own lock and evicts the least recently used results when it is full.
+// Results are kept as they are, objects are copy-on-write, so the callers never modify a cached result.
+class MemoCache {
+public:
+    static constexpr size_t SHARDS_COUNT = 16;
+    static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+    explicit MemoCache(size_t capacity = DEFAULT_CAPACITY);
+
+    MemoCache(const MemoCache&) = delete;
+    MemoCache& operator=(const MemoCache&) = delete;
+
+    // result is set only when the call is cached
+    bool find(const Function&, const TaggedValue*, size_t, TaggedValue&);
+    void insert(const Function&, const TaggedValue*, size_t, const TaggedValue&);
+
+    size_t getCapacity() const {
+        return shardCapacity * SHARDS_COUNT;
+    }
+
+    size_t getSize() const;
+    long long getHits() const;
+    long long getMisses() const;
+    long long getEvictions() const;
+
+    void clear();
+
+private:
+    // cached call, arguments are owned by the entry
+    struct Entry {
+        const Function* function;
+        std::vector<TaggedValue> args;
+        size_t hash;
+        TaggedValue result;
+    };
+
+    // lookup key referencing the arguments of the caller or of the entry, so the lookup does not copy them
+    struct Key {
+        const Function* function;
+        const TaggedValue* args;
+        size_t count;
+        size_t hash;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return key.hash;
+        }
+    };
+
+    struct KeyEqual {
+        bool operator()(const Key&, const Key&) const;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+
+        // most recently used entries first
+        std::list<Entry> entries;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash, KeyEqual> index;
+
+        long long hits = 0;
+        long long misses = 0;
+        long long evictions = 0;
+    };
+
+    static Key makeKey(const Function&, const TaggedValue*, size_t);
+
+    Shard& getShard(size_t hash) {
+        // low bits select the bucket of the shard index, the shard is taken from the high ones
+        return shards[(hash >> 24) % SHARDS_COUNT];
+    }
+
+    size_t shardCapacity;
+    mutable Shard shards[SHARDS_COUNT];
+};
+
+// structure of the value - equal objects have the same fields with equal values, field order does not matter,
+// floats are equal only with the same bits
+size_t hashStructure(const TaggedValue&);
+bool isStructureEqual(const TaggedValue&, const TaggedValue&);
+
+#endif
@@ -0,0 +1,33 @@
+#include <algorithm>
+
+#include "MessageArena.h"
+
+using namespace std;
+
+MessageArena::Scope::Scope() : arena(MessageArena::current()), chunk(arena.chunk), used(arena.used) {
+}
+
+MessageArena::Scope::~Scope() {
+    arena.chunk = chunk;
+    arena.used = used;
+}
+
+MessageArena& MessageArena::current() {
+    thread_local MessageArena arena;
+    return arena;
+}
+
+void* MessageArena::allocateChunk(size_t size, size_t align) {
+    // next kept chunk big enough for the allocation, a new one when there is none
+    size_t next = chunks.empty() ? 0 : chunk + 1;
+    while (next < chunks.size() && chunks[next].size < size + align) next++;
+
+    if (next == chunks.size()) {
+        size_t chunkSize = max(CHUNK_SIZE, size + align);
+        chunks.push_back({ unique_ptr<char[]>(new char[chunkSize]), chunkSize });
+    }
+
+    chunk = next;
+    used = 0;
+    return allocate(size, align);
+}
@@ -0,0 +1,103 @@
+#ifndef MESSAGE_ARENA_H
+#define MESSAGE_ARENA_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+// Bump allocator for the temporaries of one message execution - frames of the called functions, arguments of the
+// built-in functions, registers of the VM. Every thread has its own arena, memory allocated in a scope is given back
+// all at once when the scope is closed and the chunks are kept for the next messages.
+// Values of the program (objects, strings) are never allocated here, they are shared with the global state and the
+// results, so nothing has to be promoted out of the arena.
+class MessageArena {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    // allocations made while the scope is open are released when it is closed, scopes can be nested
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        MessageArena& arena;
+        size_t chunk;
+        size_t used;
+    };
+
+    // arena of the calling thread
+    static MessageArena& current();
+
+    void* allocate(size_t size, size_t align) {
+        size_t start = (used + align - 1) & ~(align - 1);
+        if (chunk < chunks.size() && start + size <= chunks[chunk].size) {
+            used = start + size;
+            return chunks[chunk].data.get() + start;
+        }
+        return allocateChunk(size, align);
+    }
+
+    // only the last allocation is given back (frames are released in the reverse order), others wait for the scope
+    void deallocate(void* ptr, size_t size) {
+        if (chunk < chunks.size() && static_cast<char*>(ptr) + size == chunks[chunk].data.get() + used) {
+            used = static_cast<char*>(ptr) - chunks[chunk].data.get();
+        }
+    }
+
+    size_t getChunksCount() const {
+        return chunks.size();
+    }
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    MessageArena() : chunk(0), used(0) { }
+
+    void* allocateChunk(size_t, size_t);
+
+    std::vector<Chunk> chunks;
+    size_t chunk;
+    size_t used;
+};
+
+// allocator of the standard containers using the arena of the thread which created them
+template <class T> class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    ArenaAllocator() : arena(&MessageArena::current()) { }
+
+    template <class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) { }
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, size_t count) {
+        arena->deallocate(ptr, count * sizeof(T));
+    }
+
+    friend bool operator==(const ArenaAllocator& l, const ArenaAllocator& r) {
+        return l.arena == r.arena;
+    }
+
+    friend bool operator!=(const ArenaAllocator& l, const ArenaAllocator& r) {
+        return l.arena != r.arena;
+    }
+
+private:
+    MessageArena* arena;
+
+    template <class U> friend class ArenaAllocator;
+};
+
+template <class T> using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+#endif
@@ -9,19 +9,26 @@
 #include <locale>
 #include <codecvt>
 #include <algorithm>
+#include <unordered_map>
 
 extern std::string GLOBAL_PREFIX;
 extern std::string LOCAL_PREFIX;
 
+class Function;
+class Dispatch;
+class BuiltInFunction;
+
 // Utils
 class Identifier {
 public:
+    Identifier() : global(false), slot(-1) { }
+
     bool isGlobal() const {
-        return fullName.substr(0, GLOBAL_PREFIX.length()) == GLOBAL_PREFIX;
+        return global;
     }
 
     bool isLocal() const {
-        return fullName.substr(0, LOCAL_PREFIX.length()) == LOCAL_PREFIX;
+        return fullName.compare(0, LOCAL_PREFIX.length(), LOCAL_PREFIX) == 0;
     }
 
     const std::string& getFullName() const {
@@ -30,15 +37,40 @@ public:
 
     void setFullName(const std::string& fullName) {
         this->fullName = fullName;
+
+        global = fullName.compare(0, GLOBAL_PREFIX.length(), GLOBAL_PREFIX) == 0;
+        name = fullName.substr(std::min(fullName.length(), global ? GLOBAL_PREFIX.length() : LOCAL_PREFIX.length()));
+    }
+
+    const std::string& getName() const {
+        return name;
+    }
+
+    // frame slot of the local variable (-1 for the global one), set by the analyzer
+    int getSlot() const {
+        return slot;
+    }
+
+    void setSlot(int slot) {
+        this->slot = slot;
+    }
+
+    // interned fields of the path - whole name of the global variable, rest of the name after the slot for the local one
+    const std::vector<int>& getFieldPath() const {
+        return fieldPath;
     }
 
-    std::string getName() const {
-        if (isGlobal()) return fullName.substr(GLOBAL_PREFIX.length());
-        return fullName.substr(LOCAL_PREFIX.length());
+    void setFieldPath(const std::vector<int>& fieldPath) {
+        this->fieldPath = fieldPath;
     }
 
 private:
     std::string fullName;
+    std::string name;
+    bool global;
+
+    int slot;
+    std::vector<int> fieldPath;
 };
 
 // Values
@@ -85,7 +117,7 @@ class NullValue : public ConstantValue
 
 class IdentifierValue : public Value {
 public:
-    std::shared_ptr<Identifier> getIdentifier() const {
+    const std::shared_ptr<Identifier>& getIdentifier() const {
         return identifier;
     }
 
@@ -107,21 +139,38 @@ public:
 class CallExpression : public Expression {
 public:
     explicit CallExpression(std::string name, std::vector<std::shared_ptr<Expression> > arguments)
-            : name(std::move(name)), arguments(std::move(arguments)) { }
+            : name(std::move(name)), arguments(std::move(arguments)), function(nullptr), builtInFunction(nullptr) {
+        // arguments are shared by many expressions, so the result is not searched for again
+        undetermined = false;
+        for (auto& arg : this->arguments) {
+            if (!arg || arg->isUndetermined()) undetermined = true;
+        }
+    }
 
     const std::string& getName() const {
         return name;
     }
 
+    // called function resolved by the link step of the executor
+    Function* getFunction() const {
+        return function;
+    }
+
+    const BuiltInFunction* getBuiltInFunction() const {
+        return builtInFunction;
+    }
+
+    void setCallee(Function* function, const BuiltInFunction* builtInFunction) {
+        this->function = function;
+        this->builtInFunction = builtInFunction;
+    }
+
     const std::vector<std::shared_ptr<Expression> >& getArguments() const {
         return arguments;
     }
 
     bool isUndetermined() const override {
-        for (auto& arg : arguments) {
-            if (!arg || arg->isUndetermined()) return true;
-        }
-        return false;
+        return undetermined;
     }
 
     std::string toString() const override {
@@ -136,6 +185,32 @@ public:
 private:
     std::string name;
     std::vector<std::shared_ptr<Expression> > arguments;
+
+    Function* function;
+    const BuiltInFunction* builtInFunction;
+    bool undetermined;
+};
+
+// comparison of the dispatched value with the literal of the case, it is evaluated as the `_eq` call except
+// the access predicates, which look the value up in the table of the dispatch
+class CaseExpression : public CallExpression {
+public:
+    CaseExpression(std::shared_ptr<Expression> valueExpression, std::shared_ptr<Expression> literalExpression,
+                   const Dispatch* dispatch, int caseIndex) :
+            CallExpression("_eq", { std::move(valueExpression), std::move(literalExpression) }),
+            dispatch(dispatch), caseIndex(caseIndex) { }
+
+    const Dispatch* getDispatch() const {
+        return dispatch;
+    }
+
+    int getCaseIndex() const {
+        return caseIndex;
+    }
+
+private:
+    const Dispatch* dispatch;
+    int caseIndex;
 };
 
 class ConditionExpression : public Expression {
@@ -143,7 +218,11 @@ public:
     ConditionExpression(std::shared_ptr<Expression> conditionExpression, std::shared_ptr<Expression> thenExpression,
                         std::shared_ptr<Expression> elseExpression) :
             conditionExpression(std::move(conditionExpression)), thenExpression(std::move(thenExpression)),
-            elseExpression(std::move(elseExpression)) { }
+            elseExpression(std::move(elseExpression)) {
+        undetermined = !this->conditionExpression || !this->thenExpression || !this->elseExpression ||
+                       this->conditionExpression->isUndetermined() || this->thenExpression->isUndetermined() ||
+                       this->elseExpression->isUndetermined();
+    }
 
     const std::shared_ptr<Expression>& getConditionExpression() const {
         return conditionExpression;
@@ -158,8 +237,7 @@ public:
     }
 
     bool isUndetermined() const override {
-        return !conditionExpression || !thenExpression || !elseExpression || conditionExpression->isUndetermined() ||
-               thenExpression->isUndetermined() || elseExpression->isUndetermined();
+        return undetermined;
     }
 
     std::string toString() const override {
@@ -178,6 +256,7 @@ private:
     std::shared_ptr<Expression> conditionExpression;
     std::shared_ptr<Expression> thenExpression;
     std::shared_ptr<Expression> elseExpression;
+    bool undetermined;
 };
 
 class ValueExpression : public Expression {
@@ -241,7 +320,7 @@ public:
 
 class Assignment : public Statement {
 public:
-    std::shared_ptr<Identifier> getTarget() const {
+    const std::shared_ptr<Identifier>& getTarget() const {
         return target;
     }
 
@@ -255,10 +334,35 @@ private:
 
 class CallAssignment : public Assignment {
 public:
+    CallAssignment() : function(nullptr), builtInFunction(nullptr), tailCall(false) { }
+
     const std::string& getFunctionName() const {
         return functionName;
     }
 
+    // called function resolved by the link step of the executor
+    Function* getFunction() const {
+        return function;
+    }
+
+    const BuiltInFunction* getBuiltInFunction() const {
+        return builtInFunction;
+    }
+
+    void setCallee(Function* function, const BuiltInFunction* builtInFunction) {
+        this->function = function;
+        this->builtInFunction = builtInFunction;
+    }
+
+    // result is returned right after the call, so the executors reuse the frame of the caller
+    bool isTailCall() const {
+        return tailCall;
+    }
+
+    void setTailCall(bool tailCall) {
+        this->tailCall = tailCall;
+    }
+
     void setFunctionName(const std::string& functionName)  {
         this->functionName = functionName;
     }
@@ -274,6 +378,10 @@ public:
 private:
     std::string functionName;
     std::vector<std::shared_ptr<Value> > functionArgs;
+
+    Function* function;
+    const BuiltInFunction* builtInFunction;
+    bool tailCall;
 };
 
 class IdentifierAssignment : public Assignment {
@@ -336,6 +444,10 @@ public:
         thenStatements.push_back(statement);
     }
 
+    void setThenStatements(const std::vector<std::shared_ptr<Statement> >& statements) {
+        thenStatements = statements;
+    }
+
     const std::vector<std::shared_ptr<Statement> >& getElseStatements() const {
         return elseStatements;
     }
@@ -344,16 +456,70 @@ public:
         elseStatements.push_back(statement);
     }
 
+    void setElseStatements(const std::vector<std::shared_ptr<Statement> >& statements) {
+        elseStatements = statements;
+    }
+
 private:
     std::shared_ptr<IdentifierValue> conditionValue;
     std::vector<std::shared_ptr<Statement> > thenStatements;
     std::vector<std::shared_ptr<Statement> > elseStatements;
 };
 
+// Handlers selected by a string value through a hashed table, built by the optimizer from the chains of
+// `local.test = _eq(value, "<literal>")` / `if local.test` conditions - the value is looked up once instead of
+// being compared with every literal. Nothing is executed when no literal matches.
+class Dispatch : public Statement {
+public:
+    std::shared_ptr<IdentifierValue> getValue() const {
+        return value;
+    }
+
+    void setValue(std::shared_ptr<IdentifierValue> value) {
+        this->value = value;
+    }
+
+    int getCasesCount() const {
+        return (int)literals.size();
+    }
+
+    const std::u32string& getCaseLiteral(int index) const {
+        return literals[index];
+    }
+
+    const std::vector<std::shared_ptr<Statement> >& getCaseStatements(int index) const {
+        return cases[index];
+    }
+
+    // statements of the already added literal are appended to its case
+    void addCase(const std::u32string& literal, const std::vector<std::shared_ptr<Statement> >& statements) {
+        auto caseIt = table.emplace(literal, (int)literals.size()).first;
+        if (caseIt->second == (int)literals.size()) {
+            literals.push_back(literal);
+            cases.emplace_back();
+        }
+
+        auto& caseStatements = cases[caseIt->second];
+        caseStatements.insert(caseStatements.end(), statements.begin(), statements.end());
+    }
+
+    // index of the case, -1 when there is none for the value
+    int findCase(const std::u32string& value) const {
+        auto caseIt = table.find(value);
+        return caseIt == table.end() ? -1 : caseIt->second;
+    }
+
+private:
+    std::shared_ptr<IdentifierValue> value;
+    std::vector<std::u32string> literals;
+    std::vector<std::vector<std::shared_ptr<Statement> > > cases;
+    std::unordered_map<std::u32string, int> table;
+};
+
 // TopLevel structures
 class Function {
 public:
-    explicit Function(const std::string& name) : name(name), recursive(false) {
+    explicit Function(const std::string& name) : name(name), recursive(false), pure(false), slotsCount(0) {
     }
 
     bool isUsingGlobal() const {
@@ -368,6 +534,25 @@ public:
         recursive = val;
     }
 
+    // result depends only on the arguments - no global variables and no built-in functions with side effects are
+    // used by the function and the functions it calls, set by the analyzer
+    bool isPure() const {
+        return pure;
+    }
+
+    void setPure(bool val) {
+        pure = val;
+    }
+
+    // local variables of the frame, arguments take the first slots
+    int getSlotsCount() const {
+        return slotsCount;
+    }
+
+    void setSlotsCount(int count) {
+        slotsCount = count;
+    }
+
     const std::set<std::string>& getReadVariables() const {
         return readVariables;
     }
@@ -427,8 +612,28 @@ public:
         statements.push_back(statement);
     }
 
+    void setStatements(const std::vector<std::shared_ptr<Statement> >& statements) {
+        this->statements = statements;
+    }
+
+    // copies of the function specialized for the cases of the dispatch on its argument, set by the optimizer
+    const std::shared_ptr<Dispatch>& getSpecializedDispatch() const {
+        return specializedDispatch;
+    }
+
+    const std::vector<std::shared_ptr<Function> >& getVariants() const {
+        return variants;
+    }
+
+    void setVariants(std::shared_ptr<Dispatch> dispatch, const std::vector<std::shared_ptr<Function> >& variants) {
+        specializedDispatch = std::move(dispatch);
+        this->variants = variants;
+    }
+
 private:
     bool recursive;
+    bool pure;
+    int slotsCount;
     std::set<std::string> readVariables;
     std::set<std::string> writeVariables;
 
@@ -438,16 +643,20 @@ private:
     std::string name;
     std::vector<std::string> arguments;
     std::vector<std::shared_ptr<Statement> > statements;
+
+    std::shared_ptr<Dispatch> specializedDispatch;
+    std::vector<std::shared_ptr<Function> > variants;
 };
 
 class Program {
 public:
 
-    std::shared_ptr<Function> getFunction(std::string name) const {
-        auto func = std::find_if(functions.begin(), functions.end(), [&](auto func) { return func->getName() == name; });
-        if (func == functions.end()) return std::shared_ptr<Function>();
+    // first function of the name, calls are looked up for every analyzed and linked statement
+    std::shared_ptr<Function> getFunction(const std::string& name) const {
+        auto func = functionsByName.find(name);
+        if (func == functionsByName.end()) return std::shared_ptr<Function>();
 
-        return *func;
+        return func->second;
     }
 
     const std::vector<std::shared_ptr<Function> >& getFunctions() const {
@@ -455,11 +664,13 @@ public:
     }
 
     void addFunction(std::shared_ptr<Function> function) {
+        functionsByName.emplace(function->getName(), function);
         functions.push_back(function);
     }
 
 private:
     std::vector<std::shared_ptr<Function> > functions;
+    std::unordered_map<std::string, std::shared_ptr<Function> > functionsByName;
 };
 
 #endif
@@ -1,42 +1,119 @@
+#include <cstring>
 #include <iostream>
+#include <algorithm>
 
+#include "Symbols.h"
 #include "ProgramAnalyzer.h"
+#include "BuiltInFunction.h"
 
 using namespace std;
 
-void ProgramAnalyzer::analyze() {
-    auto trueValue = make_shared<BooleanValue>();
-    trueValue->setValue(true);
-    auto trueExpression = make_shared<ValueExpression>(trueValue);
+// Helpers
+static string getExpressionId(const shared_ptr<Expression>& expression) {
+    return to_string((size_t)expression.get());
+}
 
-    // running analyzers for the functions
-    for (auto& function : program->getFunctions()) {
-        // first recursive functions determination
-        set<shared_ptr<Function> > visitedFunctions;
-        function->setRecursive(isFunctionRecursive(function, function, visitedFunctions));
+// structural key of the constant or of the variable, other values are never equal
+static string getValueKey(const shared_ptr<Value>& value) {
+    if (dynamic_pointer_cast<BooleanValue>(value)) {
+        return dynamic_pointer_cast<BooleanValue>(value)->getValue() ? "Btrue" : "Bfalse";
+    }
+    if (dynamic_pointer_cast<IntegerValue>(value)) {
+        return "I" + to_string(dynamic_pointer_cast<IntegerValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<FloatValue>(value)) {
+        // exact bits, the printed number is rounded
+        double number = dynamic_pointer_cast<FloatValue>(value)->getValue();
+        long long bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return "D" + to_string(bits);
+    }
+    if (dynamic_pointer_cast<CharValue>(value)) {
+        return "C" + to_string((long long)dynamic_pointer_cast<CharValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<StringValue>(value)) {
+        return "S" + toUTF8(dynamic_pointer_cast<StringValue>(value)->getValue());
+    }
+    if (dynamic_pointer_cast<IdentifierValue>(value)) {
+        return "V" + dynamic_pointer_cast<IdentifierValue>(value)->getIdentifier()->getFullName();
+    }
+    if (dynamic_pointer_cast<NullValue>(value)) {
+        return "N";
+    }
+    return "";
+}
+
+static bool isBooleanConstant(const shared_ptr<Expression>& expression, bool constant) {
+    auto valueExp = dynamic_pointer_cast<ValueExpression>(expression);
+    auto value = valueExp ? dynamic_pointer_cast<BooleanValue>(valueExp->getValue()) : shared_ptr<BooleanValue>();
+    return value && value->getValue() == constant;
+}
+
+// nodes of the printed expression, counting stops above the limit
+static int getPrintedSize(const Expression* expression, map<const Expression*, int>& sizes) {
+    if (!expression) return 1;
+
+    auto sizeIt = sizes.find(expression);
+    if (sizeIt != sizes.end()) return sizeIt->second;
+
+    vector<const Expression*> children;
+    if (dynamic_cast<const CallExpression*>(expression)) {
+        for (auto& arg : dynamic_cast<const CallExpression*>(expression)->getArguments()) children.push_back(arg.get());
+    }
+    else if (dynamic_cast<const ConditionExpression*>(expression)) {
+        auto exp = dynamic_cast<const ConditionExpression*>(expression);
+        children = { exp->getConditionExpression().get(), exp->getThenExpression().get(), exp->getElseExpression().get() };
+    }
 
-        // then variables determination
-        visitedFunctions.clear();
-        set<string> readVars, writeVars;
-        determineFunctionVariables(function, readVars, writeVars, visitedFunctions);
-        function->setReadVariables(readVars);
-        function->setWriteVariables(writeVars);
+    int res = 1;
+    for (auto child : children) res = min(res + getPrintedSize(child, sizes), ProgramAnalyzer::MAX_PRINTED_SIZE + 1);
+    sizes[expression] = res;
+    return res;
+}
+
+// Analyzer
+void ProgramAnalyzer::analyze() {
+    // expressions of the previous analysis stay with the functions, the new ones are not shared with them
+    expressions.clear();
 
-        // extract expressions for each variable
-        visitedFunctions.clear();
+    // recursion, variables and purity of the functions are summarized bottom-up over the components of the call
+    // graph, every function is visited once and its summary is reused by all its callers
+    buildCallGraph();
+    for (auto& component : components) summarizeComponent(component);
+
+    // expressions are evaluated only for the messages passed to the main, called functions are inlined into it
+    auto mainFunction = program->getFunction("main");
+    if (mainFunction) {
+        set<shared_ptr<Function> > visitedFunctions;
         map<string, shared_ptr<Expression> > globalExpressions, localExpressions;
         map<string, set<shared_ptr<Expression> > > readExpressions, writeExpressions;
 
-        determineFunctionExpressions(function, trueExpression, globalExpressions, localExpressions, readExpressions, writeExpressions, visitedFunctions);
-        function->setReadExpressions(readExpressions);
-        function->setWriteExpressions(writeExpressions);
+        determineFunctionExpressions(mainFunction, makeBooleanExpression(true), globalExpressions, localExpressions, readExpressions, writeExpressions, visitedFunctions);
+        mainFunction->setReadExpressions(readExpressions);
+        mainFunction->setWriteExpressions(writeExpressions);
     }
 
-    // printing analysis
+    // resolving local variables to the frame slots and the paths to the interned fields, executors then
+    // do not work with the names at all
+    for (auto& function : program->getFunctions()) resolveFunctionSlots(function);
+
+    // calls returning their result right away, recursion by them does not need a new frame
+    for (auto& function : program->getFunctions()) markTailCalls(function->getStatements());
+}
+
+void ProgramAnalyzer::print() const {
+    // specialized variants are copies of their function, only their count is printed
+    set<shared_ptr<Function> > variants;
+    for (auto& function : program->getFunctions()) variants.insert(function->getVariants().begin(), function->getVariants().end());
+
     cout << "======== Code analysis ========" << endl;
     for (auto& function : program->getFunctions()) {
+        if (variants.count(function)) continue;
+
         cout << "function " << function->getName() << ":" << endl;
         cout << "  - recursive: " << function->isRecursive() << endl;
+        cout << "  - pure: " << function->isPure() << endl;
+        if (!function->getVariants().empty()) cout << "  - variants: " << function->getVariants().size() << endl;
 
         cout << "  - readVars: ";
         for (auto& var : function->getReadVariables()) cout << var << " ";
@@ -46,92 +123,86 @@ void ProgramAnalyzer::analyze() {
         for (auto& var : function->getWriteVariables()) cout << var << " ";
         cout << endl;
 
+        // only the main has the expressions
+        if (function != program->getFunction("main")) continue;
+
+        map<const Expression*, int> sizes;
+        auto printExpression = [&](const shared_ptr<Expression>& exp) {
+            if (getPrintedSize(exp.get(), sizes) <= MAX_PRINTED_SIZE) cout << "      - " << exp->toString() << "" << endl;
+            else cout << "      - <expression of more than " << MAX_PRINTED_SIZE << " printed nodes>" << endl;
+        };
+
         cout << "  - readExpressions:" << endl;
         for (auto& exps : function->getReadExpressions()) {
             cout << "    - " << exps.first << ": " << endl;
-            for (auto& exp : exps.second) {
-                cout << "      - " << exp->toString() << "" << endl;
-            }
+            for (auto& exp : exps.second) printExpression(exp);
         }
 
         cout << "  - writeExpressions:" << endl;
         for (auto& exps : function->getWriteExpressions()) {
             cout << "    - " << exps.first << ": " << endl;
-            for (auto& exp : exps.second) {
-                cout << "      - " << exp->toString() << "" << endl;
-            }
+            for (auto& exp : exps.second) printExpression(exp);
         }
     }
     cout << "===============================" << endl << endl;
 }
 
-bool ProgramAnalyzer::isFunctionRecursive(shared_ptr<Function> origFunction, shared_ptr<Function> currFunction,
-                                          set<shared_ptr<Function> >& visitedFunctions) {
-    visitedFunctions.insert(currFunction);
-
-    for (auto& stat : currFunction->getStatements()) {
-        if (isFunctionStatementRecursive(origFunction, stat, visitedFunctions)) return true;
-    }
-    return false;
-}
+void ProgramAnalyzer::buildCallGraph() {
+    auto& functions = program->getFunctions();
 
-bool ProgramAnalyzer::isFunctionStatementRecursive(shared_ptr<Function> origFunction, shared_ptr<Statement> currStatement,
-                                                   set<std::shared_ptr<Function> >& visitedFunctions) {
-    if (dynamic_pointer_cast<CallAssignment>(currStatement)) {
-        auto callFunction = program->getFunction(dynamic_pointer_cast<CallAssignment>(currStatement)->getFunctionName());
-        if (callFunction == origFunction) return true;
+    callGraph.assign(functions.size(), CallGraphNode());
+    components.clear();
 
-        if (callFunction && visitedFunctions.find(callFunction) == visitedFunctions.end()) {
-            if (isFunctionRecursive(origFunction, callFunction, visitedFunctions)) return true;
-        }
-    }
-    else if (dynamic_pointer_cast<Condition>(currStatement)) {
-        for (auto& stat : dynamic_pointer_cast<Condition>(currStatement)->getThenStatements()) {
-            if (isFunctionStatementRecursive(origFunction, stat, visitedFunctions)) return true;
-        }
-        for (auto& stat : dynamic_pointer_cast<Condition>(currStatement)->getElseStatements()) {
-            if (isFunctionStatementRecursive(origFunction, stat, visitedFunctions)) return true;
-        }
-    }
+    map<const Function*, int> indexes;
+    for (int i = 0; i < (int)functions.size(); i++) indexes.emplace(functions[i].get(), i);
 
-    return false;
-}
+    // direct variables and calls of every function
+    for (int i = 0; i < (int)functions.size(); i++) {
+        auto& node = callGraph[i];
+        node.function = functions[i];
+        for (auto& stat : functions[i]->getStatements()) collectStatementCalls(stat, node, indexes);
 
-void ProgramAnalyzer::determineFunctionVariables(shared_ptr<Function> currFunction,
-                                                 set<string>& readVars, set<string>& writeVars,
-                                                 set<shared_ptr<Function> >& visitedFunctions) {
-    visitedFunctions.insert(currFunction);
+        sort(node.callees.begin(), node.callees.end());
+        node.callees.erase(unique(node.callees.begin(), node.callees.end()), node.callees.end());
+    }
 
-    for (auto& stat : currFunction->getStatements()) {
-        determineFunctionStatementVariables(stat, readVars, writeVars, visitedFunctions);
+    // components are found in the reverse topological order, callees come before their callers
+    int index = 0;
+    vector<int> stack;
+    for (int i = 0; i < (int)callGraph.size(); i++) {
+        if (callGraph[i].index < 0) connectComponent(i, index, stack);
     }
 }
 
-void ProgramAnalyzer::determineFunctionStatementVariables(shared_ptr<Statement> currStatement,
-                                                          set<string>& readVars, set<string>& writeVars,
-                                                          set<shared_ptr<Function> >& visitedFunctions) {
+void ProgramAnalyzer::collectStatementCalls(shared_ptr<Statement> currStatement, CallGraphNode& node,
+                                            const map<const Function*, int>& indexes) {
     if (dynamic_pointer_cast<Assignment>(currStatement)) {
         auto target = dynamic_pointer_cast<Assignment>(currStatement)->getTarget();
-        if (target->isGlobal()) writeVars.insert(target->getName());
+        if (target->isGlobal()) node.writeVars.insert(target->getName());
 
         if (dynamic_pointer_cast<CallAssignment>(currStatement)) {
             auto assignment = dynamic_pointer_cast<CallAssignment>(currStatement);
             for (auto& val : assignment->getFunctionArgs()) {
                 if (dynamic_pointer_cast<IdentifierValue>(val)) {
                     if (dynamic_pointer_cast<IdentifierValue>(val)->getIdentifier()->isGlobal()) {
-                        readVars.insert(dynamic_pointer_cast<IdentifierValue>(val)->getIdentifier()->getName());
+                        node.readVars.insert(dynamic_pointer_cast<IdentifierValue>(val)->getIdentifier()->getName());
                     }
                 }
             }
 
             auto callFunction = program->getFunction(assignment->getFunctionName());
-            if (callFunction && visitedFunctions.find(callFunction) == visitedFunctions.end()) {
-                determineFunctionVariables(callFunction, readVars, writeVars, visitedFunctions);
+            if (callFunction) {
+                node.callees.push_back(indexes.at(callFunction.get()));
+            }
+            else {
+                // unknown functions are reported by the executors
+                auto builtInFunction = findBuiltInFunction(assignment->getFunctionName());
+                if (!builtInFunction || !builtInFunction->isPure()) node.pureCalls = false;
             }
         }
         else if (dynamic_pointer_cast<IdentifierAssignment>(currStatement)) {
             if (dynamic_pointer_cast<IdentifierAssignment>(currStatement)->getValue()->getIdentifier()->isGlobal()) {
-                readVars.insert(dynamic_pointer_cast<IdentifierAssignment>(currStatement)->getValue()->getIdentifier()->getName());
+                node.readVars.insert(dynamic_pointer_cast<IdentifierAssignment>(currStatement)->getValue()->getIdentifier()->getName());
             }
         }
     }
@@ -139,18 +210,94 @@ void ProgramAnalyzer::determineFunctionStatementVariables(shared_ptr<Statement>
         auto val = dynamic_pointer_cast<Return>(currStatement)->getValue();
         if (dynamic_pointer_cast<IdentifierValue>(val)) {
             if (dynamic_pointer_cast<IdentifierValue>(val)->getIdentifier()->isGlobal()) {
-                readVars.insert(dynamic_pointer_cast<IdentifierValue>(val)->getIdentifier()->getName());
+                node.readVars.insert(dynamic_pointer_cast<IdentifierValue>(val)->getIdentifier()->getName());
             }
         }
     }
     else if (dynamic_pointer_cast<Condition>(currStatement)) {
         for (auto& stat : dynamic_pointer_cast<Condition>(currStatement)->getThenStatements()) {
-            determineFunctionStatementVariables(stat, readVars, writeVars, visitedFunctions);
+            collectStatementCalls(stat, node, indexes);
         }
         for (auto& stat : dynamic_pointer_cast<Condition>(currStatement)->getElseStatements()) {
-            determineFunctionStatementVariables(stat, readVars, writeVars, visitedFunctions);
+            collectStatementCalls(stat, node, indexes);
+        }
+    }
+    else if (dynamic_pointer_cast<Dispatch>(currStatement)) {
+        auto dispatch = dynamic_pointer_cast<Dispatch>(currStatement);
+        if (dispatch->getValue()->getIdentifier()->isGlobal()) node.readVars.insert(dispatch->getValue()->getIdentifier()->getName());
+
+        for (int i = 0; i < dispatch->getCasesCount(); i++) {
+            for (auto& stat : dispatch->getCaseStatements(i)) {
+                collectStatementCalls(stat, node, indexes);
+            }
+        }
+    }
+}
+
+void ProgramAnalyzer::connectComponent(int curr, int& index, vector<int>& stack) {
+    // Tarjan's algorithm, the lowest index reachable on the stack identifies the component
+    callGraph[curr].index = callGraph[curr].lowLink = index++;
+    stack.push_back(curr);
+    callGraph[curr].onStack = true;
+
+    for (int callee : callGraph[curr].callees) {
+        if (callGraph[callee].index < 0) {
+            connectComponent(callee, index, stack);
+            callGraph[curr].lowLink = min(callGraph[curr].lowLink, callGraph[callee].lowLink);
+        }
+        else if (callGraph[callee].onStack) {
+            callGraph[curr].lowLink = min(callGraph[curr].lowLink, callGraph[callee].index);
         }
     }
+    if (callGraph[curr].lowLink != callGraph[curr].index) return;
+
+    components.emplace_back();
+    int member;
+    do {
+        member = stack.back();
+        stack.pop_back();
+
+        callGraph[member].onStack = false;
+        callGraph[member].component = (int)components.size() - 1;
+        components.back().push_back(member);
+    } while (member != curr);
+}
+
+void ProgramAnalyzer::summarizeComponent(const vector<int>& component) {
+    // functions of one component call each other, so they share the summary, the other callees are done already
+    bool recursive = component.size() > 1;
+    bool pure = true;
+    set<string> readVars, writeVars;
+
+    for (int member : component) {
+        auto& node = callGraph[member];
+        readVars.insert(node.readVars.begin(), node.readVars.end());
+        writeVars.insert(node.writeVars.begin(), node.writeVars.end());
+        if (!node.pureCalls) pure = false;
+
+        for (int callee : node.callees) {
+            auto& calleeFunction = *callGraph[callee].function;
+            if (callGraph[callee].component == node.component) {
+                if (callee == member) recursive = true;
+                continue;
+            }
+
+            readVars.insert(calleeFunction.getReadVariables().begin(), calleeFunction.getReadVariables().end());
+            writeVars.insert(calleeFunction.getWriteVariables().begin(), calleeFunction.getWriteVariables().end());
+            if (!calleeFunction.isPure()) pure = false;
+        }
+    }
+
+    // result depends only on the arguments
+    if (!readVars.empty() || !writeVars.empty()) pure = false;
+
+    for (int member : component) {
+        auto& function = *callGraph[member].function;
+        function.setRecursive(recursive);
+        function.setPure(pure);
+        function.setReadVariables(readVars);
+        function.setWriteVariables(writeVars);
+    }
 }
 
 void ProgramAnalyzer::determineFunctionExpressions(shared_ptr<Function> currFunction, shared_ptr<Expression> currCond,
@@ -174,10 +321,10 @@ void ProgramAnalyzer::determineFunctionStatementExpressions(shared_ptr<Statement
                                                             set<shared_ptr<Function> >& visitedFunctions) {
     auto trueValue = make_shared<BooleanValue>();
     trueValue->setValue(true);
-    auto trueExpression = make_shared<ValueExpression>(trueValue);
+    auto trueExpression = makeValueExpression(trueValue);
 
     auto nullValue = make_shared<NullValue>();
-    auto nullExpression = make_shared<ValueExpression>(nullValue);
+    auto nullExpression = makeValueExpression(nullValue);
 
     if (dynamic_pointer_cast<Return>(currStatement)) {
         auto value = dynamic_pointer_cast<Return>(currStatement)->getValue();
@@ -198,11 +345,11 @@ void ProgramAnalyzer::determineFunctionStatementExpressions(shared_ptr<Statement
             else {
                 // local variables can be read even when not determined!!!
                 auto oldExp = localExpressions[dynamic_pointer_cast<IdentifierValue>(value)->getIdentifier()->getName()];
-                valueExp = (oldExp ? oldExp : static_pointer_cast<Expression>(make_shared<ValueExpression>(value)));
+                valueExp = (oldExp ? oldExp : makeValueExpression(value));
             }
         }
         else {
-            valueExp = make_shared<ValueExpression>(value);
+            valueExp = makeValueExpression(value);
         }
 
         // setting actual return expression
@@ -236,56 +383,42 @@ void ProgramAnalyzer::determineFunctionStatementExpressions(shared_ptr<Statement
         else {
             // local variables can be read even when not determined!!!
             auto oldExp = localExpressions[cond->getConditionValue()->getIdentifier()->getName()];
-            condExp = (oldExp ? oldExp : static_pointer_cast<Expression>(make_shared<ValueExpression>(cond->getConditionValue())));
+            condExp = (oldExp ? oldExp : makeValueExpression(cond->getConditionValue()));
         }
 
-        // building expressions for conditions
-        vector<shared_ptr<Expression> > args;
-        args.push_back(currCond);
-        args.push_back(condExp);
-        auto thenExp = make_shared<CallExpression>("_and", args);
-
-        args.clear();
-        args.push_back(currCond);
-        args.push_back(make_shared<CallExpression>("_neg", vector<shared_ptr<Expression> >(1, condExp)));
-        auto elseExp = make_shared<CallExpression>("_and", args);
-
-        // executing then branch
-        map<string, shared_ptr<Expression> > thenGlobalExpressions(globalExpressions);
-        map<string, shared_ptr<Expression> > thenLocalExpressions(localExpressions);
-        for (auto& stat : cond->getThenStatements()) {
-            determineFunctionStatementExpressions(stat, thenExp, thenGlobalExpressions, thenLocalExpressions, readExpressions, writeExpressions, visitedFunctions);
-        }
-
-        // executing else branch
-        map<string, shared_ptr<Expression> > elseGlobalExpressions(globalExpressions);
-        map<string, shared_ptr<Expression> > elseLocalExpressions(localExpressions);
-        for (auto& stat : cond->getElseStatements()) {
-            determineFunctionStatementExpressions(stat, elseExp, elseGlobalExpressions, elseLocalExpressions, readExpressions, writeExpressions, visitedFunctions);
-        }
+        determineConditionExpressions(condExp, cond->getThenStatements(), cond->getElseStatements(), currCond, globalExpressions,
+                                      localExpressions, readExpressions, writeExpressions, visitedFunctions);
+    }
+    else if (dynamic_pointer_cast<Dispatch>(currStatement)) {
+        auto dispatch = dynamic_pointer_cast<Dispatch>(currStatement);
+        auto value = dispatch->getValue();
 
-        // merging of the expressions into the former expression maps is needed!
-        set<string> globalExpressionsKeys;
-        for (auto& pair : thenGlobalExpressions) globalExpressionsKeys.insert(pair.first);
-        for (auto& pair : elseGlobalExpressions) globalExpressionsKeys.insert(pair.first);
+        shared_ptr<Expression> valueExp;
+        if (value->getIdentifier()->isGlobal()) {
+            valueExp = globalExpressions[value->getIdentifier()->getName()];
 
-        for (auto& key : globalExpressionsKeys) {
-            if (thenGlobalExpressions[key] != elseGlobalExpressions[key]) {
-                globalExpressions[key] = make_shared<ConditionExpression>(condExp, thenGlobalExpressions[key], elseGlobalExpressions[key]);
+            // also adding currCond expression to reads if it can be determined!
+            if (!currCond->isUndetermined()) readExpressions[value->getIdentifier()->getName()].insert(currCond);
+            else {
+                readExpressions[value->getIdentifier()->getName()].clear();
+                readExpressions[value->getIdentifier()->getName()].insert(trueExpression);
             }
         }
+        else {
+            // local variables can be read even when not determined!!!
+            auto oldExp = localExpressions[value->getIdentifier()->getName()];
+            valueExp = (oldExp ? oldExp : makeValueExpression(value));
+        }
 
-        set<string> localExpressionsKeys;
-        for (auto& pair : thenLocalExpressions) localExpressionsKeys.insert(pair.first);
-        for (auto& pair : elseLocalExpressions) localExpressionsKeys.insert(pair.first);
+        // cases are the conditions of the chain the dispatch was built from
+        for (int i = 0; i < dispatch->getCasesCount(); i++) {
+            auto literal = make_shared<StringValue>();
+            literal->setValue(dispatch->getCaseLiteral(i));
 
-        for (auto& key : localExpressionsKeys) {
-            if (!thenLocalExpressions[key]) thenLocalExpressions[key] = nullExpression;
-            if (!elseLocalExpressions[key]) elseLocalExpressions[key] = nullExpression;
+            auto condExp = makeCaseExpression(valueExp, makeValueExpression(literal), dispatch.get(), i);
 
-            if (thenLocalExpressions[key] != elseLocalExpressions[key]) {
-                localExpressions[key] = make_shared<ConditionExpression>(condExp, thenLocalExpressions[key], elseLocalExpressions[key]);
-            }
+            determineConditionExpressions(condExp, dispatch->getCaseStatements(i), vector<shared_ptr<Statement> >(), currCond,
+                                          globalExpressions, localExpressions, readExpressions, writeExpressions, visitedFunctions);
         }
     }
     else if (dynamic_pointer_cast<Assignment>(currStatement)) {
@@ -312,11 +445,11 @@ void ProgramAnalyzer::determineFunctionStatementExpressions(shared_ptr<Statement
                     else {
                         // local variables can be read even when not determined!!!
                         auto oldExp = localExpressions[dynamic_pointer_cast<IdentifierValue>(arg)->getIdentifier()->getName()];
-                        args.push_back(oldExp ? oldExp : static_pointer_cast<Expression>(make_shared<ValueExpression>(arg)));
+                        args.push_back(oldExp ? oldExp : makeValueExpression(arg));
                     }
                 }
                 else {
-                    args.emplace_back(make_shared<ValueExpression>(arg));
+                    args.emplace_back(makeValueExpression(arg));
                 }
             }
 
@@ -384,11 +517,11 @@ void ProgramAnalyzer::determineFunctionStatementExpressions(shared_ptr<Statement
             else canUseInExpression = true;
 
             if (canUseInExpression) {
-                valueExp = make_shared<CallExpression>(dynamic_pointer_cast<CallAssignment>(assign)->getFunctionName(), args);
+                valueExp = makeCallExpression(dynamic_pointer_cast<CallAssignment>(assign)->getFunctionName(), args);
             }
         }
         else if (dynamic_pointer_cast<ConstantAssignment>(assign)) {
-            valueExp = make_shared<ValueExpression>(dynamic_pointer_cast<ConstantAssignment>(assign)->getValue());
+            valueExp = makeValueExpression(dynamic_pointer_cast<ConstantAssignment>(assign)->getValue());
         }
         else if (dynamic_pointer_cast<IdentifierAssignment>(assign)) {
             auto value = dynamic_pointer_cast<IdentifierAssignment>(assign)->getValue();
@@ -406,10 +539,12 @@ void ProgramAnalyzer::determineFunctionStatementExpressions(shared_ptr<Statement
             else {
                 // local variables can be read even when not determined!!!
                 auto oldExp = localExpressions[value->getIdentifier()->getName()];
-                valueExp = (oldExp ? oldExp : static_pointer_cast<Expression>(make_shared<ValueExpression>(value)));
+                valueExp = (oldExp ? oldExp : makeValueExpression(value));
             }
 
-            valueExp = make_shared<ValueExpression>(dynamic_pointer_cast<IdentifierAssignment>(assign)->getValue());
+            // global variable without known expression is read by its name (so the expression is undetermined),
+            // copied local variable keeps its expression - inlined arguments and results are such copies
+            if (!valueExp) valueExp = makeValueExpression(value);
         }
 
         // setting value
@@ -428,3 +563,245 @@ void ProgramAnalyzer::determineFunctionStatementExpressions(shared_ptr<Statement
         }
     }
 }
+
+void ProgramAnalyzer::determineConditionExpressions(shared_ptr<Expression> condExp,
+                                                    const vector<shared_ptr<Statement> >& thenStatements,
+                                                    const vector<shared_ptr<Statement> >& elseStatements,
+                                                    shared_ptr<Expression> currCond,
+                                                    map<string, shared_ptr<Expression> >& globalExpressions,
+                                                    map<string, shared_ptr<Expression> >& localExpressions,
+                                                    map<string, set<shared_ptr<Expression> > >& readExpressions,
+                                                    map<string, set<shared_ptr<Expression> > >& writeExpressions,
+                                                    set<shared_ptr<Function> >& visitedFunctions) {
+    auto nullValue = make_shared<NullValue>();
+    auto nullExpression = makeValueExpression(nullValue);
+
+    // building expressions for conditions
+    vector<shared_ptr<Expression> > args;
+    args.push_back(currCond);
+    args.push_back(condExp);
+    auto thenExp = makeCallExpression("_and", args);
+
+    args.clear();
+    args.push_back(currCond);
+    args.push_back(makeCallExpression("_neg", vector<shared_ptr<Expression> >(1, condExp)));
+    auto elseExp = makeCallExpression("_and", args);
+
+    // executing then branch
+    map<string, shared_ptr<Expression> > thenGlobalExpressions(globalExpressions);
+    map<string, shared_ptr<Expression> > thenLocalExpressions(localExpressions);
+    for (auto& stat : thenStatements) {
+        determineFunctionStatementExpressions(stat, thenExp, thenGlobalExpressions, thenLocalExpressions, readExpressions, writeExpressions, visitedFunctions);
+    }
+
+    // executing else branch
+    map<string, shared_ptr<Expression> > elseGlobalExpressions(globalExpressions);
+    map<string, shared_ptr<Expression> > elseLocalExpressions(localExpressions);
+    for (auto& stat : elseStatements) {
+        determineFunctionStatementExpressions(stat, elseExp, elseGlobalExpressions, elseLocalExpressions, readExpressions, writeExpressions, visitedFunctions);
+    }
+
+    // merging of the expressions into the former expression maps is needed!
+    set<string> globalExpressionsKeys;
+    for (auto& pair : thenGlobalExpressions) globalExpressionsKeys.insert(pair.first);
+    for (auto& pair : elseGlobalExpressions) globalExpressionsKeys.insert(pair.first);
+
+    for (auto& key : globalExpressionsKeys) {
+        if (thenGlobalExpressions[key] != elseGlobalExpressions[key]) {
+            globalExpressions[key] = makeConditionExpression(condExp, thenGlobalExpressions[key], elseGlobalExpressions[key]);
+        }
+    }
+
+    set<string> localExpressionsKeys;
+    for (auto& pair : thenLocalExpressions) localExpressionsKeys.insert(pair.first);
+    for (auto& pair : elseLocalExpressions) localExpressionsKeys.insert(pair.first);
+
+    for (auto& key : localExpressionsKeys) {
+        if (!thenLocalExpressions[key]) thenLocalExpressions[key] = nullExpression;
+        if (!elseLocalExpressions[key]) elseLocalExpressions[key] = nullExpression;
+
+        if (thenLocalExpressions[key] != elseLocalExpressions[key]) {
+            // later returns are chained into the else branch of the return expression, so it keeps its shape
+            if (key == "&return&") {
+                localExpressions[key] = make_shared<ConditionExpression>(condExp, thenLocalExpressions[key], elseLocalExpressions[key]);
+            }
+            else {
+                localExpressions[key] = makeConditionExpression(condExp, thenLocalExpressions[key], elseLocalExpressions[key]);
+            }
+        }
+    }
+}
+
+shared_ptr<Expression> ProgramAnalyzer::makeValueExpression(shared_ptr<Value> value) {
+    string key = getValueKey(value);
+    if (key.empty()) return make_shared<ValueExpression>(move(value));
+
+    auto& res = expressions[key];
+    if (!res) res = make_shared<ValueExpression>(move(value));
+    return res;
+}
+
+shared_ptr<Expression> ProgramAnalyzer::makeBooleanExpression(bool constant) {
+    auto value = make_shared<BooleanValue>();
+    value->setValue(constant);
+    return makeValueExpression(value);
+}
+
+shared_ptr<Expression> ProgramAnalyzer::makeCallExpression(const string& name, vector<shared_ptr<Expression> > args) {
+    // program functions hide the built-in boolean operations
+    if (!program->getFunction(name)) {
+        auto simplified = simplifyCall(name, args);
+        if (simplified) return simplified;
+    }
+
+    string key = "F" + name;
+    for (auto& arg : args) key += " " + getExpressionId(arg);
+
+    auto& res = expressions[key];
+    if (!res) res = make_shared<CallExpression>(name, move(args));
+    return res;
+}
+
+shared_ptr<Expression> ProgramAnalyzer::makeCaseExpression(shared_ptr<Expression> valueExp, shared_ptr<Expression> literalExp,
+                                                           const Dispatch* dispatch, int caseIndex) {
+    string key = "S" + to_string((size_t)dispatch) + " " + to_string(caseIndex) + " " + getExpressionId(valueExp);
+
+    auto& res = expressions[key];
+    if (!res) res = make_shared<CaseExpression>(move(valueExp), move(literalExp), dispatch, caseIndex);
+    return res;
+}
+
+shared_ptr<Expression> ProgramAnalyzer::makeConditionExpression(shared_ptr<Expression> condExp, shared_ptr<Expression> thenExp,
+                                                                shared_ptr<Expression> elseExp) {
+    // equal branches and the branches of the constant conditions are taken directly
+    if (thenExp && thenExp == elseExp) return thenExp;
+    if (thenExp && isBooleanConstant(condExp, true)) return thenExp;
+    if (elseExp && isBooleanConstant(condExp, false)) return elseExp;
+
+    string key = "? " + getExpressionId(condExp) + " " + getExpressionId(thenExp) + " " + getExpressionId(elseExp);
+
+    auto& res = expressions[key];
+    if (!res) res = make_shared<ConditionExpression>(move(condExp), move(thenExp), move(elseExp));
+    return res;
+}
+
+shared_ptr<Expression> ProgramAnalyzer::simplifyCall(const string& name, const vector<shared_ptr<Expression> >& args) {
+    if (name == "_neg" && args.size() == 1 && args[0]) {
+        if (isBooleanConstant(args[0], true)) return makeBooleanExpression(false);
+        if (isBooleanConstant(args[0], false)) return makeBooleanExpression(true);
+
+        // double negation
+        auto call = dynamic_pointer_cast<CallExpression>(args[0]);
+        if (call && call->getName() == "_neg" && call->getArguments().size() == 1) return call->getArguments()[0];
+    }
+    else if ((name == "_and" || name == "_or") && args.size() == 2 && args[0] && args[1]) {
+        // neutral operand is left out, the dominant one decides alone
+        bool neutral = name == "_and";
+        for (int i = 0; i < 2; i++) {
+            if (isBooleanConstant(args[i], neutral)) return args[1 - i];
+            if (isBooleanConstant(args[i], !neutral)) return args[i];
+        }
+
+        if (args[0] == args[1]) return args[0];
+
+        // absorption - a & (a | b) is a, a & (a & b) is a & b (and the same for the or)
+        for (int i = 0; i < 2; i++) {
+            auto call = dynamic_pointer_cast<CallExpression>(args[1 - i]);
+            if (!call || call->getArguments().size() != 2 || (call->getName() != "_and" && call->getName() != "_or")) continue;
+
+            auto& callArgs = call->getArguments();
+            if (callArgs[0] == args[i] || callArgs[1] == args[i]) return call->getName() == name ? args[1 - i] : args[i];
+        }
+    }
+    return shared_ptr<Expression>();
+}
+
+void ProgramAnalyzer::resolveFunctionSlots(shared_ptr<Function> function) {
+    // arguments take the first slots, other locals follow in the order of the first use
+    map<string, int> slots;
+    for (auto& arg : function->getArguments()) slots.emplace(arg, (int)slots.size());
+    for (auto& statement : function->getStatements()) resolveStatementSlots(statement, slots);
+
+    function->setSlotsCount((int)slots.size());
+}
+
+void ProgramAnalyzer::resolveStatementSlots(shared_ptr<Statement> currStatement, map<string, int>& slots) {
+    if (dynamic_pointer_cast<Assignment>(currStatement)) {
+        resolveIdentifier(dynamic_pointer_cast<Assignment>(currStatement)->getTarget(), slots);
+    }
+
+    if (dynamic_pointer_cast<CallAssignment>(currStatement)) {
+        for (auto& arg : dynamic_pointer_cast<CallAssignment>(currStatement)->getFunctionArgs()) {
+            if (dynamic_pointer_cast<IdentifierValue>(arg)) resolveIdentifier(dynamic_pointer_cast<IdentifierValue>(arg)->getIdentifier(), slots);
+        }
+    }
+    else if (dynamic_pointer_cast<IdentifierAssignment>(currStatement)) {
+        resolveIdentifier(dynamic_pointer_cast<IdentifierAssignment>(currStatement)->getValue()->getIdentifier(), slots);
+    }
+    else if (dynamic_pointer_cast<Return>(currStatement)) {
+        auto value = dynamic_pointer_cast<IdentifierValue>(dynamic_pointer_cast<Return>(currStatement)->getValue());
+        if (value) resolveIdentifier(value->getIdentifier(), slots);
+    }
+    else if (dynamic_pointer_cast<Condition>(currStatement)) {
+        auto cond = dynamic_pointer_cast<Condition>(currStatement);
+        resolveIdentifier(cond->getConditionValue()->getIdentifier(), slots);
+        for (auto& statement : cond->getThenStatements()) resolveStatementSlots(statement, slots);
+        for (auto& statement : cond->getElseStatements()) resolveStatementSlots(statement, slots);
+    }
+    else if (dynamic_pointer_cast<Dispatch>(currStatement)) {
+        auto dispatch = dynamic_pointer_cast<Dispatch>(currStatement);
+        resolveIdentifier(dispatch->getValue()->getIdentifier(), slots);
+        for (int i = 0; i < dispatch->getCasesCount(); i++) {
+            for (auto& statement : dispatch->getCaseStatements(i)) resolveStatementSlots(statement, slots);
+        }
+    }
+}
+
+void ProgramAnalyzer::resolveIdentifier(shared_ptr<Identifier> identifier, map<string, int>& slots) {
+    auto& name = identifier->getName();
+    if (identifier->isGlobal()) {
+        identifier->setFieldPath(Symbols::internPath(name));
+        return;
+    }
+
+    size_t dotPos = name.find('.');
+    auto slotIt = slots.emplace(name.substr(0, dotPos), (int)slots.size()).first;
+
+    identifier->setSlot(slotIt->second);
+    identifier->setFieldPath(dotPos == string::npos ? FieldPath() : Symbols::internPath(name.substr(dotPos + 1)));
+}
+
+void ProgramAnalyzer::markTailCalls(const vector<shared_ptr<Statement> >& statements) {
+    for (size_t i = 0; i < statements.size(); i++) {
+        if (dynamic_pointer_cast<Condition>(statements[i])) {
+            auto cond = dynamic_pointer_cast<Condition>(statements[i]);
+            markTailCalls(cond->getThenStatements());
+            markTailCalls(cond->getElseStatements());
+            continue;
+        }
+        if (dynamic_pointer_cast<Dispatch>(statements[i])) {
+            auto dispatch = dynamic_pointer_cast<Dispatch>(statements[i]);
+            for (int j = 0; j < dispatch->getCasesCount(); j++) markTailCalls(dispatch->getCaseStatements(j));
+            continue;
+        }
+
+        // function call into a local variable followed by the return of the variable
+        auto call = dynamic_pointer_cast<CallAssignment>(statements[i]);
+        if (!call) continue;
+
+        // marks of the previous analysis are replaced, the optimizer rewrites the statements
+        call->setTailCall(false);
+        if (i + 1 == statements.size() || !program->getFunction(call->getFunctionName())) continue;
+
+        auto ret = dynamic_pointer_cast<Return>(statements[i + 1]);
+        auto value = ret ? dynamic_pointer_cast<IdentifierValue>(ret->getValue()) : shared_ptr<IdentifierValue>();
+        if (!value) continue;
+
+        auto& target = *call->getTarget();
+        auto& returned = *value->getIdentifier();
+        if (target.isLocal() && returned.isLocal() && target.getFieldPath().empty() && returned.getFieldPath().empty() &&
+            target.getSlot() == returned.getSlot()) {
+            call->setTailCall(true);
+        }
+    }
+}
@@ -2,21 +2,48 @@
 #define PROGRAM_ANALYZER_H
 
 #include <map>
+#include <string>
+#include <unordered_map>
 
 #include "Program.h"
 
+// Determines the recursive and the pure functions and the global variables of every function from the components of
+// the call graph, the read / write expressions of the main, the frame slots of the locals and the tail calls.
+// Expressions are hash-consed - structurally equal expressions are one shared object, so the merged branches of
+// the conditions compare by the pointers. Boolean operations and conditions are simplified when they are built.
 class ProgramAnalyzer {
 public:
+    // bigger expressions are only counted by the print, shared sub-expressions are printed for every use
+    static constexpr int MAX_PRINTED_SIZE = 1000;
+
     explicit ProgramAnalyzer(std::shared_ptr<Program> program) : program(std::move(program)) { };
 
+    // can be run again after the program is rewritten, all the results are replaced
     void analyze();
+    void print() const;
 
 private:
-    bool isFunctionRecursive(std::shared_ptr<Function>, std::shared_ptr<Function>, std::set<std::shared_ptr<Function> >&);
-    bool isFunctionStatementRecursive(std::shared_ptr<Function>, std::shared_ptr<Statement>, std::set<std::shared_ptr<Function> >&);
+    // function with its direct variables and calls, callees are the indexes of the program functions
+    struct CallGraphNode {
+        std::shared_ptr<Function> function;
+        std::vector<int> callees;
+        std::set<std::string> readVars;
+        std::set<std::string> writeVars;
+
+        // all the called built-in functions are known and pure
+        bool pureCalls = true;
+
+        // strongly connected component of the node
+        int index = -1;
+        int lowLink = -1;
+        bool onStack = false;
+        int component = -1;
+    };
 
-    void determineFunctionVariables(std::shared_ptr<Function>, std::set<std::string>&, std::set<std::string>&, std::set<std::shared_ptr<Function> >&);
-    void determineFunctionStatementVariables(std::shared_ptr<Statement>, std::set<std::string>&, std::set<std::string>&, std::set<std::shared_ptr<Function> >&);
+    void buildCallGraph();
+    void collectStatementCalls(std::shared_ptr<Statement>, CallGraphNode&, const std::map<const Function*, int>&);
+    void connectComponent(int, int&, std::vector<int>&);
+    void summarizeComponent(const std::vector<int>&);
 
     void determineFunctionExpressions(std::shared_ptr<Function>, std::shared_ptr<Expression>,
                                       std::map<std::string, std::shared_ptr<Expression> >&,
@@ -31,7 +58,37 @@ private:
                                                std::map<std::string, std::set<std::shared_ptr<Expression> > >&,
                                                std::set<std::shared_ptr<Function> >&);
 
+    void determineConditionExpressions(std::shared_ptr<Expression>,
+                                       const std::vector<std::shared_ptr<Statement> >&,
+                                       const std::vector<std::shared_ptr<Statement> >&,
+                                       std::shared_ptr<Expression>,
+                                       std::map<std::string, std::shared_ptr<Expression> >&,
+                                       std::map<std::string, std::shared_ptr<Expression> >&,
+                                       std::map<std::string, std::set<std::shared_ptr<Expression> > >&,
+                                       std::map<std::string, std::set<std::shared_ptr<Expression> > >&,
+                                       std::set<std::shared_ptr<Function> >&);
+
+    std::shared_ptr<Expression> makeValueExpression(std::shared_ptr<Value>);
+    std::shared_ptr<Expression> makeBooleanExpression(bool);
+    std::shared_ptr<Expression> makeCallExpression(const std::string&, std::vector<std::shared_ptr<Expression> >);
+    std::shared_ptr<Expression> makeCaseExpression(std::shared_ptr<Expression>, std::shared_ptr<Expression>, const Dispatch*, int);
+    std::shared_ptr<Expression> makeConditionExpression(std::shared_ptr<Expression>, std::shared_ptr<Expression>, std::shared_ptr<Expression>);
+    std::shared_ptr<Expression> simplifyCall(const std::string&, const std::vector<std::shared_ptr<Expression> >&);
+
+    void resolveFunctionSlots(std::shared_ptr<Function>);
+    void resolveStatementSlots(std::shared_ptr<Statement>, std::map<std::string, int>&);
+    void resolveIdentifier(std::shared_ptr<Identifier>, std::map<std::string, int>&);
+
+    void markTailCalls(const std::vector<std::shared_ptr<Statement> >&);
+
     std::shared_ptr<Program> program;
+
+    // nodes in the order of the program functions, components in the bottom-up order
+    std::vector<CallGraphNode> callGraph;
+    std::vector<std::vector<int> > components;
+
+    // hash-consed expressions by their structural keys, children are identified by their addresses
+    std::unordered_map<std::string, std::shared_ptr<Expression> > expressions;
 };
 
 
@@ -1,5 +1,9 @@
+#include <atomic>
+#include <algorithm>
 #include <stdexcept>
 
+#include "MemoCache.h"
+#include "BytecodeVM.h"
 #include "ProgramExecutor.h"
 #include "BuiltInFunction.h"
 
@@ -17,296 +21,728 @@ string paddNewLines(const string& str, const string& padder) {
     return res;
 }
 
+// Values
+static_assert(sizeof(TaggedValue) == 24, "Tagged value should be a tag with a pointer sized payload.");
+
+static wstring_convert<codecvt_utf8<char32_t>, char32_t>& getUTFConverter() {
+    // converter is not thread safe, so every thread has its own
+    thread_local wstring_convert<codecvt_utf8<char32_t>, char32_t> utfConverter;
+    return utfConverter;
+}
+
+string toUTF8(const u32string& str) {
+    return getUTFConverter().to_bytes(str);
+}
+
+string toUTF8(char32_t ch) {
+    return getUTFConverter().to_bytes(ch);
+}
+
+u32string fromUTF8(const string& str) {
+    return getUTFConverter().from_bytes(str);
+}
+
+TaggedValue TaggedValue::makeString(const u32string& value) {
+    TaggedValue res;
+    new (&res.heap) shared_ptr<ExecValue>(make_shared<ExecString>(value));
+    res.type = String;
+    return res;
+}
+
+TaggedValue TaggedValue::makeObject(shared_ptr<ExecObject> value) {
+    if (!value) return makeNull();
+
+    TaggedValue res;
+    new (&res.heap) shared_ptr<ExecValue>(move(value));
+    res.type = Object;
+    return res;
+}
+
+TaggedValue TaggedValue::unbox(const shared_ptr<ExecValue>& value) {
+    auto ptr = value.get();
+    if (!ptr || dynamic_cast<ExecNull*>(ptr)) return makeNull();
+    if (dynamic_cast<ExecBoolean*>(ptr)) return makeBoolean(static_cast<ExecBoolean*>(ptr)->getValue());
+    if (dynamic_cast<ExecInteger*>(ptr)) return makeInteger(static_cast<ExecInteger*>(ptr)->getValue());
+    if (dynamic_cast<ExecFloat*>(ptr)) return makeFloat(static_cast<ExecFloat*>(ptr)->getValue());
+    if (dynamic_cast<ExecChar*>(ptr)) return makeChar(static_cast<ExecChar*>(ptr)->getValue());
+
+    // strings and objects keep their allocation
+    TaggedValue res;
+    new (&res.heap) shared_ptr<ExecValue>(value);
+    res.type = dynamic_cast<ExecString*>(ptr) ? String : Object;
+    return res;
+}
+
+shared_ptr<ExecValue> TaggedValue::box() const {
+    switch (type) {
+        case Null: return make_shared<ExecNull>();
+        case Boolean: return make_shared<ExecBoolean>(boolean);
+        case Integer: return make_shared<ExecInteger>(integer);
+        case Float: return make_shared<ExecFloat>(floating);
+        case Char: return make_shared<ExecChar>(character);
+        case String:
+        case Object: return heap;
+        default: return shared_ptr<ExecValue>();
+    }
+}
+
+shared_ptr<ExecObject> TaggedValue::getObjectPtr() const {
+    return type == Object ? static_pointer_cast<ExecObject>(heap) : shared_ptr<ExecObject>();
+}
+
+ExecObject* TaggedValue::getMutableObject() {
+    if (type != Object) return nullptr;
+
+    // the only owner can modify the object in place
+    if (heap.use_count() > 1) heap = heap->clone();
+    return (ExecObject*)heap.get();
+}
+
+TaggedValue TaggedValue::copy() const {
+    if (type == Object) return makeObject(getObject()->deepClone());
+    return *this;
+}
+
+string TaggedValue::toString() const {
+    switch (type) {
+        case Boolean: return boolean ? "true" : "false";
+        case Integer: return to_string(integer);
+        case Float: return to_string(floating);
+        case Char: return "'" + toUTF8(character) + "'";
+        case String:
+        case Object: return heap->toString();
+        default: return "null";
+    }
+}
+
 // Objects
+static atomic<long long> clonesCount(0);
+static atomic<long long> copiedBytes(0);
+
+long long ExecObject::getClonesCount() {
+    return clonesCount;
+}
+
+long long ExecObject::getCopiedBytes() {
+    return copiedBytes;
+}
+
 void ExecObject::ensureFieldPath(const string& path, bool sticky) {
-    if (path.length() == 0) return;
+    ensureFieldPaths(vector<string>(1, path), sticky);
+}
+
+void ExecObject::ensureFieldPaths(const vector<string>& paths, bool sticky) {
+    // sticky paths are shared by the copies of the object, so they are copied once for all the new paths
+    auto stickyPaths = stickyFieldPaths ? make_shared<vector<FieldPath> >(*stickyFieldPaths) : make_shared<vector<FieldPath> >();
 
-    // save path for sticky handling
-    if (sticky) stickyFieldPaths.push_back(path);
+    for (auto& path : paths) {
+        if (path.length() == 0) continue;
 
-    size_t dotPos = path.find('.');
-    if (dotPos == string::npos) {
-        // just reassigning to ensure that pointer (maybe NULL) is created
-        fields[path] = fields[path];
+        auto fieldPath = Symbols::internPath(path);
+
+        // save path for sticky handling
+        if (sticky) stickyPaths->push_back(fieldPath);
+
+        ensureFieldPath(fieldPath, 0);
     }
-    else {
-        string field = path.substr(0, dotPos);
-        string subPath = path.substr(dotPos + 1);
 
-        // recursively creating objects
-        auto subObj = make_shared<ExecObject>();
-        subObj->ensureFieldPath(subPath, false);
-        fields[field] = subObj;
+    if (sticky) stickyFieldPaths = move(stickyPaths);
+}
+
+void ExecObject::ensureFieldPath(const FieldPath& path, size_t from) {
+    if (from + 1 == path.size()) {
+        // just reassigning to ensure that value (maybe null) is created
+        auto& field = fields[path[from]];
+        if (field.isUndefined()) field = TaggedValue::makeNull();
+    }
+    else {
+        // recursively creating objects, existing ones keep their fields
+        auto& field = fields[path[from]];
+        if (!field.isObject()) field = TaggedValue::makeObject(make_shared<ExecObject>());
+        field.getMutableObject()->ensureFieldPath(path, from + 1);
     }
 }
 
-shared_ptr<ExecValue> ExecObject::getFieldByPath(const string& path) const {
-    size_t dotPos = path.find('.');
-    if (dotPos == string::npos) return fields[path];
+TaggedValue ExecObject::getValueByPath(const string& path) const {
+    return getValueByPath(Symbols::internPath(path));
+}
 
-    string field = path.substr(0, dotPos);
-    string subPath = path.substr(dotPos + 1);
+void ExecObject::setValueByPath(const string& path, TaggedValue val) {
+    setValueByPath(Symbols::internPath(path), move(val));
+}
 
-    auto subObj = fields[field];
-    if (subObj) {
-        if (dynamic_pointer_cast<ExecObject>(subObj)) {
-            return dynamic_pointer_cast<ExecObject>(subObj)->getFieldByPath(subPath);
+TaggedValue ExecObject::getValueByPath(const FieldPath& path) const {
+    const ExecObject* obj = this;
+    for (size_t i = 0; i + 1 < path.size(); i++) {
+        auto field = obj->fields.find(path[i]);
+        if (!field || field->isNull()) {
+            // Note: this is not a logic error like below!!!
+            return TaggedValue::makeNull();
         }
-        else {
-            throw logic_error("Bad return -> non-object value exists in the path.");
-        }
-    }
 
-    // Note: this is not a logic error like above!!!
-    return std::shared_ptr<ExecValue>();
+        if (!field->isObject()) throw logic_error("Bad return -> non-object value exists in the path.");
+        obj = field->getObject();
+    }
+    return obj->getValue(path.back());
 }
 
-void ExecObject::setFieldByPath(const string& path, shared_ptr<ExecValue> val) {
+void ExecObject::setValueByPath(const FieldPath& path, TaggedValue val, size_t inPlace) {
     // we do store special null values!
-    if (dynamic_pointer_cast<ExecNull>(val)) val = shared_ptr<ExecValue>();
+    if (val.isUndefined()) val = TaggedValue::makeNull();
 
     // ensuring needed sticky sub-paths in the val here!!!
-    if (dynamic_pointer_cast<ExecObject>(val)) {
-        for (auto& stickyPath : stickyFieldPaths) {
-            if (stickyPath.find(path + ".") == 0) {
-                dynamic_pointer_cast<ExecObject>(val)->ensureFieldPath(stickyPath.substr(path.length() + 1), false);
+    if (val.isObject() && stickyFieldPaths) {
+        for (auto& stickyPath : *stickyFieldPaths) {
+            if (stickyPath.size() > path.size() && equal(path.begin(), path.end(), stickyPath.begin())) {
+                val.getMutableObject()->ensureFieldPath(stickyPath, path.size());
             }
         }
     }
 
-    // setting value
-    size_t dotPos = path.find('.');
-    if (dotPos == string::npos) {
-        fields[path] = val;
-        return;
+    ExecObject* obj = this;
+    for (size_t i = 0; i + 1 < path.size(); i++) {
+        auto& subObj = obj->fields[path[i]];
+        if (subObj.isNull()) subObj = TaggedValue::makeObject(make_shared<ExecObject>());
+
+        if (!subObj.isObject()) throw logic_error("Bad assignment -> non-object value exists in the path.");
+        obj = i < inPlace ? subObj.getObject() : subObj.getMutableObject();
     }
+    obj->fields[path.back()] = move(val);
+}
 
-    string field = path.substr(0, dotPos);
-    string subPath = path.substr(dotPos + 1);
+shared_ptr<ExecValue> ExecObject::getFieldByPath(const string& path) const {
+    auto val = getValueByPath(path);
+    return val.isNull() ? shared_ptr<ExecValue>() : val.box();
+}
 
-    auto subObj = fields[field];
-    if (!subObj) {
-        subObj = make_shared<ExecObject>();
-        fields[field] = subObj;
-    }
+void ExecObject::setFieldByPath(const string& path, shared_ptr<ExecValue> val) {
+    setValueByPath(path, TaggedValue::unbox(val));
+}
 
-    if (dynamic_pointer_cast<ExecObject>(subObj)) {
-        dynamic_pointer_cast<ExecObject>(subObj)->setFieldByPath(subPath, val);
-    }
-    else {
-        throw logic_error("Bad assignment -> non-object value exists in the path.");
+shared_ptr<ExecObject> ExecObject::withFieldByPath(const string& path, TaggedValue val) const {
+    return withFieldByPath(Symbols::internPath(path), 0, move(val));
+}
+
+shared_ptr<ExecObject> ExecObject::withFieldByPath(const FieldPath& path, size_t from, TaggedValue val) const {
+    auto res = make_shared<ExecObject>();
+    res->stickyFieldPaths = stickyFieldPaths;
+    res->fields = fields;
+
+    if (from + 1 == path.size()) {
+        res->fields[path[from]] = move(val);
+        return res;
     }
+
+    auto subObj = getValue(path[from]);
+    if (subObj.isNull()) subObj = TaggedValue::makeObject(make_shared<ExecObject>());
+
+    if (!subObj.isObject()) throw logic_error("Bad assignment -> non-object value exists in the path.");
+    res->fields[path[from]] = TaggedValue::makeObject(subObj.getObject()->withFieldByPath(path, from + 1, move(val)));
+
+    return res;
 }
 
 shared_ptr<ExecValue> ExecObject::clone() const {
     auto res = make_shared<ExecObject>();
     res->stickyFieldPaths = stickyFieldPaths;
-    for (auto& val : fields) res->setField(val.first, val.second ? val.second->clone() : shared_ptr<ExecValue>());
+    res->fields = fields;
+
+    // small objects have the fields inline
+    long long bytes = sizeof(ExecObject);
+    if (fields.size() > FieldTable<TaggedValue>::INLINE_SIZE) bytes += fields.size() * sizeof(FieldTable<TaggedValue>::Field);
+    clonesCount += 1;
+    copiedBytes += bytes;
+
+    return res;
+}
+
+shared_ptr<ExecObject> ExecObject::deepClone() const {
+    auto res = static_pointer_cast<ExecObject>(clone());
+    for (auto& field : res->fields) field.value = field.value.copy();
     return res;
 }
 
 string ExecObject::toString() const {
+    // fields are printed ordered by the names
+    vector<const FieldTable<TaggedValue>::Field*> sorted;
+    for (auto& field : fields) sorted.push_back(&field);
+    sort(sorted.begin(), sorted.end(), [](auto left, auto right) {
+        return Symbols::getName(left->id) < Symbols::getName(right->id);
+    });
+
     string res = "{\n";
-    for (auto& val : fields) {
-        res += "  " + val.first + ": ";
-        res += paddNewLines(val.second ? val.second->toString() : "null", "  ") + "\n";
+    for (auto field : sorted) {
+        res += "  " + Symbols::getName(field->id) + ": ";
+        res += paddNewLines(field->value.toString(), "  ") + "\n";
     }
     return res + "}";
 }
 
 // Executor
-ProgramExecutor::ProgramExecutor(shared_ptr<Program> program) : program(move(program)) {
-    initBuiltInFunctions();
+ProgramExecutor::ProgramExecutor(shared_ptr<Program> program) :
+        program(move(program)), mainFunction(nullptr), mainDispatch(nullptr), engine(Interpreter) {
+}
+
+void ProgramExecutor::link() {
+    auto main = program->getFunction("main");
+    mainFunction = main.get();
+
+    mainDispatch = main ? main->getSpecializedDispatch().get() : nullptr;
+    mainVariants.clear();
+    if (main) {
+        for (auto& variant : main->getVariants()) mainVariants.push_back(variant.get());
+    }
+
+    // expressions are shared by the variables and the functions, every one is linked once
+    set<const Expression*> linkedExpressions;
+    for (auto& function : program->getFunctions()) {
+        for (auto& statement : function->getStatements()) linkStatement(statement);
+
+        // expressions added by the analyzer are evaluated by the access predicates
+        for (auto& exps : function->getReadExpressions()) {
+            for (auto& exp : exps.second) linkExpression(exp, linkedExpressions);
+        }
+        for (auto& exps : function->getWriteExpressions()) {
+            for (auto& exp : exps.second) linkExpression(exp, linkedExpressions);
+        }
+    }
+
+    // compiled program has to use the new callees
+    if (vm) vm = make_shared<BytecodeVM>(*this);
+}
+
+void ProgramExecutor::linkStatement(const shared_ptr<Statement>& statement) {
+    if (dynamic_pointer_cast<Condition>(statement)) {
+        auto cond = dynamic_pointer_cast<Condition>(statement);
+        for (auto& condStatement : cond->getThenStatements()) linkStatement(condStatement);
+        for (auto& condStatement : cond->getElseStatements()) linkStatement(condStatement);
+    }
+    else if (dynamic_pointer_cast<Dispatch>(statement)) {
+        auto dispatch = dynamic_pointer_cast<Dispatch>(statement);
+        for (int i = 0; i < dispatch->getCasesCount(); i++) {
+            for (auto& caseStatement : dispatch->getCaseStatements(i)) linkStatement(caseStatement);
+        }
+    }
+    else if (dynamic_pointer_cast<CallAssignment>(statement)) {
+        auto call = dynamic_pointer_cast<CallAssignment>(statement);
+        int argsCount = (int)call->getFunctionArgs().size();
+
+        auto function = program->getFunction(call->getFunctionName());
+        if (function) {
+            if (function->getArguments().size() != argsCount) {
+                throw logic_error("Bad arguments count for the function named '" + function->getName() + "'.");
+            }
+            call->setCallee(function.get(), nullptr);
+            return;
+        }
+
+        auto builtInFunction = findBuiltIn(call->getFunctionName());
+        if (!builtInFunction) throw logic_error("Function with the name '" + call->getFunctionName() + "' does not exist.");
+        if (builtInFunction->getArgsCount() != argsCount) {
+            throw logic_error("Wrong arguments count for the function '" + call->getFunctionName() + "'.");
+        }
+        call->setCallee(nullptr, builtInFunction);
+    }
+}
+
+void ProgramExecutor::linkExpression(const shared_ptr<Expression>& expression, set<const Expression*>& linkedExpressions) {
+    if (!linkedExpressions.insert(expression.get()).second) return;
+
+    if (dynamic_pointer_cast<ConditionExpression>(expression)) {
+        auto exp = dynamic_pointer_cast<ConditionExpression>(expression);
+        linkExpression(exp->getConditionExpression(), linkedExpressions);
+        linkExpression(exp->getThenExpression(), linkedExpressions);
+        linkExpression(exp->getElseExpression(), linkedExpressions);
+    }
+    else if (dynamic_pointer_cast<CallExpression>(expression)) {
+        auto exp = dynamic_pointer_cast<CallExpression>(expression);
+        for (auto& arg : exp->getArguments()) linkExpression(arg, linkedExpressions);
+
+        // unknown callee makes the expression undetermined, it fails only when it is evaluated
+        auto function = program->getFunction(exp->getName());
+        exp->setCallee(function.get(), function ? nullptr : findBuiltIn(exp->getName()));
+    }
+}
+
+void ProgramExecutor::overrideBuiltInFunction(const BuiltInFunction& function) {
+    builtInOverrides[function.getName()] = make_shared<BuiltInFunction>(function);
+    link();
+}
+
+void ProgramExecutor::setMemoCapacity(size_t capacity) {
+    memoCache = capacity > 0 ? make_shared<MemoCache>(capacity) : shared_ptr<MemoCache>();
+}
+
+const BuiltInFunction* ProgramExecutor::findBuiltIn(const string& name) const {
+    auto overrideIt = builtInOverrides.find(name);
+    if (overrideIt != builtInOverrides.end()) return overrideIt->second.get();
+
+    return findBuiltInFunction(name);
+}
+
+void ProgramExecutor::setEngine(Engine engine) {
+    // program is compiled once, when the VM is selected for the first time
+    if (engine == Bytecode && !vm) vm = make_shared<BytecodeVM>(*this);
+    this->engine = engine;
 }
 
 shared_ptr<ExecValue> ProgramExecutor::exec(shared_ptr<ExecValue> arg) {
-    auto mainFunction = program->getFunction("main");
+    return exec(move(arg), getReadGlobal(), getWriteGlobal());
+}
+
+shared_ptr<ExecValue> ProgramExecutor::exec(shared_ptr<ExecValue> arg, shared_ptr<ExecObject> readGlobal, shared_ptr<ExecObject> writeGlobal) {
+    // frames and arguments of the message are released at once when it finishes
+    MessageArena::Scope arenaScope;
+
     if (!mainFunction) throw logic_error("No function with name 'main' defined.");
+    auto& function = selectMain(TaggedValue::unbox(arg));
+
+    if (engine == Bytecode) return vm->exec(function, move(arg), move(readGlobal), move(writeGlobal));
 
-    // setup local context for the function
-    auto local = make_shared<ExecObject>();
-    for (auto& argName : mainFunction->getArguments()) local->setField(argName, arg->clone());
+    // setup local context for the function, arguments are in the first slots
+    LocalFrame local(function.getSlotsCount());
+    for (int i = 0; i < function.getArguments().size(); i++) local[i] = TaggedValue::unbox(arg);
 
     // execute function within the context
-    return execFunction(mainFunction, getReadGlobal(), getWriteGlobal(), local);
+    return execFunction(function, readGlobal, writeGlobal, move(local)).box();
+}
+
+const Function& ProgramExecutor::selectMain(const TaggedValue& arg) const {
+    if (!mainDispatch) return *mainFunction;
+
+    // message of a known type runs only its own handler, the generic main handles the rest (and the errors)
+    auto& path = mainDispatch->getValue()->getIdentifier()->getFieldPath();
+    if (!path.empty() && !arg.isObject()) return *mainFunction;
+
+    auto value = path.empty() ? arg : arg.getObject()->getValueByPath(path);
+    int index = value.isString() ? mainDispatch->findCase(value.getString()) : -1;
+    return index >= 0 ? *mainVariants[index] : *mainFunction;
+}
+
+TaggedValue ProgramExecutor::execExpression(shared_ptr<Expression> expression, std::shared_ptr<ExecObject> local) {
+    ExpressionValues values;
+    return execExpression(expression, local, values);
+}
+
+TaggedValue ProgramExecutor::execExpression(const shared_ptr<Expression>& expression, const shared_ptr<ExecObject>& local,
+                                            ExpressionValues& values) {
+    auto valueIt = values.find(expression.get());
+    if (valueIt != values.end()) return valueIt->second;
+
+    auto res = evalExpression(expression, local, values);
+    values.emplace(expression.get(), res);
+    return res;
 }
 
-shared_ptr<ExecValue> ProgramExecutor::execExpression(shared_ptr<Expression> expression, std::shared_ptr<ExecObject> local) {
+TaggedValue ProgramExecutor::evalExpression(const shared_ptr<Expression>& expression, const shared_ptr<ExecObject>& local,
+                                            ExpressionValues& values) {
     if (dynamic_pointer_cast<ValueExpression>(expression)) {
-        return execValue(dynamic_pointer_cast<ValueExpression>(expression)->getValue(),
-                         shared_ptr<ExecObject>(), shared_ptr<ExecObject>(), local);
+        auto& value = dynamic_pointer_cast<ValueExpression>(expression)->getValue();
+
+        // expressions are evaluated outside of the functions, so the locals are looked up by the names
+        if (dynamic_pointer_cast<IdentifierValue>(value)) {
+            auto identifier = dynamic_pointer_cast<IdentifierValue>(value)->getIdentifier();
+            if (identifier->isGlobal()) throw logic_error("Access expression cannot read global variable.");
+
+            return local->getValueByPath(identifier->getName());
+        }
+
+        LocalFrame noLocals;
+        return execValue(value, shared_ptr<ExecObject>(), shared_ptr<ExecObject>(), noLocals);
     }
     else if (dynamic_pointer_cast<CallExpression>(expression)) {
         auto exp = dynamic_pointer_cast<CallExpression>(expression);
-        auto function = program->getFunction(exp->getName());
-
-        auto value = shared_ptr<ExecValue>();
-        if (function) {
-            if (function->getArguments().size() != exp->getArguments().size()) {
-                throw logic_error("Bad arguments count for the function named '" + function->getName() + "'.");
-            }
 
-            auto funcLocal = make_shared<ExecObject>();
-            for (int i = 0; i < function->getArguments().size(); i++) {
-                funcLocal->setField(function->getArguments()[i], execExpression(exp->getArguments()[i], local));
-            }
-            value = execFunction(function, shared_ptr<ExecObject>(), shared_ptr<ExecObject>(), funcLocal);
+        vector<TaggedValue> args;
+        if (exp->getFunction()) {
+            for (auto& arg : exp->getArguments()) args.push_back(execExpression(arg, local, values));
+            return execCall(*exp->getFunction(), args);
         }
-        else if (BUILT_IN_FUNCTIONS[exp->getName()].isDefined()) {
-            vector<shared_ptr<ExecValue> > args;
-            for (int i = 0; i < exp->getArguments().size(); i++) {
-                args.push_back(execExpression(exp->getArguments()[i], local));
-            }
-            value = BUILT_IN_FUNCTIONS[exp->getName()](BuiltInArguments(args));
-        }
-        else {
-            throw logic_error("Function with the name '" + exp->getName() + "' does not exist.");
+        else if (exp->getBuiltInFunction()) {
+            for (auto& arg : exp->getArguments()) args.push_back(execExpression(arg, local, values));
+            return (*exp->getBuiltInFunction())(BuiltInArguments(args.data(), args.size()));
         }
 
-        return value;
+        throw logic_error("Function with the name '" + exp->getName() + "' does not exist.");
     }
     else if (dynamic_pointer_cast<ConditionExpression>(expression)) {
         auto exp = dynamic_pointer_cast<ConditionExpression>(expression);
-        auto cond = execExpression(exp->getConditionExpression(), local);
-        if (!dynamic_pointer_cast<ExecBoolean>(cond)) {
-            throw logic_error("Condition expression does not evaluate to boolean.");
-        }
+        auto cond = execExpression(exp->getConditionExpression(), local, values);
+        if (!cond.isBoolean()) throw logic_error("Condition expression does not evaluate to boolean.");
 
-        return execExpression(dynamic_pointer_cast<ExecBoolean>(cond)->getValue() ? exp->getThenExpression() : exp->getElseExpression(), local);
+        return execExpression(cond.getBoolean() ? exp->getThenExpression() : exp->getElseExpression(), local, values);
     }
 
     // expression in undetermined
     throw logic_error("Cannot execute undetermined expression.");
 }
 
-shared_ptr<ExecValue> ProgramExecutor::execFunction(shared_ptr<Function> function,
-                                                    shared_ptr<ExecObject> readGlobal,
-                                                    shared_ptr<ExecObject> writeGlobal,
-                                                    shared_ptr<ExecObject> local) {
-    for (auto& statement : function->getStatements()) {
-        auto res = execStatement(statement, readGlobal, writeGlobal, local);
-        if (res) return res;
+TaggedValue ProgramExecutor::execCall(const Function& function, const vector<TaggedValue>& args) {
+    if (function.getArguments().size() != args.size()) {
+        throw logic_error("Bad arguments count for the function named '" + function.getName() + "'.");
     }
-    return shared_ptr<ExecValue>();
-}
 
-shared_ptr<ExecValue> ProgramExecutor::execStatement(shared_ptr<Statement> statement,
-                                                     shared_ptr<ExecObject> readGlobal,
-                                                     shared_ptr<ExecObject> writeGlobal,
-                                                     shared_ptr<ExecObject> local) {
-    if (dynamic_pointer_cast<Return>(statement)) {
-        return execValue(dynamic_pointer_cast<Return>(statement)->getValue(), readGlobal, writeGlobal, local);
+    // helpers of the access predicates are usually called with the same arguments by many messages
+    bool memoized = memoCache && function.isPure();
+
+    TaggedValue res;
+    if (memoized && memoCache->find(function, args.data(), args.size(), res)) return res;
+
+    MessageArena::Scope arenaScope;
+
+    if (engine == Bytecode) res = vm->execCall(function, args);
+    else {
+        // functions called from expressions cannot touch the global state
+        LocalFrame funcLocal(function.getSlotsCount());
+        copy(args.begin(), args.end(), funcLocal.begin());
+
+        res = execFunction(function, shared_ptr<ExecObject>(), shared_ptr<ExecObject>(), move(funcLocal));
     }
-    else if (dynamic_pointer_cast<Condition>(statement)) {
-        auto cond = dynamic_pointer_cast<Condition>(statement);
-        auto condValue = dynamic_pointer_cast<ExecBoolean>(execValue(cond->getConditionValue(), readGlobal, writeGlobal, local));
-        if (!condValue) throw logic_error("Condition value does not evaluate to boolean.");
 
-        if (condValue->getValue()) {
-            for (auto& condStatement : cond->getThenStatements()) {
-                auto res = execStatement(condStatement, readGlobal, writeGlobal, local);
-                if (res) return res;
+    if (memoized) memoCache->insert(function, args.data(), args.size(), res);
+    return res;
+}
+
+TaggedValue ProgramExecutor::execFunction(const Function& function,
+                                          const shared_ptr<ExecObject>& readGlobal,
+                                          const shared_ptr<ExecObject>& writeGlobal,
+                                          LocalFrame local) {
+    // called functions do not recurse on the C++ stack, their frames are pushed to the interpreter stack
+    ArenaVector<CallFrame> frames;
+    ArenaVector<Block> blocks;
+
+    // arguments of the called pure functions, the result is cached under them when the function returns
+    ArenaVector<TaggedValue> memoArgs;
+    auto memo = memoCache.get();
+
+    frames.push_back({ &function, move(local), 0, nullptr, false, nullptr });
+    blocks.push_back({ &function.getStatements(), 0 });
+
+    while (true) {
+        auto& frame = frames.back();
+        auto& block = blocks.back();
+
+        TaggedValue res;
+        if (block.next < block.statements->size()) {
+            auto& statement = (*block.statements)[block.next++];
+
+            if (dynamic_pointer_cast<Condition>(statement)) {
+                auto cond = dynamic_pointer_cast<Condition>(statement);
+                auto condValue = execValue(cond->getConditionValue(), readGlobal, writeGlobal, frame.local);
+                if (!condValue.isBoolean()) throw logic_error("Condition value does not evaluate to boolean.");
+
+                blocks.push_back({ condValue.getBoolean() ? &cond->getThenStatements() : &cond->getElseStatements(), 0 });
+                continue;
             }
-        }
-        else {
-            for (auto& condStatement : cond->getElseStatements()) {
-                auto res = execStatement(condStatement, readGlobal, writeGlobal, local);
-                if (res) return res;
+
+            if (dynamic_pointer_cast<Dispatch>(statement)) {
+                // only strings can equal the literals of the cases
+                auto dispatch = static_pointer_cast<Dispatch>(statement);
+                auto value = execValue(dispatch->getValue(), readGlobal, writeGlobal, frame.local);
+
+                int index = value.isString() ? dispatch->findCase(value.getString()) : -1;
+                if (index >= 0) blocks.push_back({ &dispatch->getCaseStatements(index), 0 });
+                continue;
+            }
+
+            // callee and the arguments count are checked by the link step
+            auto call = dynamic_cast<const CallAssignment*>(statement.get());
+            if (call && call->getFunction()) {
+                auto callee = call->getFunction();
+
+                LocalFrame calleeLocal(callee->getSlotsCount());
+                for (int i = 0; i < callee->getArguments().size(); i++) {
+                    calleeLocal[i] = execValue(call->getFunctionArgs()[i], readGlobal, writeGlobal, frame.local);
+                }
+
+                if (call->isTailCall()) {
+                    // result of the callee is the result of the frame - the frame is reused, so the tail
+                    // recursion runs in constant memory
+                    frame.function = callee;
+                    frame.local.assign(callee->getSlotsCount(), TaggedValue());
+                    move(calleeLocal.begin(), calleeLocal.end(), frame.local.begin());
+                    frame.tailCalled = true;
+
+                    blocks.resize(frame.blocksBase);
+                    blocks.push_back({ &callee->getStatements(), 0 });
+                }
+                else {
+                    // tail calls are not looked up, the result is cached for the call which started the frame
+                    const Function* memoized = nullptr;
+                    if (memo && callee->isPure()) {
+                        size_t argsCount = callee->getArguments().size();
+
+                        TaggedValue cached;
+                        if (memo->find(*callee, calleeLocal.data(), argsCount, cached)) {
+                            execStore(*call->getTarget(), move(cached), writeGlobal, frame.local);
+                            continue;
+                        }
+
+                        memoArgs.insert(memoArgs.end(), calleeLocal.begin(), calleeLocal.begin() + argsCount);
+                        memoized = callee;
+                    }
+
+                    size_t blocksBase = blocks.size();
+                    frames.push_back({ callee, move(calleeLocal), blocksBase, call, false, memoized });
+                    blocks.push_back({ &callee->getStatements(), 0 });
+                }
+                continue;
+            }
+
+            if (!dynamic_pointer_cast<Return>(statement)) {
+                execAssignment(static_cast<const Assignment&>(*statement), readGlobal, writeGlobal, frame.local);
+                continue;
             }
+
+            res = execValue(dynamic_pointer_cast<Return>(statement)->getValue(), readGlobal, writeGlobal, frame.local);
         }
+        else if (blocks.size() > frame.blocksBase + 1) {
+            // end of the condition branch
+            blocks.pop_back();
+            continue;
+        }
+        else if (frame.tailCalled) {
+            // function reached by a tail call ended without return, the skipped return gives null
+            res = TaggedValue::makeNull();
+        }
+
+        if (frame.memoized) {
+            size_t argsCount = frame.memoized->getArguments().size();
+            memo->insert(*frame.memoized, memoArgs.data() + memoArgs.size() - argsCount, argsCount, res);
+            memoArgs.resize(memoArgs.size() - argsCount);
+        }
+
+        // returning from the frame, the result is stored by the call statement of the caller
+        auto call = frame.call;
+        blocks.resize(frame.blocksBase);
+        frames.pop_back();
+        if (frames.empty()) return res;
+
+        execStore(*call->getTarget(), move(res), writeGlobal, frames.back().local);
     }
-    else if (dynamic_pointer_cast<ConstantAssignment>(statement)) {
-        auto assign = dynamic_pointer_cast<ConstantAssignment>(statement);
-        auto value = execValue(assign->getValue(), readGlobal, writeGlobal, local);
+}
 
-        if (assign->getTarget()->isGlobal()) writeGlobal->setFieldByPath(assign->getTarget()->getName(), value);
-        else local->setFieldByPath(assign->getTarget()->getName(), value);
+void ProgramExecutor::execAssignment(const Assignment& assign,
+                                     const shared_ptr<ExecObject>& readGlobal,
+                                     const shared_ptr<ExecObject>& writeGlobal,
+                                     LocalFrame& local) {
+    TaggedValue value;
+    if (dynamic_cast<const ConstantAssignment*>(&assign)) {
+        value = execValue(static_cast<const ConstantAssignment&>(assign).getValue(), readGlobal, writeGlobal, local);
+    }
+    else if (dynamic_cast<const IdentifierAssignment*>(&assign)) {
+        value = execValue(static_cast<const IdentifierAssignment&>(assign).getValue(), readGlobal, writeGlobal, local);
+    }
+    else if (dynamic_cast<const CallAssignment*>(&assign)) {
+        // calls of the program functions are executed on the interpreter stack
+        auto& call = static_cast<const CallAssignment&>(assign);
+
+        ArenaVector<TaggedValue> args;
+        args.reserve(call.getFunctionArgs().size());
+        for (auto& arg : call.getFunctionArgs()) args.push_back(execValue(arg, readGlobal, writeGlobal, local));
+        value = (*call.getBuiltInFunction())(BuiltInArguments(args.data(), args.size()));
     }
-    else if (dynamic_pointer_cast<IdentifierAssignment>(statement)) {
-        auto assign = dynamic_pointer_cast<IdentifierAssignment>(statement);
-        auto value = execValue(assign->getValue(), readGlobal, writeGlobal, local);
 
-        if (assign->getTarget()->isGlobal()) writeGlobal->setFieldByPath(assign->getTarget()->getName(), value);
-        else local->setFieldByPath(assign->getTarget()->getName(), value);
+    execStore(*assign.getTarget(), move(value), writeGlobal, local);
+}
+
+void ProgramExecutor::execStore(const Identifier& target, TaggedValue value,
+                                const shared_ptr<ExecObject>& writeGlobal,
+                                LocalFrame& local) {
+    if (target.isGlobal()) {
+        storeGlobal(writeGlobal, target.getFieldPath(), move(value));
+        return;
     }
-    else if (dynamic_pointer_cast<CallAssignment>(statement)) {
-        auto assign = dynamic_pointer_cast<CallAssignment>(statement);
 
-        auto value = shared_ptr<ExecValue>();
-        auto function = program->getFunction(assign->getFunctionName());
-        if (function) {
-            if (function->getArguments().size() != assign->getFunctionArgs().size()) {
-                throw logic_error("Bad arguments count for the function named '" + function->getName() + "'.");
-            }
+    auto& slot = local[target.getSlot()];
+    if (target.getFieldPath().empty()) {
+        slot = value.isUndefined() ? TaggedValue::makeNull() : move(value);
+        return;
+    }
 
-            auto funcLocal = make_shared<ExecObject>();
-            for (int i = 0; i < function->getArguments().size(); i++) {
-                funcLocal->setField(function->getArguments()[i], execValue(assign->getFunctionArgs()[i], readGlobal, writeGlobal, local));
-            }
-            value = execFunction(function, readGlobal, writeGlobal, funcLocal);
-        }
-        else if (BUILT_IN_FUNCTIONS[assign->getFunctionName()].isDefined()) {
-            vector<shared_ptr<ExecValue> > args;
-            for (int i = 0; i < assign->getFunctionArgs().size(); i++) {
-                args.push_back(execValue(assign->getFunctionArgs()[i], readGlobal, writeGlobal, local));
-            }
-            value = BUILT_IN_FUNCTIONS[assign->getFunctionName()](BuiltInArguments(args));
-        }
-        else {
-            throw logic_error("Function with the name '" + assign->getFunctionName() + "' does not exist.");
+    if (slot.isNull()) slot = TaggedValue::makeObject(make_shared<ExecObject>());
+
+    if (!slot.isObject()) throw logic_error("Bad assignment -> non-object value exists in the path.");
+    slot.getMutableObject()->setValueByPath(target.getFieldPath(), move(value));
+}
+
+void ProgramExecutor::setLockedVariables(shared_ptr<const VariablesTrie> variables, shared_ptr<ExecObject> global) {
+    lockedVariables = move(variables);
+    lockedGlobal = move(global);
+}
+
+TaggedValue ProgramExecutor::copyAncestors(const TaggedValue& value, int node) const {
+    if (!value.isObject() || !lockedVariables->isAncestor(node)) return value;
+
+    auto res = static_pointer_cast<ExecObject>(value.getObject()->clone());
+    for (auto& child : lockedVariables->getChildren(node)) {
+        auto field = res->getValue(child.first);
+        if (field.isObject() && lockedVariables->isAncestor(child.second)) {
+            res->setValue(child.first, copyAncestors(field, child.second));
         }
+    }
+    return TaggedValue::makeObject(res);
+}
 
-        if (assign->getTarget()->isGlobal()) writeGlobal->setFieldByPath(assign->getTarget()->getName(), value);
-        else local->setFieldByPath(assign->getTarget()->getName(), value);
+TaggedValue ProgramExecutor::loadGlobal(const shared_ptr<ExecObject>& readGlobal, const FieldPath& path) {
+    onGlobalRead(path);
+
+    auto res = readGlobal->getValueByPath(path);
+    if (readGlobal != lockedGlobal) return res;
+
+    // ancestor of the variables is modified in place after its variables are unlocked
+    int node;
+    return lockedVariables->walkAncestors(path, node) == path.size() ? copyAncestors(res, node) : res;
+}
+
+void ProgramExecutor::storeGlobal(const shared_ptr<ExecObject>& writeGlobal, const FieldPath& path, TaggedValue value) {
+    onGlobalWrite(path);
+    if (writeGlobal != lockedGlobal) {
+        writeGlobal->setValueByPath(path, move(value));
+        return;
     }
 
-    return shared_ptr<ExecValue>();
+    // writers of the sibling variables update their own fields of the common ancestors (the fields were created
+    // with the variables), copying the shared ancestor would lose the writes of the others
+    int node;
+    size_t ancestors = lockedVariables->walkAncestors(path, node);
+    if (ancestors == path.size()) value = copyAncestors(value, node);
+    writeGlobal->setValueByPath(path, move(value), ancestors);
 }
 
-shared_ptr<ExecValue> ProgramExecutor::execValue(shared_ptr<Value> value,
-                                                 shared_ptr<ExecObject> readGlobal,
-                                                 shared_ptr<ExecObject> writeGlobal,
-                                                 shared_ptr<ExecObject> local) {
+TaggedValue ProgramExecutor::execValue(const shared_ptr<Value>& value,
+                                       const shared_ptr<ExecObject>& readGlobal,
+                                       const shared_ptr<ExecObject>& writeGlobal,
+                                       LocalFrame& local) {
     if (dynamic_pointer_cast<IdentifierValue>(value)) {
-        auto identifier = dynamic_pointer_cast<IdentifierValue>(value);
+        auto& identifier = *static_pointer_cast<IdentifierValue>(value)->getIdentifier();
 
-        auto res = shared_ptr<ExecValue>();
-        if (identifier->getIdentifier()->isGlobal()) {
-            res = readGlobal->getFieldByPath(identifier->getIdentifier()->getName());
-        }
-        else {
-            res = local->getFieldByPath(identifier->getIdentifier()->getName());
-        }
+        // objects of the locals are shared, they are copied only when they are modified later
+        if (identifier.isGlobal()) return loadGlobal(readGlobal, identifier.getFieldPath());
 
-        // returning only if not null!
-        if (res) return res->clone();
+        auto& slot = local[identifier.getSlot()];
+        if (identifier.getFieldPath().empty()) return slot.isUndefined() ? TaggedValue::makeNull() : slot;
+
+        if (slot.isNull()) return TaggedValue::makeNull();
+        if (!slot.isObject()) throw logic_error("Bad return -> non-object value exists in the path.");
+        return slot.getObject()->getValueByPath(identifier.getFieldPath());
     }
     else if (dynamic_pointer_cast<BooleanValue>(value)) {
-        auto res = make_shared<ExecBoolean>();
-        res->setValue(dynamic_pointer_cast<BooleanValue>(value)->getValue());
-        return res;
+        return TaggedValue::makeBoolean(dynamic_pointer_cast<BooleanValue>(value)->getValue());
     }
     else if (dynamic_pointer_cast<IntegerValue>(value)) {
-        auto res = make_shared<ExecInteger>();
-        res->setValue(dynamic_pointer_cast<IntegerValue>(value)->getValue());
-        return res;
+        return TaggedValue::makeInteger(dynamic_pointer_cast<IntegerValue>(value)->getValue());
     }
     else if (dynamic_pointer_cast<FloatValue>(value)) {
-        auto res = make_shared<ExecFloat>();
-        res->setValue(dynamic_pointer_cast<FloatValue>(value)->getValue());
-        return res;
+        return TaggedValue::makeFloat(dynamic_pointer_cast<FloatValue>(value)->getValue());
     }
     else if (dynamic_pointer_cast<CharValue>(value)) {
-        auto res = make_shared<ExecChar>();
-        res->setValue(dynamic_pointer_cast<CharValue>(value)->getValue());
-        return res;
+        return TaggedValue::makeChar(dynamic_pointer_cast<CharValue>(value)->getValue());
     }
     else if (dynamic_pointer_cast<StringValue>(value)) {
-        auto res = make_shared<ExecString>();
-        res->setValue(dynamic_pointer_cast<StringValue>(value)->getValue());
-        return res;
+        return TaggedValue::makeString(dynamic_pointer_cast<StringValue>(value)->getValue());
     }
 
     // returning special null value!
-    return make_shared<ExecNull>();
+    return TaggedValue::makeNull();
 }
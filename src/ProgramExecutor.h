@@ -4,40 +4,280 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <vector>
 #include <locale>
 #include <codecvt>
 #include <functional>
 
 #include "Program.h"
+#include "Symbols.h"
+#include "FieldTable.h"
+#include "MessageArena.h"
+#include "VariablesTrie.h"
 
 // Objects
+class ExecObject;
+
 class ExecValue {
 public:
     virtual std::shared_ptr<ExecValue> clone() const = 0;
     virtual std::string toString() const = 0;
 };
 
+// UTF-8 conversion of the language strings and chars
+std::string toUTF8(const std::u32string&);
+std::string toUTF8(char32_t);
+std::u32string fromUTF8(const std::string&);
+
+// Value used by the executors - primitives are stored inline, only strings and objects are on the heap.
+// Undefined is the result of a function without return, it is stored as null.
+class TaggedValue {
+public:
+    enum Type : unsigned char { Undefined, Null, Boolean, Integer, Float, Char, String, Object };
+
+    TaggedValue() : type(Undefined), integer(0) { }
+
+    TaggedValue(const TaggedValue& other) : type(Undefined) {
+        assign(other);
+    }
+
+    TaggedValue(TaggedValue&& other) noexcept : type(Undefined) {
+        assign(std::move(other));
+    }
+
+    TaggedValue& operator=(const TaggedValue& other) {
+        if (this != &other) {
+            reset();
+            assign(other);
+        }
+        return *this;
+    }
+
+    TaggedValue& operator=(TaggedValue&& other) noexcept {
+        if (this != &other) {
+            reset();
+            assign(std::move(other));
+        }
+        return *this;
+    }
+
+    ~TaggedValue() {
+        reset();
+    }
+
+    static TaggedValue makeNull() {
+        TaggedValue res;
+        res.type = Null;
+        return res;
+    }
+
+    static TaggedValue makeBoolean(bool value) {
+        TaggedValue res;
+        res.type = Boolean;
+        res.boolean = value;
+        return res;
+    }
+
+    static TaggedValue makeInteger(long long value) {
+        TaggedValue res;
+        res.type = Integer;
+        res.integer = value;
+        return res;
+    }
+
+    static TaggedValue makeFloat(double value) {
+        TaggedValue res;
+        res.type = Float;
+        res.floating = value;
+        return res;
+    }
+
+    static TaggedValue makeChar(char32_t value) {
+        TaggedValue res;
+        res.type = Char;
+        res.character = value;
+        return res;
+    }
+
+    static TaggedValue makeString(const std::u32string&);
+    static TaggedValue makeObject(std::shared_ptr<ExecObject>);
+
+    // conversion from and to the heap allocated values
+    static TaggedValue unbox(const std::shared_ptr<ExecValue>&);
+    std::shared_ptr<ExecValue> box() const;
+
+    Type getType() const {
+        return type;
+    }
+
+    bool isUndefined() const {
+        return type == Undefined;
+    }
+
+    // undefined value is read as null
+    bool isNull() const {
+        return type == Null || type == Undefined;
+    }
+
+    bool isBoolean() const {
+        return type == Boolean;
+    }
+
+    bool isInteger() const {
+        return type == Integer;
+    }
+
+    bool isFloat() const {
+        return type == Float;
+    }
+
+    bool isChar() const {
+        return type == Char;
+    }
+
+    bool isString() const {
+        return type == String;
+    }
+
+    bool isObject() const {
+        return type == Object;
+    }
+
+    bool getBoolean() const {
+        return boolean;
+    }
+
+    long long getInteger() const {
+        return integer;
+    }
+
+    double getFloat() const {
+        return floating;
+    }
+
+    char32_t getChar() const {
+        return character;
+    }
+
+    const std::u32string& getString() const;
+
+    ExecObject* getObject() const {
+        return type == Object ? (ExecObject*)heap.get() : nullptr;
+    }
+
+    std::shared_ptr<ExecObject> getObjectPtr() const;
+
+    // object prepared for modification - object shared with other values is replaced by its own copy first
+    ExecObject* getMutableObject();
+
+    // copy not sharing any object with this value, strings are immutable so they are still shared
+    TaggedValue copy() const;
+    std::string toString() const;
+
+private:
+    bool isHeap() const {
+        return type == String || type == Object;
+    }
+
+    void reset() {
+        if (isHeap()) heap.~shared_ptr<ExecValue>();
+        type = Undefined;
+    }
+
+    void assign(const TaggedValue& other) {
+        if (other.isHeap()) new (&heap) std::shared_ptr<ExecValue>(other.heap);
+        else integer = other.integer;
+        type = other.type;
+    }
+
+    void assign(TaggedValue&& other) {
+        if (other.isHeap()) new (&heap) std::shared_ptr<ExecValue>(std::move(other.heap));
+        else integer = other.integer;
+        type = other.type;
+        other.reset();
+    }
+
+    Type type;
+    union {
+        bool boolean;
+        long long integer;
+        double floating;
+        char32_t character;
+        std::shared_ptr<ExecValue> heap;
+    };
+};
+
+// Objects are copy-on-write - reading a field shares the stored object, copying is postponed until the shared
+// object is modified through some path (only the objects along the path are copied, the rest stays shared).
+// Object which is not shared can be modified only by the thread owning the value it is stored in. The ancestors of
+// the locked global variables are the exception - they are never shared and they are modified in place by the
+// writers of their nested variables (see ProgramExecutor::storeGlobal).
 class ExecObject : public ExecValue {
 public:
     void ensureFieldPath(const std::string&, bool);
+    void ensureFieldPaths(const std::vector<std::string>&, bool);
+
+    TaggedValue getValueByPath(const std::string&) const;
+    void setValueByPath(const std::string&, TaggedValue);
 
+    // access by the interned fields of the non-empty path, used by the executors - the objects at the first inPlace
+    // prefixes of the path are modified in place even when they are shared
+    TaggedValue getValueByPath(const FieldPath&) const;
+    void setValueByPath(const FieldPath&, TaggedValue, size_t inPlace = 0);
+
+    // boxed access for the runtimes, null fields are returned as empty pointers
     std::shared_ptr<ExecValue> getFieldByPath(const std::string&) const;
     void setFieldByPath(const std::string&, std::shared_ptr<ExecValue>);
 
+    // new version of the object with the value at the path, objects outside of the path are shared
+    std::shared_ptr<ExecObject> withFieldByPath(const std::string&, TaggedValue) const;
+
+    // copy of this object only, its fields are shared
     std::shared_ptr<ExecValue> clone() const override;
+    std::shared_ptr<ExecObject> deepClone() const;
     std::string toString() const override;
 
-    std::shared_ptr<ExecValue> getField(const std::string& name) {
-        return fields[name];
+    // copies of objects made since the start, bytes are estimated from the copied fields
+    static long long getClonesCount();
+    static long long getCopiedBytes();
+
+    TaggedValue getValue(int id) const {
+        auto field = fields.find(id);
+        return field ? *field : TaggedValue::makeNull();
+    }
+
+    void setValue(int id, TaggedValue val) {
+        fields[id] = std::move(val);
+    }
+
+    TaggedValue getValue(const std::string& name) const {
+        return getValue(Symbols::intern(name));
+    }
+
+    void setValue(const std::string& name, TaggedValue val) {
+        setValue(Symbols::intern(name), std::move(val));
+    }
+
+    std::shared_ptr<ExecValue> getField(const std::string& name) const {
+        auto val = getValue(name);
+        return val.isNull() ? std::shared_ptr<ExecValue>() : val.box();
     }
 
     void setField(const std::string& name, std::shared_ptr<ExecValue> val) {
-        fields[name] = val;
+        setValue(name, TaggedValue::unbox(val));
+    }
+
+    const FieldTable<TaggedValue>& getFields() const {
+        return fields;
     }
 
 private:
-    std::vector<std::string> stickyFieldPaths;
-    mutable std::map<std::string, std::shared_ptr<ExecValue> > fields;
+    void ensureFieldPath(const FieldPath&, size_t);
+    std::shared_ptr<ExecObject> withFieldByPath(const FieldPath&, size_t, TaggedValue) const;
+
+    // shared by the copies, the paths are set up only once for the global state
+    std::shared_ptr<const std::vector<FieldPath> > stickyFieldPaths;
+    FieldTable<TaggedValue> fields;
 };
 
 class ExecPrimitive : public ExecValue {
@@ -130,11 +370,8 @@ public:
     }
 
     std::string toString() const override {
-        return "'" + utfConverter.to_bytes(getValue()) + "'";
+        return "'" + toUTF8(getValue()) + "'";
     }
-
-private:
-    mutable std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> utfConverter;
 };
 
 class ExecString : public ExecPrimitiveTemplate<std::u32string> {
@@ -143,7 +380,7 @@ public:
     explicit ExecString(const std::u32string& val) : ExecPrimitiveTemplate(val) { };
 
     void setValueUTF8(const std::string& value) {
-        setValue(utfConverter.from_bytes(value));
+        setValue(fromUTF8(value));
     }
 
     std::shared_ptr<ExecValue> clone() const override {
@@ -153,40 +390,139 @@ public:
     }
 
     std::string toString() const override {
-        return "\"" + utfConverter.to_bytes(getValue()) + "\"";
+        return "\"" + toUTF8(getValue()) + "\"";
     }
-
-private:
-    mutable std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> utfConverter;
 };
 
+inline const std::u32string& TaggedValue::getString() const {
+    return static_cast<const ExecString*>(heap.get())->getValue();
+}
+
 // Executor
+class BytecodeVM;
+class BuiltInFunction;
+class MemoCache;
+
 class ProgramExecutor {
 public:
+    // statements are interpreted directly from the program tree or executed by the bytecode VM
+    enum Engine { Interpreter, Bytecode };
+
     explicit ProgramExecutor(std::shared_ptr<Program>);
 
+    void setEngine(Engine);
+
+    Engine getEngine() const {
+        return engine;
+    }
+
+    std::shared_ptr<BytecodeVM> getBytecodeVM() const {
+        return vm;
+    }
+
     std::shared_ptr<ExecValue> exec(std::shared_ptr<ExecValue>);
-    std::shared_ptr<ExecValue> execExpression(std::shared_ptr<Expression>, std::shared_ptr<ExecObject>);
+    std::shared_ptr<ExecValue> exec(std::shared_ptr<ExecValue>, std::shared_ptr<ExecObject>, std::shared_ptr<ExecObject>);
+    // values of the evaluated sub-expressions, shared ones are evaluated once per message
+    typedef std::unordered_map<const Expression*, TaggedValue> ExpressionValues;
+
+    TaggedValue execExpression(std::shared_ptr<Expression>, std::shared_ptr<ExecObject>);
+    TaggedValue execExpression(const std::shared_ptr<Expression>&, const std::shared_ptr<ExecObject>&, ExpressionValues&);
+    TaggedValue execCall(const Function&, const std::vector<TaggedValue>&);
+
+    // replaces the built-in function for this executor only, has to be called before any message is executed
+    void overrideBuiltInFunction(const BuiltInFunction&);
+
+    // caches results of the pure functions (by both engines and the access predicates), zero capacity turns it off -
+    // has to be called before any message is executed
+    void setMemoCapacity(size_t);
+
+    std::shared_ptr<MemoCache> getMemoCache() const {
+        return memoCache;
+    }
 
     std::shared_ptr<Program> getProgram() {
         return program;
     }
 
 protected:
+    // resolves the called functions of the analyzed program, unknown functions and bad arguments counts are errors
+    void link();
+
     virtual std::shared_ptr<ExecObject> getReadGlobal() const = 0;
     virtual std::shared_ptr<ExecObject> getWriteGlobal() const = 0;
 
+    // called for every global path the program reads or writes, paths are owned by the program
+    virtual void onGlobalRead(const FieldPath&) { }
+    virtual void onGlobalWrite(const FieldPath&) { }
+
+    // global state whose variables are locked - ancestors of the variables are modified in place under the intention
+    // locks, so they are never shared. Objects of the variables are copy-on-write as any other objects
+    void setLockedVariables(std::shared_ptr<const VariablesTrie>, std::shared_ptr<ExecObject>);
+
+    // copy of the value at the trie node, only the objects of the ancestors are copied
+    TaggedValue copyAncestors(const TaggedValue&, int) const;
+
+    // loads share the values of the variables, stores copy only the ancestors in the stored value
+    TaggedValue loadGlobal(const std::shared_ptr<ExecObject>&, const FieldPath&);
+    void storeGlobal(const std::shared_ptr<ExecObject>&, const FieldPath&, TaggedValue);
+
 private:
-    std::shared_ptr<ExecValue> execFunction(std::shared_ptr<Function>,
-            std::shared_ptr<ExecObject>, std::shared_ptr<ExecObject>, std::shared_ptr<ExecObject>);
+    // local variables of the called function, indexed by the slots resolved by the analyzer
+    typedef ArenaVector<TaggedValue> LocalFrame;
+
+    void linkStatement(const std::shared_ptr<Statement>&);
+    const Function& selectMain(const TaggedValue&) const;
+    void linkExpression(const std::shared_ptr<Expression>&, std::set<const Expression*>&);
+    const BuiltInFunction* findBuiltIn(const std::string&) const;
+
+    // function being executed on the interpreter stack
+    struct CallFrame {
+        const Function* function;
+        LocalFrame local;
+        size_t blocksBase;
+
+        // call statement of the caller waiting for the result
+        const CallAssignment* call;
+        bool tailCalled;
+
+        // called function whose result is cached, its arguments are on the top of the memo arguments stack
+        const Function* memoized;
+    };
 
-    std::shared_ptr<ExecValue> execStatement(std::shared_ptr<Statement>,
-            std::shared_ptr<ExecObject>, std::shared_ptr<ExecObject>, std::shared_ptr<ExecObject>);
+    // statements of the function or of the entered condition branch
+    struct Block {
+        const std::vector<std::shared_ptr<Statement> >* statements;
+        size_t next;
+    };
 
-    std::shared_ptr<ExecValue> execValue(std::shared_ptr<Value>,
-            std::shared_ptr<ExecObject>, std::shared_ptr<ExecObject>, std::shared_ptr<ExecObject>);
+    TaggedValue evalExpression(const std::shared_ptr<Expression>&, const std::shared_ptr<ExecObject>&, ExpressionValues&);
+
+    TaggedValue execFunction(const Function&,
+            const std::shared_ptr<ExecObject>&, const std::shared_ptr<ExecObject>&, LocalFrame);
+
+    void execAssignment(const Assignment&,
+            const std::shared_ptr<ExecObject>&, const std::shared_ptr<ExecObject>&, LocalFrame&);
+    void execStore(const Identifier&, TaggedValue, const std::shared_ptr<ExecObject>&, LocalFrame&);
+
+    TaggedValue execValue(const std::shared_ptr<Value>&,
+            const std::shared_ptr<ExecObject>&, const std::shared_ptr<ExecObject>&, LocalFrame&);
 
     std::shared_ptr<Program> program;
+    Function* mainFunction;
+
+    // specialized variants of the main for the cases of its dispatch on the message
+    const Dispatch* mainDispatch;
+    std::vector<const Function*> mainVariants;
+    std::map<std::string, std::shared_ptr<BuiltInFunction> > builtInOverrides;
+
+    Engine engine;
+    std::shared_ptr<BytecodeVM> vm;
+    std::shared_ptr<MemoCache> memoCache;
+
+    std::shared_ptr<const VariablesTrie> lockedVariables;
+    std::shared_ptr<ExecObject> lockedGlobal;
+
+    friend class BytecodeVM;
 };
 
 #endif
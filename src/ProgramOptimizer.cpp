@@ -0,0 +1,718 @@
+#include <climits>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "MemoCache.h"
+#include "BuiltInFunction.h"
+#include "ProgramOptimizer.h"
+
+using namespace std;
+
+typedef vector<shared_ptr<Statement> > Statements;
+
+// Helpers
+static string getRootName(const Identifier& identifier) {
+    auto& name = identifier.getName();
+    return name.substr(0, name.find('.'));
+}
+
+static bool isRootOnly(const Identifier& identifier) {
+    return identifier.getName().find('.') == string::npos;
+}
+
+// integer division by zero or overflow raises a signal and a char out of the string is undefined, such calls
+// are not executed before the program runs
+static bool isFoldable(const string& name, const vector<TaggedValue>& args) {
+    if ((name == "_div" || name == "_mod") && args[0].isInteger() && args[1].isInteger()) {
+        return args[1].getInteger() != 0 && !(args[0].getInteger() == LLONG_MIN && args[1].getInteger() == -1);
+    }
+    if (name == "_ch" && args[0].isString() && args[1].isInteger()) {
+        return args[1].getInteger() >= 0 && args[1].getInteger() < (long long)args[0].getString().length();
+    }
+    return true;
+}
+
+static shared_ptr<Identifier> createIdentifier(const string& fullName) {
+    auto identifier = make_shared<Identifier>();
+    identifier->setFullName(fullName);
+    return identifier;
+}
+
+static shared_ptr<IdentifierValue> createIdentifierValue(shared_ptr<Identifier> identifier) {
+    auto value = make_shared<IdentifierValue>();
+    value->setIdentifier(move(identifier));
+    return value;
+}
+
+template<class T, class V> static shared_ptr<ConstantValue> createConstant(const V& value) {
+    auto res = make_shared<T>();
+    res->setValue(value);
+    return res;
+}
+
+static TaggedValue toTaggedValue(const shared_ptr<ConstantValue>& value) {
+    if (dynamic_pointer_cast<BooleanValue>(value)) return TaggedValue::makeBoolean(dynamic_pointer_cast<BooleanValue>(value)->getValue());
+    if (dynamic_pointer_cast<IntegerValue>(value)) return TaggedValue::makeInteger(dynamic_pointer_cast<IntegerValue>(value)->getValue());
+    if (dynamic_pointer_cast<FloatValue>(value)) return TaggedValue::makeFloat(dynamic_pointer_cast<FloatValue>(value)->getValue());
+    if (dynamic_pointer_cast<CharValue>(value)) return TaggedValue::makeChar(dynamic_pointer_cast<CharValue>(value)->getValue());
+    if (dynamic_pointer_cast<StringValue>(value)) return TaggedValue::makeString(dynamic_pointer_cast<StringValue>(value)->getValue());
+    return TaggedValue::makeNull();
+}
+
+// objects have no constant form, null is returned for them
+static shared_ptr<ConstantValue> fromTaggedValue(const TaggedValue& value) {
+    switch (value.getType()) {
+        case TaggedValue::Boolean: return createConstant<BooleanValue>(value.getBoolean());
+        case TaggedValue::Integer: return createConstant<IntegerValue>(value.getInteger());
+        case TaggedValue::Float: return createConstant<FloatValue>(value.getFloat());
+        case TaggedValue::Char: return createConstant<CharValue>(value.getChar());
+        case TaggedValue::String: return createConstant<StringValue>(value.getString());
+        case TaggedValue::Object: return shared_ptr<ConstantValue>();
+        default: return make_shared<NullValue>();
+    }
+}
+
+static shared_ptr<Assignment> createAssignment(shared_ptr<Identifier> target, const shared_ptr<Value>& value) {
+    if (dynamic_pointer_cast<ConstantValue>(value)) {
+        auto assignment = make_shared<ConstantAssignment>();
+        assignment->setTarget(move(target));
+        assignment->setValue(dynamic_pointer_cast<ConstantValue>(value));
+        return assignment;
+    }
+
+    auto assignment = make_shared<IdentifierAssignment>();
+    assignment->setTarget(move(target));
+    assignment->setValue(dynamic_pointer_cast<IdentifierValue>(value));
+    return assignment;
+}
+
+static shared_ptr<CallAssignment> createCall(const CallAssignment& call, shared_ptr<Identifier> target,
+                                             const vector<shared_ptr<Value> >& args) {
+    auto res = make_shared<CallAssignment>();
+    res->setTarget(move(target));
+    res->setFunctionName(call.getFunctionName());
+    res->setTailCall(call.isTailCall());
+    for (auto& arg : args) res->addFunctionArg(arg);
+    return res;
+}
+
+static int countStatements(const Statements& statements) {
+    int res = 0;
+    for (auto& statement : statements) {
+        res += 1;
+
+        auto cond = dynamic_pointer_cast<Condition>(statement);
+        if (cond) res += countStatements(cond->getThenStatements()) + countStatements(cond->getElseStatements());
+
+        auto dispatch = dynamic_pointer_cast<Dispatch>(statement);
+        if (dispatch) {
+            for (int i = 0; i < dispatch->getCasesCount(); i++) res += countStatements(dispatch->getCaseStatements(i));
+        }
+    }
+    return res;
+}
+
+static bool isRootWritten(const Statements& statements, const string& root) {
+    for (auto& statement : statements) {
+        auto cond = dynamic_pointer_cast<Condition>(statement);
+        if (cond && (isRootWritten(cond->getThenStatements(), root) || isRootWritten(cond->getElseStatements(), root))) return true;
+
+        auto dispatch = dynamic_pointer_cast<Dispatch>(statement);
+        if (dispatch) {
+            for (int i = 0; i < dispatch->getCasesCount(); i++) {
+                if (isRootWritten(dispatch->getCaseStatements(i), root)) return true;
+            }
+        }
+
+        auto assign = dynamic_pointer_cast<Assignment>(statement);
+        if (assign && !assign->getTarget()->isGlobal() && getRootName(*assign->getTarget()) == root) return true;
+    }
+    return false;
+}
+
+static int countReturns(const Statements& statements) {
+    int res = 0;
+    for (auto& statement : statements) {
+        if (dynamic_pointer_cast<Return>(statement)) res += 1;
+
+        auto cond = dynamic_pointer_cast<Condition>(statement);
+        if (cond) res += countReturns(cond->getThenStatements()) + countReturns(cond->getElseStatements());
+    }
+    return res;
+}
+
+// copy of the statement with the renamed identifiers, constants are shared
+typedef function<shared_ptr<Identifier>(const shared_ptr<Identifier>&)> Renamer;
+
+static shared_ptr<Value> renameValue(const shared_ptr<Value>& value, const Renamer& rename) {
+    auto identifierValue = dynamic_pointer_cast<IdentifierValue>(value);
+    return identifierValue ? createIdentifierValue(rename(identifierValue->getIdentifier())) : value;
+}
+
+static shared_ptr<Statement> renameStatement(const shared_ptr<Statement>& statement, const Renamer& rename) {
+    if (dynamic_pointer_cast<Condition>(statement)) {
+        auto cond = dynamic_pointer_cast<Condition>(statement);
+
+        auto res = make_shared<Condition>();
+        res->setConditionValue(createIdentifierValue(rename(cond->getConditionValue()->getIdentifier())));
+        for (auto& condStatement : cond->getThenStatements()) res->addThenStatement(renameStatement(condStatement, rename));
+        for (auto& condStatement : cond->getElseStatements()) res->addElseStatement(renameStatement(condStatement, rename));
+        return res;
+    }
+    else if (dynamic_pointer_cast<Dispatch>(statement)) {
+        auto dispatch = dynamic_pointer_cast<Dispatch>(statement);
+
+        auto res = make_shared<Dispatch>();
+        res->setValue(createIdentifierValue(rename(dispatch->getValue()->getIdentifier())));
+        for (int i = 0; i < dispatch->getCasesCount(); i++) {
+            Statements caseStatements;
+            for (auto& caseStatement : dispatch->getCaseStatements(i)) caseStatements.push_back(renameStatement(caseStatement, rename));
+            res->addCase(dispatch->getCaseLiteral(i), caseStatements);
+        }
+        return res;
+    }
+    else if (dynamic_pointer_cast<CallAssignment>(statement)) {
+        auto call = dynamic_pointer_cast<CallAssignment>(statement);
+
+        vector<shared_ptr<Value> > args;
+        for (auto& arg : call->getFunctionArgs()) args.push_back(renameValue(arg, rename));
+        return createCall(*call, rename(call->getTarget()), args);
+    }
+    else if (dynamic_pointer_cast<ConstantAssignment>(statement)) {
+        auto assign = dynamic_pointer_cast<ConstantAssignment>(statement);
+        return createAssignment(rename(assign->getTarget()), assign->getValue());
+    }
+    else if (dynamic_pointer_cast<IdentifierAssignment>(statement)) {
+        auto assign = dynamic_pointer_cast<IdentifierAssignment>(statement);
+        return createAssignment(rename(assign->getTarget()), renameValue(assign->getValue(), rename));
+    }
+
+    auto res = make_shared<Return>();
+    res->setValue(renameValue(dynamic_pointer_cast<Return>(statement)->getValue(), rename));
+    return res;
+}
+
+// Optimizer
+void ProgramOptimizer::optimize() {
+    int statementsBefore = 0, statementsAfter = 0;
+
+    for (auto& function : program->getFunctions()) {
+        auto statements = function->getStatements();
+        statementsBefore += countStatements(statements);
+
+        // every round works on the result of the previous one, e.g. inlined arguments are propagated and then removed
+        for (int round = 0; round < MAX_ROUNDS; round++) {
+            bool changed = inlineCalls(*function, statements);
+
+            // nothing is known about the arguments
+            KnownValues known;
+            bool terminated;
+            if (propagateStatements(statements, known, terminated)) changed = true;
+
+            set<string> readVariables;
+            collectReadVariables(statements, readVariables);
+            if (removeDeadStores(statements, readVariables)) changed = true;
+
+            if (!changed) break;
+        }
+
+        function->setStatements(statements);
+    }
+
+    // chains are replaced at last, the other passes and the inlining work with the conditions only
+    for (auto& function : program->getFunctions()) {
+        auto statements = function->getStatements();
+        if (buildDispatches(statements)) function->setStatements(statements);
+
+        statementsAfter += countStatements(statements);
+    }
+
+    // variants are added after the counting, they are copies of the main for the executors
+    specializeMain();
+
+    // printing optimization
+    cout << "======= Code optimization =====" << endl;
+    cout << "  - inlined calls: " << inlinedCalls << endl;
+    cout << "  - folded calls: " << foldedCalls << endl;
+    cout << "  - propagated values: " << propagatedValues << endl;
+    cout << "  - pruned branches: " << prunedBranches << endl;
+    cout << "  - removed statements: " << removedStatements << endl;
+    cout << "  - dispatch tables: " << dispatchTables << " (" << dispatchCases << " cases)" << endl;
+    cout << "  - specialized variants of main: " << specializedVariants << endl;
+    cout << "  - statements: " << statementsBefore << " -> " << statementsAfter << endl;
+    cout << "===============================" << endl << endl;
+}
+
+bool ProgramOptimizer::inlineCalls(const Function& caller, Statements& statements) {
+    bool changed = false;
+
+    Statements res;
+    for (auto& statement : statements) {
+        if (dynamic_pointer_cast<Condition>(statement)) {
+            auto cond = dynamic_pointer_cast<Condition>(statement);
+
+            auto thenStatements = cond->getThenStatements();
+            auto elseStatements = cond->getElseStatements();
+            if (inlineCalls(caller, thenStatements)) changed = true;
+            if (inlineCalls(caller, elseStatements)) changed = true;
+
+            cond->setThenStatements(thenStatements);
+            cond->setElseStatements(elseStatements);
+            res.push_back(statement);
+            continue;
+        }
+
+        auto call = dynamic_pointer_cast<CallAssignment>(statement);
+        auto callee = call ? program->getFunction(call->getFunctionName()) : shared_ptr<Function>();
+        if (callee && isInlineable(*callee, caller, *call)) {
+            // locals of every inlined call get their own names
+            inlinedCalls += 1;
+            auto body = inlineCall(*call, *callee, callee->getName() + "$" + to_string(inlinedCalls) + "$");
+            res.insert(res.end(), body.begin(), body.end());
+
+            changed = true;
+            continue;
+        }
+
+        res.push_back(statement);
+    }
+
+    statements = res;
+    return changed;
+}
+
+bool ProgramOptimizer::isInlineable(const Function& callee, const Function& caller, const CallAssignment& call) const {
+    if (&callee == &caller || callee.isRecursive()) return false;
+
+    // bad arguments count is reported by the link step
+    if (callee.getArguments().size() != call.getFunctionArgs().size()) return false;
+    if (countStatements(callee.getStatements()) > INLINE_STATEMENTS) return false;
+
+    // the only return has to be the last statement, so the body is spliced into the caller without any jumps
+    int returns = countReturns(callee.getStatements());
+    return returns == 0 || (returns == 1 && dynamic_pointer_cast<Return>(callee.getStatements().back()));
+}
+
+Statements ProgramOptimizer::inlineCall(const CallAssignment& call, const Function& callee, const string& prefix) {
+    auto rename = [&](const shared_ptr<Identifier>& identifier) {
+        return createIdentifier(identifier->isGlobal() ? identifier->getFullName() : LOCAL_PREFIX + prefix + identifier->getName());
+    };
+
+    // arguments are assigned to the renamed locals, the propagation then replaces them by the passed values
+    Statements res;
+    for (size_t i = 0; i < callee.getArguments().size(); i++) {
+        res.push_back(createAssignment(createIdentifier(LOCAL_PREFIX + prefix + callee.getArguments()[i]), call.getFunctionArgs()[i]));
+    }
+
+    auto& body = callee.getStatements();
+    auto ret = body.empty() ? shared_ptr<Return>() : dynamic_pointer_cast<Return>(body.back());
+    for (size_t i = 0; i < body.size() - (ret ? 1 : 0); i++) res.push_back(renameStatement(body[i], rename));
+
+    // function without return gives null
+    auto result = ret ? renameValue(ret->getValue(), rename) : static_pointer_cast<Value>(make_shared<NullValue>());
+    res.push_back(createAssignment(call.getTarget(), result));
+
+    return res;
+}
+
+bool ProgramOptimizer::propagateStatements(Statements& statements, KnownValues& known, bool& terminated) {
+    bool changed = false;
+    terminated = false;
+
+    Statements res;
+    for (auto& statement : statements) {
+        // statements after the return are never executed
+        if (terminated) {
+            removedStatements += 1;
+            changed = true;
+            continue;
+        }
+
+        if (dynamic_pointer_cast<Condition>(statement)) {
+            auto cond = dynamic_pointer_cast<Condition>(statement);
+            auto condValue = propagateValue(cond->getConditionValue(), known);
+
+            // constant condition - the taken branch replaces the condition, variables are not scoped by the branches
+            if (dynamic_pointer_cast<BooleanValue>(condValue)) {
+                auto branch = dynamic_pointer_cast<BooleanValue>(condValue)->getValue() ? cond->getThenStatements() : cond->getElseStatements();
+                propagateStatements(branch, known, terminated);
+                res.insert(res.end(), branch.begin(), branch.end());
+
+                prunedBranches += 1;
+                changed = true;
+                continue;
+            }
+
+            // other constants fail when the condition is executed
+            if (dynamic_pointer_cast<IdentifierValue>(condValue) && condValue != cond->getConditionValue()) {
+                cond->setConditionValue(dynamic_pointer_cast<IdentifierValue>(condValue));
+                changed = true;
+            }
+
+            auto thenStatements = cond->getThenStatements();
+            auto elseStatements = cond->getElseStatements();
+            KnownValues thenKnown(known), elseKnown(known);
+            bool thenTerminated, elseTerminated;
+            if (propagateStatements(thenStatements, thenKnown, thenTerminated)) changed = true;
+            if (propagateStatements(elseStatements, elseKnown, elseTerminated)) changed = true;
+
+            cond->setThenStatements(thenStatements);
+            cond->setElseStatements(elseStatements);
+            res.push_back(statement);
+
+            // values known after the condition are those of the branches which continue
+            terminated = thenTerminated && elseTerminated;
+            if (thenTerminated) known = elseKnown;
+            else if (elseTerminated) known = thenKnown;
+            else {
+                known.clear();
+                for (auto& thenValue : thenKnown) {
+                    auto elseValue = elseKnown.find(thenValue.first);
+                    if (elseValue == elseKnown.end()) continue;
+
+                    auto& left = thenValue.second;
+                    auto& right = elseValue->second;
+                    if (left.constant && right.constant && isStructureEqual(toTaggedValue(left.constant), toTaggedValue(right.constant))) {
+                        known.emplace(thenValue.first, left);
+                    }
+                    else if (left.copy && right.copy && left.copy->getFullName() == right.copy->getFullName()) {
+                        known.emplace(thenValue.first, left);
+                    }
+                }
+            }
+            continue;
+        }
+
+        if (dynamic_pointer_cast<Return>(statement)) {
+            auto ret = dynamic_pointer_cast<Return>(statement);
+            auto value = propagateValue(ret->getValue(), known);
+            if (value != ret->getValue()) {
+                ret = make_shared<Return>();
+                ret->setValue(value);
+                changed = true;
+            }
+
+            res.push_back(ret);
+            terminated = true;
+            continue;
+        }
+
+        auto assign = dynamic_pointer_cast<Assignment>(statement);
+        auto target = assign->getTarget();
+
+        shared_ptr<Value> value;
+        if (dynamic_pointer_cast<CallAssignment>(assign)) {
+            auto call = dynamic_pointer_cast<CallAssignment>(assign);
+
+            bool argsChanged = false;
+            vector<shared_ptr<Value> > args;
+            for (auto& arg : call->getFunctionArgs()) {
+                args.push_back(propagateValue(arg, known));
+                if (args.back() != arg) argsChanged = true;
+            }
+            if (argsChanged) {
+                call = createCall(*call, target, args);
+                changed = true;
+            }
+
+            value = foldCall(*call);
+            if (value) {
+                foldedCalls += 1;
+                assign = createAssignment(target, value);
+                changed = true;
+            }
+            else assign = call;
+        }
+        else if (dynamic_pointer_cast<ConstantAssignment>(assign)) {
+            value = dynamic_pointer_cast<ConstantAssignment>(assign)->getValue();
+        }
+        else {
+            auto identifierValue = dynamic_pointer_cast<IdentifierAssignment>(assign)->getValue();
+            value = propagateValue(identifierValue, known);
+            if (value != identifierValue) {
+                assign = createAssignment(target, value);
+                changed = true;
+            }
+        }
+        res.push_back(assign);
+
+        // assigned variable changes, so do its copies
+        forgetValues(*target, known);
+        if (target->isGlobal() || !isRootOnly(*target) || !value) continue;
+
+        if (dynamic_pointer_cast<ConstantValue>(value)) {
+            known[target->getName()] = { dynamic_pointer_cast<ConstantValue>(value), shared_ptr<Identifier>() };
+        }
+        else {
+            auto& source = dynamic_pointer_cast<IdentifierValue>(value)->getIdentifier();
+            if (!source->isGlobal() && getRootName(*source) != target->getName()) {
+                known[target->getName()] = { shared_ptr<ConstantValue>(), source };
+            }
+        }
+    }
+
+    statements = res;
+    return changed;
+}
+
+shared_ptr<Value> ProgramOptimizer::propagateValue(const shared_ptr<Value>& value, const KnownValues& known) {
+    auto identifierValue = dynamic_pointer_cast<IdentifierValue>(value);
+    if (!identifierValue || identifierValue->getIdentifier()->isGlobal()) return value;
+
+    auto& identifier = *identifierValue->getIdentifier();
+    auto knownIt = known.find(getRootName(identifier));
+    if (knownIt == known.end()) return value;
+
+    // path of the constant is not resolved, reading through non-object value fails when it is executed
+    auto& knownValue = knownIt->second;
+    if (knownValue.constant) {
+        if (!isRootOnly(identifier)) return value;
+
+        propagatedValues += 1;
+        return knownValue.constant;
+    }
+
+    auto& name = identifier.getName();
+    propagatedValues += 1;
+    return createIdentifierValue(createIdentifier(knownValue.copy->getFullName() + name.substr(knownIt->first.length())));
+}
+
+shared_ptr<ConstantValue> ProgramOptimizer::foldCall(const CallAssignment& call) const {
+    // program functions hide the built-in ones
+    if (program->getFunction(call.getFunctionName())) return shared_ptr<ConstantValue>();
+
+    auto builtInFunction = findBuiltInFunction(call.getFunctionName());
+    if (!builtInFunction || !builtInFunction->isPure() || builtInFunction->getArgsCount() != (int)call.getFunctionArgs().size()) {
+        return shared_ptr<ConstantValue>();
+    }
+
+    vector<TaggedValue> args;
+    for (auto& arg : call.getFunctionArgs()) {
+        if (!dynamic_pointer_cast<ConstantValue>(arg)) return shared_ptr<ConstantValue>();
+        args.push_back(toTaggedValue(dynamic_pointer_cast<ConstantValue>(arg)));
+    }
+
+    // failing call is kept, so the error is reported when it is executed
+    if (!isFoldable(call.getFunctionName(), args)) return shared_ptr<ConstantValue>();
+    try {
+        return fromTaggedValue((*builtInFunction)(BuiltInArguments(args.data(), args.size())));
+    }
+    catch (const exception&) {
+        return shared_ptr<ConstantValue>();
+    }
+}
+
+void ProgramOptimizer::forgetValues(const Identifier& target, KnownValues& known) const {
+    if (target.isGlobal()) return;
+
+    auto root = getRootName(target);
+    known.erase(root);
+    for (auto knownIt = known.begin(); knownIt != known.end();) {
+        if (knownIt->second.copy && getRootName(*knownIt->second.copy) == root) knownIt = known.erase(knownIt);
+        else ++knownIt;
+    }
+}
+
+bool ProgramOptimizer::removeDeadStores(Statements& statements, const set<string>& readVariables) {
+    bool changed = false;
+
+    Statements res;
+    for (auto& statement : statements) {
+        if (dynamic_pointer_cast<Condition>(statement)) {
+            auto cond = dynamic_pointer_cast<Condition>(statement);
+
+            auto thenStatements = cond->getThenStatements();
+            auto elseStatements = cond->getElseStatements();
+            if (removeDeadStores(thenStatements, readVariables)) changed = true;
+            if (removeDeadStores(elseStatements, readVariables)) changed = true;
+
+            cond->setThenStatements(thenStatements);
+            cond->setElseStatements(elseStatements);
+            res.push_back(statement);
+            continue;
+        }
+
+        // calls and reads of the global variables are kept, only plain copies are removed
+        auto assign = dynamic_pointer_cast<Assignment>(statement);
+        bool isCopy = dynamic_pointer_cast<ConstantAssignment>(statement) ||
+                      (dynamic_pointer_cast<IdentifierAssignment>(statement) &&
+                       !dynamic_pointer_cast<IdentifierAssignment>(statement)->getValue()->getIdentifier()->isGlobal());
+
+        if (isCopy && !assign->getTarget()->isGlobal() && !readVariables.count(getRootName(*assign->getTarget()))) {
+            removedStatements += 1;
+            changed = true;
+            continue;
+        }
+
+        res.push_back(statement);
+    }
+
+    statements = res;
+    return changed;
+}
+
+void ProgramOptimizer::collectReadVariables(const Statements& statements, set<string>& readVariables) const {
+    auto collectValue = [&](const shared_ptr<Value>& value) {
+        auto identifierValue = dynamic_pointer_cast<IdentifierValue>(value);
+        if (identifierValue && !identifierValue->getIdentifier()->isGlobal()) {
+            readVariables.insert(getRootName(*identifierValue->getIdentifier()));
+        }
+    };
+
+    for (auto& statement : statements) {
+        if (dynamic_pointer_cast<Condition>(statement)) {
+            auto cond = dynamic_pointer_cast<Condition>(statement);
+            collectValue(cond->getConditionValue());
+            collectReadVariables(cond->getThenStatements(), readVariables);
+            collectReadVariables(cond->getElseStatements(), readVariables);
+        }
+        else if (dynamic_pointer_cast<Dispatch>(statement)) {
+            auto dispatch = dynamic_pointer_cast<Dispatch>(statement);
+            collectValue(dispatch->getValue());
+            for (int i = 0; i < dispatch->getCasesCount(); i++) collectReadVariables(dispatch->getCaseStatements(i), readVariables);
+        }
+        else if (dynamic_pointer_cast<Return>(statement)) {
+            collectValue(dynamic_pointer_cast<Return>(statement)->getValue());
+        }
+        else {
+            // assignment to a path modifies the object already stored in the variable
+            auto& target = dynamic_pointer_cast<Assignment>(statement)->getTarget();
+            if (!target->isGlobal() && !isRootOnly(*target)) readVariables.insert(getRootName(*target));
+
+            if (dynamic_pointer_cast<CallAssignment>(statement)) {
+                for (auto& arg : dynamic_pointer_cast<CallAssignment>(statement)->getFunctionArgs()) collectValue(arg);
+            }
+            else if (dynamic_pointer_cast<IdentifierAssignment>(statement)) {
+                collectValue(dynamic_pointer_cast<IdentifierAssignment>(statement)->getValue());
+            }
+        }
+    }
+}
+
+bool ProgramOptimizer::buildDispatches(Statements& statements) {
+    Statements res;
+    set<string> tests;
+    int tables = 0, cases = 0;
+
+    for (size_t i = 0; i < statements.size();) {
+        // pairs of the comparison into the condition variable and the condition without else
+        shared_ptr<Dispatch> dispatch;
+        string test;
+        size_t end = i;
+        for (; end + 1 < statements.size(); end += 2) {
+            auto call = dynamic_pointer_cast<CallAssignment>(statements[end]);
+            auto cond = dynamic_pointer_cast<Condition>(statements[end + 1]);
+
+            shared_ptr<IdentifierValue> value;
+            u32string literal;
+            if (!call || !cond || !matchCase(*call, value, literal)) break;
+
+            auto& target = *call->getTarget();
+            auto root = getRootName(*value->getIdentifier());
+            if (target.isGlobal() || !isRootOnly(target) || target.getName() == root) break;
+            if (cond->getConditionValue()->getIdentifier()->getFullName() != target.getFullName()) break;
+            if (!cond->getElseStatements().empty()) break;
+
+            // handlers cannot change the dispatched value, all the comparisons of the chain give the same result
+            if (isRootWritten(cond->getThenStatements(), root)) break;
+
+            if (!dispatch) {
+                dispatch = make_shared<Dispatch>();
+                dispatch->setValue(value);
+                test = target.getName();
+            }
+            else if (target.getName() != test || value->getIdentifier()->getFullName() != dispatch->getValue()->getIdentifier()->getFullName()) {
+                break;
+            }
+
+            dispatch->addCase(literal, cond->getThenStatements());
+        }
+
+        if (!dispatch || (int)(end - i) / 2 < MIN_DISPATCH_CASES) {
+            res.push_back(statements[i++]);
+            continue;
+        }
+
+        res.push_back(dispatch);
+        tests.insert(test);
+        tables += 1;
+        cases += dispatch->getCasesCount();
+        i = end;
+    }
+
+    // condition variables of the chains are not assigned anymore, so they cannot be read anywhere else
+    set<string> readVariables;
+    collectReadVariables(res, readVariables);
+    for (auto& test : tests) {
+        if (readVariables.count(test)) return false;
+    }
+    if (tests.empty()) return false;
+
+    dispatchTables += tables;
+    dispatchCases += cases;
+    statements = res;
+    return true;
+}
+
+bool ProgramOptimizer::matchCase(const CallAssignment& call, shared_ptr<IdentifierValue>& value, u32string& literal) const {
+    // program functions hide the built-in ones
+    if (call.getFunctionName() != "_eq" || call.getFunctionArgs().size() != 2 || program->getFunction("_eq")) return false;
+
+    // comparison is symmetric, the literal can be on both sides
+    for (int i = 0; i < 2; i++) {
+        auto identifierValue = dynamic_pointer_cast<IdentifierValue>(call.getFunctionArgs()[i]);
+        auto stringValue = dynamic_pointer_cast<StringValue>(call.getFunctionArgs()[1 - i]);
+        if (identifierValue && stringValue && !identifierValue->getIdentifier()->isGlobal()) {
+            value = identifierValue;
+            literal = stringValue->getValue();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ProgramOptimizer::specializeMain() {
+    auto mainFunction = program->getFunction("main");
+    if (!mainFunction) return;
+
+    // the first dispatch on the message passed to the main, statements before it cannot change the message
+    auto& statements = mainFunction->getStatements();
+    auto& arguments = mainFunction->getArguments();
+    size_t index = 0;
+    shared_ptr<Dispatch> dispatch;
+    for (; index < statements.size(); index++) {
+        dispatch = dynamic_pointer_cast<Dispatch>(statements[index]);
+        if (dispatch) break;
+    }
+    if (!dispatch) return;
+
+    auto root = getRootName(*dispatch->getValue()->getIdentifier());
+    if (find(arguments.begin(), arguments.end(), root) == arguments.end()) return;
+
+    Statements prefix(statements.begin(), statements.begin() + index);
+    if (isRootWritten(prefix, root)) return;
+
+    // every variant gets its own identifiers, the slots and the tail calls are resolved per function
+    auto copy = [](const shared_ptr<Identifier>& identifier) { return createIdentifier(identifier->getFullName()); };
+
+    vector<shared_ptr<Function> > variants;
+    for (int i = 0; i < dispatch->getCasesCount(); i++) {
+        auto variant = make_shared<Function>("main$" + toUTF8(dispatch->getCaseLiteral(i)));
+        for (auto& argument : arguments) variant->addArgument(argument);
+
+        for (size_t j = 0; j < statements.size(); j++) {
+            if (j != index) {
+                variant->addStatement(renameStatement(statements[j], copy));
+                continue;
+            }
+            for (auto& caseStatement : dispatch->getCaseStatements(i)) variant->addStatement(renameStatement(caseStatement, copy));
+        }
+
+        program->addFunction(variant);
+        variants.push_back(variant);
+    }
+
+    mainFunction->setVariants(dispatch, variants);
+    specializedVariants += (int)variants.size();
+}
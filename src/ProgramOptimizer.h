@@ -0,0 +1,71 @@
+#ifndef PROGRAM_OPTIMIZER_H
+#define PROGRAM_OPTIMIZER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "Program.h"
+
+// Rewrites the functions of the analyzed program before it is executed - small non-recursive functions are inlined
+// into their callers, constants and copies of the local variables are propagated, built-in functions with constant
+// arguments are folded, branches of constant conditions are pruned and stores nobody reads are removed.
+// At last, chains of the conditions comparing one local value with string literals (the message type handlers)
+// are replaced by the dispatches with hashed tables and the main is specialized into the variants for the cases of
+// its first dispatch on the message.
+// The program has to be analyzed again afterwards, the access expressions are built from the new statements.
+class ProgramOptimizer {
+public:
+    // biggest inlined function (statements of the branches are counted too)
+    static constexpr int INLINE_STATEMENTS = 8;
+    static constexpr int MAX_ROUNDS = 8;
+
+    // shortest chain of the conditions replaced by the dispatch
+    static constexpr int MIN_DISPATCH_CASES = 2;
+
+    explicit ProgramOptimizer(std::shared_ptr<Program> program) : program(std::move(program)) { };
+
+    void optimize();
+
+private:
+    typedef std::vector<std::shared_ptr<Statement> > Statements;
+
+    // known value of a local variable - constant or copy of another local variable
+    struct KnownValue {
+        std::shared_ptr<ConstantValue> constant;
+        std::shared_ptr<Identifier> copy;
+    };
+    typedef std::map<std::string, KnownValue> KnownValues;
+
+    bool inlineCalls(const Function&, Statements&);
+    bool isInlineable(const Function&, const Function&, const CallAssignment&) const;
+    Statements inlineCall(const CallAssignment&, const Function&, const std::string&);
+
+    bool propagateStatements(Statements&, KnownValues&, bool&);
+    std::shared_ptr<Value> propagateValue(const std::shared_ptr<Value>&, const KnownValues&);
+    std::shared_ptr<ConstantValue> foldCall(const CallAssignment&) const;
+    void forgetValues(const Identifier&, KnownValues&) const;
+
+    bool removeDeadStores(Statements&, const std::set<std::string>&);
+    void collectReadVariables(const Statements&, std::set<std::string>&) const;
+
+    bool buildDispatches(Statements&);
+    bool matchCase(const CallAssignment&, std::shared_ptr<IdentifierValue>&, std::u32string&) const;
+
+    void specializeMain();
+
+    std::shared_ptr<Program> program;
+
+    int inlinedCalls = 0;
+    int foldedCalls = 0;
+    int propagatedValues = 0;
+    int prunedBranches = 0;
+    int removedStatements = 0;
+    int dispatchTables = 0;
+    int dispatchCases = 0;
+    int specializedVariants = 0;
+};
+
+#endif
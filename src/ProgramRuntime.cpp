@@ -5,14 +5,8 @@
 
 using namespace std;
 
-bool hasPrefixInSet(const string& var, const set<string>& prefixes) {
-    for (auto& prefix : prefixes) {
-        if (var.find(prefix + ".") == 0 || var == prefix) {
-            return true;
-        }
-    }
-    return false;
-}
+// transaction of the optimistic execution running in the current thread
+static thread_local OptimisticTransaction* currentTransaction = NULL;
 
 // ResultWorker
 bool ResultWorker::process(ResultWorkerMessage& msg) {
@@ -45,17 +39,31 @@ MessageGenerator::MessageGenerator(const string &name, int interval,
 }
 
 // Runtime
-ProgramRuntime::ProgramRuntime(string filePath, Scheduler::Type type, int workers) :
-        SimpleProgramRuntime(move(filePath)),
+ProgramRuntime::ProgramRuntime(string filePath, Scheduler::Type type, int workers, bool optimized) :
+        SimpleProgramRuntime(move(filePath), optimized),
         Scheduler(type, workers, (int)getProgram()->getFunction("main")->getAllVariables().size()),
+        readonlyGlobal(make_shared<ExecObject>()),
         variables(getProgram()->getFunction("main")->getAllVariables()),
-        readonlyGlobal(make_shared<ExecObject>()) {
+        variablesList(variables.begin(), variables.end()),
+        versions(variables.size(), 0), commits(0), aborts(0), fallbacks(0), latenciesTracked(false) {
     resultWorker = make_shared<ResultWorker>(*this);
 
-    for (auto& var : variables) {
-        getReadGlobal()->ensureFieldPath(var, true);
-        getWriteGlobal()->ensureFieldPath(var, true);
-    }
+    // building variables trie - parent is the closest variable the path is nested in
+    variablesTrie = make_shared<VariablesTrie>(variablesList);
+
+    vector<int> parents(variablesList.size(), -1);
+    for (int i = 0; i < (int)variablesList.size(); i++) parents[i] = variablesTrie->getParent(i);
+    setVarParents(move(parents));
+
+    // predicates are compiled once, the expressions are kept for the reference evaluation
+    accessPredicates.reset(new AccessPredicates(*this, variablesList));
+
+    readonlyGlobal->ensureFieldPaths(variablesList, true);
+    getWriteGlobal()->ensureFieldPaths(variablesList, true);
+
+    // fields of all the variables exist from the start, so the writers never add fields to their common ancestors.
+    // Optimistic commits are serialized, the live state is copy-on-write there
+    if (getType() != Optimistic) setLockedVariables(variablesTrie, getWriteGlobal());
 }
 
 void ProgramRuntime::run(int millis) {
@@ -123,68 +131,266 @@ void ProgramRuntime::run(int millis) {
     cout << "  - absolute total done: " << totalDoneMessages << endl;
     cout << "  - absolute avg. per second: " << totalDoneMessages / (millis / 1000.0) << endl;
     cout << "===============================" << endl << endl;
+
+    if (accessPredicates->isCacheable() && getType() != Optimistic && getWorkersCount() > 1) {
+        long long hits = accessPredicates->getCacheHits(), misses = accessPredicates->getCacheMisses();
+
+        cout << "===== Scheduling decisions ====" << endl;
+        cout << "  - cache hits: " << hits << endl;
+        cout << "  - cache misses: " << misses << endl;
+        cout << "  - hit rate: " << hits * 100.0 / max(hits + misses, 1LL) << "%" << endl;
+        cout << "===============================" << endl << endl;
+    }
+
+    if (getType() == Optimistic) {
+        cout << "===== Optimistic execution ====" << endl;
+        cout << "  - commits: " << commits << endl;
+        cout << "  - aborts: " << aborts << endl;
+        cout << "  - abort rate: " << aborts * 100.0 / max(commits + aborts, 1LL) << "%" << endl;
+        cout << "  - exclusive fallbacks: " << fallbacks << endl;
+        cout << "===============================" << endl << endl;
+    }
+}
+
+vector<shared_ptr<ExecValue>> ProgramRuntime::generateMessages(int count) {
+    vector<shared_ptr<ExecValue>> res;
+
+    chrono::time_point<chrono::high_resolution_clock> currTime;
+    while ((int)res.size() < count) {
+        currTime += 1ms;
+        for (auto& gen : messageGenerators) {
+            if (gen.isGenerationNeeded(currTime) && (int)res.size() < count) res.push_back(gen.generate(currTime));
+        }
+    }
+
+    return res;
+}
+
+string ProgramRuntime::runMessages(const vector<shared_ptr<ExecValue>>& msgs) {
+    if (latenciesTracked) {
+        for (auto& workerLatencies : latencies) workerLatencies.reserve(workerLatencies.size() + msgs.size() + 1);
+    }
+
+    start();
+
+    auto initMsg = createInitMessage();
+    if (initMsg) schedule(initMsg);
+
+    for (auto& msg : msgs) schedule(msg);
+
+    // waiting for all messages to be done
+    stop(true);
+
+    return getWriteGlobal()->toString();
 }
 
 void ProgramRuntime::workerProcess(int index, shared_ptr<void> msg) {
-    resultWorker->sendResult(
-            exec(static_pointer_cast<ExecValue>(msg))
-    );
+    // temporaries of the message (including the retries and the commit) are released when it is done
+    MessageArena::Scope arenaScope;
+    auto startTime = chrono::high_resolution_clock::now();
+
+    shared_ptr<ExecValue> res;
+    if (getType() == Optimistic) res = execOptimistic(static_pointer_cast<ExecValue>(msg));
+    else if (isWorkerOnSnapshot(index)) res = exec(static_pointer_cast<ExecValue>(msg), atomic_load(&readonlyGlobal), getWriteGlobal());
+    else res = exec(static_pointer_cast<ExecValue>(msg));
+
+    resultWorker->sendResult(res);
+
+    if (latenciesTracked) {
+        latencies[index].push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - startTime).count());
+    }
 }
 
-void ProgramRuntime::updateReadonlyState(const std::vector<bool> &writes) {
-    if (getType() == WLocking) {
-        // reading only written vars, others are dangerous to read because are not locked!!!
-        auto res = static_pointer_cast<ExecObject>(readonlyGlobal->clone());
+void ProgramRuntime::setLatenciesTracked(bool tracked) {
+    latenciesTracked = tracked;
+    latencies.assign(tracked ? getWorkersCount() : 0, vector<long long>());
+}
+
+vector<long long> ProgramRuntime::getLatencies() const {
+    vector<long long> res;
+    for (auto& workerLatencies : latencies) res.insert(res.end(), workerLatencies.begin(), workerLatencies.end());
+
+    sort(res.begin(), res.end());
+    return res;
+}
+
+void ProgramRuntime::onGlobalRead(const FieldPath& path) {
+    if (currentTransaction) addPathVars(path, currentTransaction->readVars);
+}
 
-        int i = 0;
-        for (auto& var : variables) {
-            if (writes[i]) res->setFieldByPath(var, getWriteGlobal()->getFieldByPath(var));
-            i += 1;
+void ProgramRuntime::onGlobalWrite(const FieldPath& path) {
+    if (currentTransaction) {
+        currentTransaction->writePaths.push_back(&path);
+        addPathVars(path, currentTransaction->writeVars);
+    }
+}
+
+shared_ptr<ExecValue> ProgramRuntime::execOptimistic(shared_ptr<ExecValue> msg) {
+    for (int attempt = 0; attempt < MAX_ABORTS; attempt++) {
+        OptimisticTransaction transaction;
+        long long seenCommits;
+        {
+            // consistent snapshot, nobody can commit meanwhile
+            lock_guard<mutex> lock(commitMutex);
+            transaction.global = static_pointer_cast<ExecObject>(getWriteGlobal()->clone());
+            transaction.versions = versions;
+            seenCommits = commits;
+        }
+
+        shared_ptr<ExecValue> res;
+        try {
+            currentTransaction = &transaction;
+            res = exec(msg, transaction.global, transaction.global);
+            currentTransaction = NULL;
+        }
+        catch (...) {
+            // message can fail on a state no locking run would give it (e.g. before the init message
+            // is committed), so it is aborted and tried again when some other message commits
+            currentTransaction = NULL;
+            aborts += 1;
+            if (attempt == MAX_ABORTS - 1) throw;
+
+            unique_lock<mutex> lock(commitMutex);
+            commitCond.wait_for(lock, 10ms, [&] { return commits != seenCommits; });
+            continue;
+        }
+
+        if (commit(transaction)) {
+            commits += 1;
+            commitCond.notify_all();
+            return res;
+        }
+        aborts += 1;
+    }
+
+    // too many conflicts - executing on the live state while no other message can commit
+    fallbacks += 1;
+
+    OptimisticTransaction transaction;
+    lock_guard<mutex> lock(commitMutex);
+
+    currentTransaction = &transaction;
+    auto res = exec(msg, getWriteGlobal(), getWriteGlobal());
+    currentTransaction = NULL;
+
+    for (int var : transaction.writeVars) versions[var] += 1;
+
+    commits += 1;
+    commitCond.notify_all();
+    return res;
+}
+
+bool ProgramRuntime::commit(OptimisticTransaction& transaction) {
+    lock_guard<mutex> lock(commitMutex);
+
+    // validating that nothing read by the message was changed since the snapshot
+    for (int var : transaction.readVars) {
+        if (versions[var] != transaction.versions[var]) return false;
+    }
+
+    // publishing writes, the snapshot is thrown away so values do not need to be cloned
+    for (auto path : transaction.writePaths) {
+        getWriteGlobal()->setValueByPath(*path, transaction.global->getValueByPath(*path));
+    }
+    for (int var : transaction.writeVars) versions[var] += 1;
+
+    return true;
+}
+
+void ProgramRuntime::addPathVars(const FieldPath& path, vector<int>& res) const {
+    // variables the path is inside of - the deepest one on the path and its parents
+    int node = VariablesTrie::ROOT, last = -1;
+    size_t depth = 0;
+    for (; depth < path.size(); depth++) {
+        int child = variablesTrie->getChild(node, path[depth]);
+        if (child < 0) break;
+
+        node = child;
+        if (variablesTrie->getVar(node) >= 0) last = variablesTrie->getVar(node);
+    }
+    for (int var = last; var >= 0; var = getVarParent(var)) res.push_back(var);
+
+    // variables inside of the path
+    if (depth < path.size() || node == VariablesTrie::ROOT) return;
+    for (int var : variablesTrie->getNestedVars(node)) {
+        if (var != last) res.push_back(var);
+        addNestedVars(var, res);
+    }
+}
+
+void ProgramRuntime::addNestedVars(int var, vector<int>& res) const {
+    for (int child : getVarChildren(var)) {
+        res.push_back(child);
+        addNestedVars(child, res);
+    }
+}
+
+void ProgramRuntime::updateReadonlyState(const VarsSet& writes) {
+    if (getType() == WLocking || (getType() == RWLocking && isSnapshotReads() && getWorkersCount() > 1)) {
+        if (writes.empty()) return;
+
+        // new version copies only the written paths, readers of the old one keep it alive until they finish
+        auto res = atomic_load(&readonlyGlobal);
+
+        // reading only written vars, others are dangerous to read because are not locked!!!
+        // ancestors of the nested variables are copied, they are modified in place in the live state
+        for (int var : writes) {
+            auto value = getWriteGlobal()->getValueByPath(variablesList[var]);
+            res = res->withFieldByPath(variablesList[var], copyAncestors(value, variablesTrie->getVarNode(var)));
         }
 
         atomic_store(&readonlyGlobal, res);
     }
 }
 
-std::pair< std::vector<bool>, std::vector<bool> > ProgramRuntime::getMessageVars(std::shared_ptr<void> msg) {
+std::pair<VarsSet, VarsSet> ProgramRuntime::getMessageVars(std::shared_ptr<void> msg) {
     if (getWorkersCount() == 1) {
-        return make_pair(vector<bool>(getVarsCount(), true), vector<bool>(getVarsCount(), true));
+        auto res = make_pair(VarsSet(), VarsSet());
+        for (int i = 0; i < getVarsCount(); i++) {
+            res.first.insert(i);
+            res.second.insert(i);
+        }
+        return res;
     }
 
+    return getCachedMessageVars(static_pointer_cast<ExecValue>(msg));
+}
+
+std::pair<VarsSet, VarsSet> ProgramRuntime::getCachedMessageVars(std::shared_ptr<ExecValue> msg) {
+    return accessPredicates->evaluate(static_pointer_cast<ExecObject>(msg));
+}
+
+std::pair<VarsSet, VarsSet> ProgramRuntime::getCompiledMessageVars(std::shared_ptr<ExecValue> msg) const {
+    return accessPredicates->compute(static_pointer_cast<ExecObject>(msg));
+}
+
+std::pair<VarsSet, VarsSet> ProgramRuntime::getInterpretedMessageVars(std::shared_ptr<ExecValue> msg) {
     // setting up data for executor
     auto mainLocal = make_shared<ExecObject>();
     auto mainFunction = getProgram()->getFunction("main");
     for (auto& arg : mainFunction->getArguments()) mainLocal->setFieldByPath(arg, static_pointer_cast<ExecObject>(msg));
 
-    // determine sets of variables according to expressions found by analyzer
-    set<string> readVars;
-    set<string> writeVars;
-    for (auto& var : variables) {
-        // handling read expressions
-        for (auto& exp : mainFunction->getReadExpressions()[var]) {
-            if (dynamic_pointer_cast<ExecBoolean>(execExpression(exp, mainLocal))->getValue()) {
-                readVars.insert(var);
-                break;
-            }
-        }
+    // determine sets of variables according to expressions found by analyzer, nested variables are
+    // handled by the scheduler's intention locks - so only the touched paths are returned
+    auto res = make_pair(VarsSet(), VarsSet());
 
-        // handling write expressions
-        for (auto& exp : mainFunction->getWriteExpressions()[var]) {
-            if (dynamic_pointer_cast<ExecBoolean>(execExpression(exp, mainLocal))->getValue()) {
-                writeVars.insert(var);
-                break;
-            }
-        }
-    }
+    // expressions are only looked up - decentralized workers are evaluating them concurrently, the shared
+    // sub-expressions are evaluated once for the message
+    ExpressionValues values;
+    auto isAnyTrue = [&](const map<string, set<shared_ptr<Expression> > >& expressions, const string& var) {
+        auto expIt = expressions.find(var);
+        if (expIt == expressions.end()) return false;
 
-    // creating final binary vectors
-    auto res = make_pair(vector<bool>(variables.size(), false), vector<bool>(variables.size(), false));
+        for (auto& exp : expIt->second) {
+            if (execExpression(exp, mainLocal, values).getBoolean()) return true;
+        }
+        return false;
+    };
 
     int i = 0;
     for (auto& var : variables) {
-        // it is needed to fill in any dependent vars!!!
-        if (hasPrefixInSet(var, readVars)) res.first[i] = true;
-        if (hasPrefixInSet(var, writeVars)) res.second[i] = true;
+        if (isAnyTrue(mainFunction->getReadExpressions(), var)) res.first.insert(i);
+        if (isAnyTrue(mainFunction->getWriteExpressions(), var)) res.second.insert(i);
 
         i += 1;
     }
@@ -1,13 +1,16 @@
 #ifndef SCHEDULER_RUNTIME_H
 #define SCHEDULER_RUNTIME_H
 
+#include <mutex>
 #include <atomic>
 #include <string>
 #include <memory>
 #include <chrono>
 #include <functional>
+#include <condition_variable>
 
 #include "Scheduler.h"
+#include "AccessPredicates.h"
 #include "SimpleProgramRuntime.h"
 
 class ProgramRuntime;
@@ -16,12 +19,22 @@ class ResultWorkerMessage {
 public:
     enum Type { Exit = 10, Result = 5, LazyExit = 1 };
 
+    static constexpr size_t LANES_COUNT = 3;
+
     ResultWorkerMessage(Type type, std::shared_ptr<ExecValue> result) : type(type), result(std::move(result)) { }
 
     Type getType() const {
         return type;
     }
 
+    size_t getLane() const {
+        switch (type) {
+            case Exit: return 0;
+            case Result: return 1;
+            default: return 2;
+        }
+    }
+
     std::shared_ptr<ExecValue> getResult() const {
         return result;
     }
@@ -112,12 +125,44 @@ private:
     std::vector<int> counters;
 };
 
+// Accesses of one optimistic execution - snapshot of the global state with versions of its variables.
+// Accessed paths are resolved to the variables (with their nested and parent variables) as they are recorded,
+// the commit only compares and increments the versions.
+struct OptimisticTransaction {
+    std::shared_ptr<ExecObject> global;
+    std::vector<long long> versions;
+    std::vector<int> readVars;
+    std::vector<int> writeVars;
+    std::vector<const FieldPath*> writePaths;
+};
+
 class ProgramRuntime : public SimpleProgramRuntime, public Scheduler {
 public:
-    explicit ProgramRuntime(std::string, Scheduler::Type, int);
+    // optimistic message falls back to the exclusive (locked) execution after this many aborts
+    static constexpr int MAX_ABORTS = 4;
+
+    explicit ProgramRuntime(std::string, Scheduler::Type, int, bool optimized = true);
 
     void run(int);
 
+    // access sets of the message computed by the compiled predicates (with or without the decision cache)
+    // and by interpreting the analyzer's expressions
+    std::pair<VarsSet, VarsSet> getCachedMessageVars(std::shared_ptr<ExecValue>);
+    std::pair<VarsSet, VarsSet> getCompiledMessageVars(std::shared_ptr<ExecValue>) const;
+    std::pair<VarsSet, VarsSet> getInterpretedMessageVars(std::shared_ptr<ExecValue>);
+
+    const AccessPredicates& getAccessPredicates() const {
+        return *accessPredicates;
+    }
+
+    // time of every message spent in the worker (sorted nanoseconds), recorded only when tracked
+    void setLatenciesTracked(bool);
+    std::vector<long long> getLatencies() const;
+
+    // deterministic replay - messages of registered generators on a simulated 1 ms clock
+    std::vector<std::shared_ptr<ExecValue>> generateMessages(int);
+    std::string runMessages(const std::vector<std::shared_ptr<ExecValue>>&);
+
     void start() override {
         resultWorker->start();
         Scheduler::start();
@@ -150,20 +195,44 @@ protected:
     }
 
     std::shared_ptr<ExecObject> getReadGlobal() const override {
-        return getType() == RWLocking ? SimpleProgramRuntime::getReadGlobal() : std::atomic_load(&readonlyGlobal);
+        return getType() != WLocking ? SimpleProgramRuntime::getReadGlobal() : std::atomic_load(&readonlyGlobal);
     }
 
+    void onGlobalRead(const FieldPath&) override;
+    void onGlobalWrite(const FieldPath&) override;
+
     void workerProcess(int, std::shared_ptr<void>) override;
-    void updateReadonlyState(const std::vector<bool> &) override;
-    std::pair<std::vector<bool>, std::vector<bool> > getMessageVars(std::shared_ptr<void>) override;
+    void updateReadonlyState(const VarsSet&) override;
+    std::pair<VarsSet, VarsSet> getMessageVars(std::shared_ptr<void>) override;
 
 private:
+    std::shared_ptr<ExecValue> execOptimistic(std::shared_ptr<ExecValue>);
+    bool commit(OptimisticTransaction&);
+    void addPathVars(const FieldPath&, std::vector<int>&) const;
+    void addNestedVars(int, std::vector<int>&) const;
+
     std::shared_ptr<ResultWorker> resultWorker;
     std::vector<MessageGenerator> messageGenerators;
 
     std::shared_ptr<ExecObject> readonlyGlobal;
 
     std::set<std::string> variables;
+    std::vector<std::string> variablesList;
+    std::unique_ptr<AccessPredicates> accessPredicates;
+
+    std::shared_ptr<const VariablesTrie> variablesTrie;
+
+    // optimistic mode - version of every variable, snapshots and commits are done under commitMutex
+    std::mutex commitMutex;
+    std::condition_variable commitCond;
+    std::vector<long long> versions;
+    std::atomic<long long> commits;
+    std::atomic<long long> aborts;
+    std::atomic<long long> fallbacks;
+
+    // every worker records into its own list
+    bool latenciesTracked;
+    std::vector<std::vector<long long> > latencies;
 };
 
 
@@ -1,12 +1,156 @@
 #ifndef INTERPRETER_QUEUE_H
 #define INTERPRETER_QUEUE_H
 
+#include <array>
 #include <mutex>
 #include <queue>
+#include <atomic>
+#include <new>
+#include <type_traits>
 #include <functional>
 #include <condition_variable>
 
+// Lock-free multi-level mailbox. Messages are stored in one FIFO lane per priority level (T::LANES_COUNT lanes,
+// lane index returned by T::getLane(), 0 is the highest priority). Any thread can push, but only one thread
+// (the owning worker) can pop or wait. Mutex and condition variable are touched only when the consumer is
+// going to sleep on an empty queue.
 template <class T> class Queue {
+public:
+    Queue() : sleeping(false) { }
+
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
+    void waitFor(const std::function<bool(const T&)>& func) {
+        size_t lane;
+        sleepUntil([&] {
+            const T* item = front(lane);
+            return item && func(*item);
+        });
+    }
+
+    T pop() {
+        T* item;
+        size_t lane;
+        sleepUntil([&] { return (item = front(lane)) != nullptr; });
+
+        // popping from the lane of the item - higher lanes could be filled meanwhile
+        T res = std::move(*item);
+        lanes[lane].pop();
+        return res;
+    }
+
+    void pop(T& item) {
+        item = pop();
+    }
+
+    void push(const T& item) {
+        lanes[item.getLane()].push(new Node(item));
+        wakeUp();
+    }
+
+    void push(T&& item) {
+        auto lane = item.getLane();
+        lanes[lane].push(new Node(std::move(item)));
+        wakeUp();
+    }
+
+private:
+    struct Node {
+        Node() : next(nullptr), hasItem(false) { }
+        explicit Node(const T& item) : next(nullptr), hasItem(true) { new (&storage) T(item); }
+        explicit Node(T&& item) : next(nullptr), hasItem(true) { new (&storage) T(std::move(item)); }
+
+        ~Node() {
+            clear();
+        }
+
+        T* get() {
+            return hasItem ? reinterpret_cast<T*>(&storage) : nullptr;
+        }
+
+        void clear() {
+            if (hasItem) reinterpret_cast<T*>(&storage)->~T();
+            hasItem = false;
+        }
+
+        std::atomic<Node*> next;
+        bool hasItem;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    // non-intrusive MPSC queue (D. Vyukov), head is shared by producers, tail is owned by the consumer
+    class Lane {
+    public:
+        Lane() : head(&stub), tail(&stub) { }
+
+        ~Lane() {
+            while (pop()) { }
+            if (tail != &stub) delete tail;
+        }
+
+        void push(Node* node) {
+            Node* prev = head.exchange(node);
+            prev->next.store(node);
+        }
+
+        T* front() const {
+            Node* next = tail->next.load();
+            return next ? next->get() : nullptr;
+        }
+
+        bool pop() {
+            Node* next = tail->next.load();
+            if (!next) return false;
+
+            // the popped node becomes the new (empty) tail node
+            Node* old = tail;
+            tail = next;
+            next->clear();
+            if (old != &stub) delete old;
+
+            return true;
+        }
+
+    private:
+        std::atomic<Node*> head;
+        Node* tail;
+        Node stub;
+    };
+
+    T* front(size_t& lane) const {
+        for (lane = 0; lane < lanes.size(); lane++) {
+            T* item = lanes[lane].front();
+            if (item) return item;
+        }
+        return nullptr;
+    }
+
+    template <class F> void sleepUntil(F pred) {
+        if (pred()) return;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping.store(true);
+        while (!pred()) cond.wait(lock);
+        sleeping.store(false);
+    }
+
+    void wakeUp() {
+        if (sleeping.load()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cond.notify_one();
+        }
+    }
+
+    std::array<Lane, T::LANES_COUNT> lanes;
+
+    std::atomic<bool> sleeping;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+// Original mutex + heap based queue, kept as the reference implementation for the queue benchmark.
+template <class T> class LockingQueue {
 public:
     void waitFor(const std::function<bool(const T&)>& func) {
         std::unique_lock<std::mutex> lock(mutex);
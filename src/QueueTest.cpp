@@ -0,0 +1,82 @@
+#include <map>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <sstream>
+#include <iostream>
+
+#include "Queue.h"
+#include "QueueTest.h"
+
+using namespace std;
+
+QueueTest::QueueTest(int messagesCount, int producersCount) : producersCount(producersCount) {
+    mt19937 engine(42);
+    uniform_int_distribution<> distribution(0, 9);
+
+    // same mix of messages as scheduler receives - mostly processing with some releases
+    for (int p = 0; p < producersCount; p++) {
+        vector<QueueTestMessage> producerMessages;
+        for (int i = 0; i < messagesCount / producersCount; i++) {
+            int roll = distribution(engine);
+            auto type = roll < 5 ? QueueTestMessage::Process : (roll < 8 ? QueueTestMessage::Release : QueueTestMessage::Reprocess);
+            producerMessages.emplace_back(type, p, i);
+        }
+        messages.push_back(producerMessages);
+    }
+}
+
+void QueueTest::run() {
+    double ref = runOn<LockingQueue<QueueTestMessage> >("LockingQueue", -1);
+    runOn<Queue<QueueTestMessage> >("Queue", ref);
+}
+
+template <class Q> double QueueTest::runOn(const string& name, double refTime) {
+    Q queue;
+
+    int totalCount = 0;
+    for (auto& producerMessages : messages) totalCount += (int)producerMessages.size();
+
+    // FIFO order violations within the same producer and priority
+    int violations = 0;
+    map<pair<int, int>, int> lastSequences;
+
+    auto startTime = chrono::high_resolution_clock::now();
+    {
+        vector<thread> producers;
+        for (auto& producerMessages : messages) {
+            producers.emplace_back([&queue, &producerMessages] {
+                for (auto& msg : producerMessages) queue.push(msg);
+            });
+        }
+
+        for (int i = 0; i < totalCount; i++) {
+            auto msg = queue.pop();
+
+            auto key = make_pair(msg.getProducer(), (int)msg.getType());
+            auto last = lastSequences.find(key);
+            if (last != lastSequences.end() && last->second > msg.getSequence()) violations += 1;
+            lastSequences[key] = msg.getSequence();
+        }
+
+        for (auto& producer : producers) producer.join();
+    }
+    auto endTime = chrono::high_resolution_clock::now();
+
+    chrono::duration<double, milli> elapsed = endTime - startTime;
+
+    stringstream lineStream;
+    lineStream << "========= " << totalCount << " on " << name << "x" << producersCount << " =========";
+
+    cout << lineStream.str() << endl;
+    cout << "Computation took: " << elapsed.count() << " milliseconds" << endl;
+    cout << "Avg. push + pop cost: " << elapsed.count() * 1000000.0 / totalCount << " nanoseconds" << endl;
+    cout << "FIFO order violations: " << violations << endl;
+
+    double gain = (refTime - elapsed.count()) / refTime;
+    cout << "Performance gain: " << (refTime <= 0 ? 0.0 : gain * 100.0) << "%" << endl;
+
+    cout << string(lineStream.str().size(), '=') << endl << endl;
+
+    return elapsed.count();
+}
@@ -0,0 +1,63 @@
+#ifndef QUEUE_TEST_H
+#define QUEUE_TEST_H
+
+#include <string>
+#include <vector>
+
+class QueueTestMessage {
+public:
+    // same priorities as SchedulerMessage
+    enum Type {
+        Exit = 1000, Release = 100, Reprocess = 10, Process = 15, LazyExit = 1
+    };
+
+    static constexpr size_t LANES_COUNT = 5;
+
+    QueueTestMessage(Type type, int producer, int sequence) : type(type), producer(producer), sequence(sequence) { }
+
+    Type getType() const {
+        return type;
+    }
+
+    int getProducer() const {
+        return producer;
+    }
+
+    int getSequence() const {
+        return sequence;
+    }
+
+    size_t getLane() const {
+        switch (type) {
+            case Exit: return 0;
+            case Release: return 1;
+            case Process: return 2;
+            case Reprocess: return 3;
+            default: return 4;
+        }
+    }
+
+    friend bool operator<(const QueueTestMessage& l, const QueueTestMessage& r) {
+        return l.getType() < r.getType();
+    }
+
+private:
+    Type type;
+    int producer;
+    int sequence;
+};
+
+class QueueTest {
+public:
+    QueueTest(int, int);
+
+    void run();
+
+private:
+    template <class Q> double runOn(const std::string&, double);
+
+    int producersCount;
+    std::vector<std::vector<QueueTestMessage> > messages;
+};
+
+#endif
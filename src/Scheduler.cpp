@@ -1,3 +1,6 @@
+#include <ctime>
+#include <chrono>
+#include <algorithm>
 #include <stdexcept>
 
 #include "Scheduler.h"
@@ -11,25 +14,38 @@ bool SchedulerWorker::process(SchedulerWorkerMessage& msg) {
         scheduler.workerRelease(index);
         return true;
     }
+    else if (msg.getType() == SchedulerWorkerMessage::Pull) {
+        // returns when the scheduler is stopped
+        scheduler.workerPull(index);
+    }
 
     return false;
 }
 
 void SchedulerWorker::clearVars() {
-    readVars.assign(varsCount, false);
-    writeVars.assign(varsCount, false);
+    readVars.clear();
+    writeVars.clear();
 }
 
-void SchedulerWorker::setVars(const std::vector<bool>& newReadVars, const std::vector<bool>& newWriteVars) {
-    readVars.assign(newReadVars.begin(), newReadVars.end());
-    writeVars.assign(newWriteVars.begin(), newWriteVars.end());
+void SchedulerWorker::setVars(VarsSet newReadVars, VarsSet newWriteVars) {
+    readVars = std::move(newReadVars);
+    writeVars = std::move(newWriteVars);
 }
 
 // Scheduler
-Scheduler::Scheduler(Type type, int workersCount, int varsCount) :
-        type(type), varsCount(varsCount) {
+Scheduler::Scheduler(Type type, int workersCount, int varsCount, int lookahead) :
+        type(type), mode(Central), snapshotReads(true), varsCount(varsCount), lookahead(lookahead), locks(varsCount),
+        parents(varsCount, -1), children(varsCount),
+        nextParkedId(0), waitLists(varsCount), nextNodeId(0), workerNodes(workersCount, -1),
+        sharedGeneration(0), sharedExit(false), sharedExitNow(false) {
+    // choosing conflict policy once, so the checks do not branch on the type
+    if (type == RWLocking) isSchedulableFunc = &Scheduler::isSchedulable<RWLockingPolicy>;
+    else isSchedulableFunc = &Scheduler::isSchedulable<WLockingPolicy>;
+
+    if (type == Ordered) varOrders.resize(varsCount);
+
     for (int i = 0; i < workersCount; i++) {
-        workers.push_back(new SchedulerWorker(*this, i, varsCount));
+        workers.push_back(new SchedulerWorker(*this, i));
     }
 }
 
@@ -37,12 +53,51 @@ Scheduler::~Scheduler() {
     for (auto worker : workers) delete worker;
 }
 
+void Scheduler::setVarParents(vector<int> newParents) {
+    parents = move(newParents);
+
+    for (auto& varChildren : children) varChildren.clear();
+    for (int var = 0; var < varsCount; var++) {
+        if (parents[var] >= 0) children[parents[var]].push_back(var);
+    }
+}
+
+void Scheduler::setMode(Mode newMode) {
+    if (newMode == Decentralized && type == Ordered) {
+        throw logic_error("Ordered scheduling needs the central scheduler");
+    }
+
+    mode = newMode;
+    if (mode == Decentralized) atomicLocks = vector<atomic<int> >(varsCount);
+}
+
 void Scheduler::start() {
+    if (mode == Decentralized) {
+        // no scheduler thread, workers are pulling messages themselves
+        for (auto worker : workers) {
+            worker->start();
+            worker->pull();
+        }
+        return;
+    }
+
     Worker::start();
     for (auto worker : workers) worker->start();
 }
 
 void Scheduler::stop(bool wait) {
+    if (mode == Decentralized) {
+        {
+            lock_guard<mutex> lock(sharedMutex);
+            sharedExit = true;
+            sharedExitNow = !wait;
+        }
+        sharedCond.notify_all();
+
+        for (auto worker : workers) worker->join();
+        return;
+    }
+
     send(SchedulerMessage(wait ? SchedulerMessage::LazyExit : SchedulerMessage::Exit, -1, shared_ptr<void>()));
     join();
 
@@ -50,11 +105,14 @@ void Scheduler::stop(bool wait) {
 }
 
 bool Scheduler::process(SchedulerMessage& msg) {
+    if (type == Ordered) return processOrdered(msg);
+
     if (msg.getType() == SchedulerMessage::Process || msg.getType() == SchedulerMessage::Reprocess) {
         auto worker = getAvailableWorker();
 
         if (worker == NULL) {
             // reschedule message again
+            stats.reschedules += 1;
             reschedule(msg.getMessage());
 
             // wait for release or exit message here - because no worker are available so no need to try scheduling
@@ -67,15 +125,32 @@ bool Scheduler::process(SchedulerMessage& msg) {
             return true;
         }
 
-        auto vars = getMessageVars(msg.getMessage());
-        if (isSchedulable(vars.first, vars.second)) {
-            worker->setAvailable(false);
-            worker->setVars(vars.first, vars.second);
-            worker->schedule(msg.getMessage());
+        auto startTime = chrono::high_resolution_clock::now();
+
+        auto vars = getLockedVars(msg.getMessage());
+        bool schedulable = (this->*isSchedulableFunc)(vars.first, vars.second, NULL);
+
+        stats.decisions += 1;
+        stats.decisionsNanos += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - startTime).count();
+
+        if (schedulable) {
+            dispatch(worker, msg.getMessage(), move(vars.first), move(vars.second));
+        }
+        else if ((int)parked.size() < lookahead) {
+            // parking message until some of its variables is released, following messages can go meanwhile
+            park(msg.getMessage(), move(vars.first), move(vars.second));
         }
         else {
             // reschedule not-processed message
+            stats.reschedules += 1;
             reschedule(msg.getMessage());
+
+            // lookahead window is full - nothing can change until some release
+            if (lookahead > 0) {
+                waitFor([&](const SchedulerMessage& m) {
+                    return m.getType() == SchedulerMessage::Release || m.getType() == SchedulerMessage::Exit;
+                });
+            }
         }
 
         return true;
@@ -86,16 +161,179 @@ bool Scheduler::process(SchedulerMessage& msg) {
         // updating read-only copy of the state (if it is not needed implementation will do nothing)
         updateReadonlyState(worker->getWriteVars());
 
-        // resetting worker
+        // resetting worker, parked messages waiting for freed variables are woken up
+        auto startTime = chrono::high_resolution_clock::now();
+
+        set<long long> candidates;
+        candidates.swap(readyParked);
+
+        unlockVars(worker->getReadVars(), worker->getWriteVars(), candidates);
+        worker->clearVars();
+        worker->setAvailable(true);
+
+        stats.releases += 1;
+        stats.releasesNanos += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - startTime).count();
+
+        wakeParked(candidates);
+
+        return true;
+    }
+    else if (msg.getType() == SchedulerMessage::LazyExit && !parked.empty()) {
+        // parked messages have to be finished first, so waiting for next (release) message and trying again
+        waitFor([](const SchedulerMessage&) { return true; });
+        send(SchedulerMessage(SchedulerMessage::LazyExit, -1, shared_ptr<void>()));
+        return true;
+    }
+
+    recordCpuTime();
+    return false;
+}
+
+bool Scheduler::processOrdered(SchedulerMessage& msg) {
+    if (msg.getType() == SchedulerMessage::Process || msg.getType() == SchedulerMessage::Reprocess) {
+        auto startTime = chrono::high_resolution_clock::now();
+
+        addOrderedNode(msg.getMessage());
+
+        stats.decisions += 1;
+        stats.decisionsNanos += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - startTime).count();
+
+        dispatchOrderedNodes();
+        return true;
+    }
+    else if (msg.getType() == SchedulerMessage::Release) {
+        auto worker = workers[msg.getSenderIndex()];
+        updateReadonlyState(worker->getWriteVars());
+
+        auto startTime = chrono::high_resolution_clock::now();
+
+        finishOrderedNode(workerNodes[msg.getSenderIndex()]);
+        workerNodes[msg.getSenderIndex()] = -1;
         worker->clearVars();
         worker->setAvailable(true);
 
+        stats.releases += 1;
+        stats.releasesNanos += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - startTime).count();
+
+        dispatchOrderedNodes();
+        return true;
+    }
+    else if (msg.getType() == SchedulerMessage::LazyExit && !nodes.empty()) {
+        // unfinished messages have to be done first, so waiting for next (release) message and trying again
+        waitFor([](const SchedulerMessage&) { return true; });
+        send(SchedulerMessage(SchedulerMessage::LazyExit, -1, shared_ptr<void>()));
         return true;
     }
 
+    recordCpuTime();
     return false;
 }
 
+void Scheduler::addOrderedNode(shared_ptr<void> message) {
+    long long id = nextNodeId++;
+
+    auto vars = getMessageVars(message);
+
+    // nested variables are conflicting with their parents, so the DAG works with whole subtrees
+    auto& node = nodes[id];
+    node.message = move(message);
+    node.readVars = withDescendants(vars.first);
+    node.writeVars = withDescendants(vars.second);
+
+    auto addEdge = [&](long long from) {
+        if (from < 0 || from == id) return;
+        nodes[from].successors.push_back(id);
+        node.pendingCount += 1;
+    };
+
+    // writer waits for the last writer and all readers after it, reader waits only for the last writer
+    for (int var : node.writeVars) {
+        auto& order = varOrders[var];
+        addEdge(order.lastWriter);
+        for (long long reader : order.readers) addEdge(reader);
+
+        order.lastWriter = id;
+        order.readers.clear();
+    }
+    for (int var : node.readVars) {
+        if (node.writeVars.contains(var)) continue;
+
+        auto& order = varOrders[var];
+        addEdge(order.lastWriter);
+        order.readers.push_back(id);
+    }
+
+    if (node.pendingCount == 0) readyNodes.insert(id);
+}
+
+void Scheduler::finishOrderedNode(long long id) {
+    auto nodeIt = nodes.find(id);
+    auto& node = nodeIt->second;
+
+    for (long long successor : node.successors) {
+        if (--nodes[successor].pendingCount == 0) readyNodes.insert(successor);
+    }
+
+    // finished message is not a dependency of any new message
+    for (int var : node.writeVars) {
+        if (varOrders[var].lastWriter == id) varOrders[var].lastWriter = -1;
+    }
+    for (int var : node.readVars) {
+        auto& readers = varOrders[var].readers;
+        readers.erase(remove(readers.begin(), readers.end(), id), readers.end());
+    }
+
+    nodes.erase(nodeIt);
+}
+
+void Scheduler::dispatchOrderedNodes() {
+    // ready messages go in the submission order
+    while (!readyNodes.empty()) {
+        auto worker = getAvailableWorker();
+        if (worker == NULL) return;
+
+        long long id = *readyNodes.begin();
+        readyNodes.erase(readyNodes.begin());
+
+        auto& node = nodes[id];
+        workerNodes[worker->getIndex()] = id;
+        worker->setAvailable(false);
+        worker->setVars(node.readVars, node.writeVars);
+        worker->schedule(node.message);
+    }
+}
+
+pair<VarsSet, VarsSet> Scheduler::getLockedVars(shared_ptr<void> message) {
+    // optimistic messages do not lock anything, so their predicates are not evaluated at all
+    if (type == Optimistic) return make_pair(VarsSet(), VarsSet());
+
+    auto vars = getMessageVars(move(message));
+
+    // read-only message works with the snapshot, so it does not need to lock its reads
+    if (type == RWLocking && snapshotReads && vars.second.empty()) vars.first.clear();
+
+    return vars;
+}
+
+VarsSet Scheduler::withDescendants(const VarsSet& vars) const {
+    VarsSet res;
+    vector<int> stack(vars.begin(), vars.end());
+    while (!stack.empty()) {
+        int var = stack.back();
+        stack.pop_back();
+
+        if (res.contains(var)) continue;
+        res.insert(var);
+        stack.insert(stack.end(), children[var].begin(), children[var].end());
+    }
+    return res;
+}
+
+bool Scheduler::isWorkerOnSnapshot(int index) const {
+    auto worker = workers[index];
+    return type == RWLocking && snapshotReads && worker->getReadVars().empty() && worker->getWriteVars().empty();
+}
+
 SchedulerWorker* Scheduler::getAvailableWorker() {
     for (auto worker : workers) {
         if (worker->isAvailable()) return worker;
@@ -103,34 +341,266 @@ SchedulerWorker* Scheduler::getAvailableWorker() {
     return NULL;
 }
 
-bool Scheduler::isSchedulable(const std::vector<bool>& readVars, const std::vector<bool>& writeVars) {
+template <class Policy> bool Scheduler::isSchedulable(const VarsSet& readVars, const VarsSet& writeVars,
+                                                      vector<int>* blockingVars) const {
     if (getWorkersCount() == 1) return true;
 
-    for (int i = 0; i < varsCount; i++) {
-        bool locked = false;
-        bool needLocked = false;
+    // when blocking variables are requested all of them are collected, otherwise first one is enough
+    bool res = true;
+    auto check = [&](int var, bool blocked) {
+        if (!blocked) return true;
+        res = false;
+        if (!blockingVars) return false;
+        blockingVars->push_back(var);
+        return true;
+    };
+
+    for (int var : readVars) {
+        if (!check(var, Policy::isReadBlocked(locks[var]))) return false;
+        for (int parent = parents[var]; parent >= 0; parent = parents[parent]) {
+            if (!check(parent, Policy::isIntentReadBlocked(locks[parent]))) return false;
+        }
+    }
+    for (int var : writeVars) {
+        if (!check(var, Policy::isWriteBlocked(locks[var]))) return false;
+        for (int parent = parents[var]; parent >= 0; parent = parents[parent]) {
+            if (!check(parent, Policy::isIntentWriteBlocked(locks[parent]))) return false;
+        }
+    }
+
+    return res;
+}
+
+void Scheduler::dispatch(SchedulerWorker* worker, shared_ptr<void> message, VarsSet readVars, VarsSet writeVars) {
+    lockVars(readVars, writeVars);
+    worker->setAvailable(false);
+    worker->setVars(move(readVars), move(writeVars));
+    worker->schedule(move(message));
+}
+
+void Scheduler::park(shared_ptr<void> message, VarsSet readVars, VarsSet writeVars) {
+    long long id = nextParkedId++;
+
+    auto& parkedMsg = parked[id];
+    parkedMsg.message = move(message);
+    parkedMsg.readVars = move(readVars);
+    parkedMsg.writeVars = move(writeVars);
+
+    // waiting only for variables that block the message now
+    (this->*isSchedulableFunc)(parkedMsg.readVars, parkedMsg.writeVars, &parkedMsg.waitingVars);
+    for (int var : parkedMsg.waitingVars) waitLists[var].push_back(id);
+
+    stats.parks += 1;
+}
+
+void Scheduler::wakeParked(set<long long>& candidates) {
+    // candidates are tried in the arrival order
+    for (long long id : candidates) {
+        auto parkedIt = parked.find(id);
+        if (parkedIt == parked.end()) continue;
+
+        auto& parkedMsg = parkedIt->second;
+        for (int var : parkedMsg.waitingVars) {
+            auto& waitList = waitLists[var];
+            waitList.erase(remove(waitList.begin(), waitList.end(), id), waitList.end());
+        }
+        parkedMsg.waitingVars.clear();
 
-        if (type == RWLocking) {
-            for (auto worker : workers) {
-                if (worker->getWriteVars()[i]) {
-                    locked = true;
-                    break;
-                }
+        if (!(this->*isSchedulableFunc)(parkedMsg.readVars, parkedMsg.writeVars, &parkedMsg.waitingVars)) {
+            // still blocked - parking again on the current blocking variables
+            for (int var : parkedMsg.waitingVars) waitLists[var].push_back(id);
+            continue;
+        }
+
+        auto worker = getAvailableWorker();
+        if (worker == NULL) {
+            // not blocked anymore, will be tried on the next release
+            readyParked.insert(id);
+            continue;
+        }
+
+        stats.wakeups += 1;
+        dispatch(worker, move(parkedMsg.message), move(parkedMsg.readVars), move(parkedMsg.writeVars));
+        parked.erase(parkedIt);
+    }
+}
+
+void Scheduler::lockVars(const VarsSet& readVars, const VarsSet& writeVars) {
+    // ancestors get intention locks, so conflicts with parent variables are found on the path
+    for (int var : readVars) {
+        locks[var].readers += 1;
+        for (int parent = parents[var]; parent >= 0; parent = parents[parent]) locks[parent].intentReaders += 1;
+    }
+    for (int var : writeVars) {
+        locks[var].writer = true;
+        for (int parent = parents[var]; parent >= 0; parent = parents[parent]) locks[parent].intentWriters += 1;
+    }
+}
+
+void Scheduler::unlockVars(const VarsSet& readVars, const VarsSet& writeVars, set<long long>& woken) {
+    // collecting parked messages waiting for the freed variables
+    auto wake = [&](int var) { woken.insert(waitLists[var].begin(), waitLists[var].end()); };
+
+    for (int var : readVars) {
+        if (--locks[var].readers == 0) wake(var);
+        for (int parent = parents[var]; parent >= 0; parent = parents[parent]) {
+            if (--locks[parent].intentReaders == 0) wake(parent);
+        }
+    }
+    for (int var : writeVars) {
+        locks[var].writer = false;
+        wake(var);
+        for (int parent = parents[var]; parent >= 0; parent = parents[parent]) {
+            if (--locks[parent].intentWriters == 0) wake(parent);
+        }
+    }
+}
+
+void Scheduler::pushShared(shared_ptr<void> message) {
+    {
+        lock_guard<mutex> lock(sharedMutex);
+        sharedQueue.push_back(move(message));
+        sharedGeneration += 1;
+    }
+    sharedCond.notify_one();
+}
+
+void Scheduler::workerPull(int index) {
+    auto worker = workers[index];
+    SchedulerStats workerStats;
+
+    // blocked messages are requeued, worker sleeps when all queued messages failed since last change
+    long long failedGeneration = -1;
+    size_t failedCount = 0;
+
+    while (true) {
+        shared_ptr<void> message;
+        long long generation;
+        {
+            unique_lock<mutex> lock(sharedMutex);
+            while (true) {
+                if (sharedExitNow || (sharedExit && sharedQueue.empty())) break;
+
+                bool blocked = failedGeneration == sharedGeneration && failedCount >= sharedQueue.size();
+                if (!sharedQueue.empty() && !blocked) break;
+
+                sharedCond.wait(lock);
             }
-            needLocked = readVars[i] || writeVars[i];
-        }
-        else if (type == WLocking) {
-            for (auto worker : workers) {
-                if (worker->getWriteVars()[i]) {
-                    locked = true;
-                    break;
-                }
+
+            if (sharedExitNow || sharedQueue.empty()) {
+                // merging worker counters into scheduler stats
+                stats.decisions += workerStats.decisions;
+                stats.decisionsNanos += workerStats.decisionsNanos;
+                stats.releases += workerStats.releases;
+                stats.releasesNanos += workerStats.releasesNanos;
+                stats.reschedules += workerStats.reschedules;
+                return;
             }
-            needLocked = writeVars[i];
+
+            message = move(sharedQueue.front());
+            sharedQueue.pop_front();
+            generation = sharedGeneration;
+        }
+
+        auto startTime = chrono::high_resolution_clock::now();
+
+        // lock table is flat, nested variables are claimed together with their parents
+        auto lockedVars = getLockedVars(message);
+        auto vars = make_pair(withDescendants(lockedVars.first), withDescendants(lockedVars.second));
+        bool claimed = claimVars(vars.first, vars.second);
+
+        workerStats.decisions += 1;
+        workerStats.decisionsNanos += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - startTime).count();
+
+        if (!claimed) {
+            workerStats.reschedules += 1;
+
+            // failure counts only if nothing was released since the message was taken
+            lock_guard<mutex> lock(sharedMutex);
+            if (failedGeneration != generation) {
+                failedGeneration = generation;
+                failedCount = 0;
+            }
+            failedCount += 1;
+
+            sharedQueue.push_back(move(message));
+            continue;
+        }
+
+        failedGeneration = -1;
+
+        worker->setVars(move(vars.first), move(vars.second));
+        workerProcess(index, message);
+
+        {
+            // read-only copy is shared by all workers
+            lock_guard<mutex> lock(readonlyMutex);
+            updateReadonlyState(worker->getWriteVars());
+        }
+
+        startTime = chrono::high_resolution_clock::now();
+
+        releaseVars(worker->getReadVars(), worker->getWriteVars());
+        worker->clearVars();
+
+        workerStats.releases += 1;
+        workerStats.releasesNanos += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - startTime).count();
+
+        // blocked messages can be tried again
+        {
+            lock_guard<mutex> lock(sharedMutex);
+            sharedGeneration += 1;
         }
+        sharedCond.notify_all();
+    }
+}
+
+bool Scheduler::claimVars(const VarsSet& readVars, const VarsSet& writeVars) {
+    // variables are claimed one by one, on conflict the claimed ones are given back
+    vector<int> claimedReads;
+    vector<int> claimedWrites;
+
+    auto rollback = [&] {
+        for (int var : claimedReads) atomicLocks[var].fetch_sub(1);
+        for (int var : claimedWrites) atomicLocks[var].store(0);
+        return false;
+    };
 
-        if (locked && needLocked) return false;
+    for (int var : writeVars) {
+        int expected = 0;
+        if (!atomicLocks[var].compare_exchange_strong(expected, -1)) return rollback();
+        claimedWrites.push_back(var);
+    }
+
+    // with WLocking readers use the read-only copy, so reads are not claimed
+    if (type == WLocking) return true;
+
+    for (int var : readVars) {
+        if (writeVars.contains(var)) continue;
+
+        int curr = atomicLocks[var].load();
+        while (true) {
+            if (curr < 0) return rollback();
+            if (atomicLocks[var].compare_exchange_weak(curr, curr + 1)) break;
+        }
+        claimedReads.push_back(var);
     }
 
     return true;
 }
+
+void Scheduler::releaseVars(const VarsSet& readVars, const VarsSet& writeVars) {
+    for (int var : writeVars) atomicLocks[var].store(0);
+    if (type == WLocking) return;
+
+    for (int var : readVars) {
+        if (!writeVars.contains(var)) atomicLocks[var].fetch_sub(1);
+    }
+}
+
+void Scheduler::recordCpuTime() {
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0) {
+        stats.cpuNanos = time.tv_sec * 1000000000LL + time.tv_nsec;
+    }
+}
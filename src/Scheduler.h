@@ -1,23 +1,33 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
+#include <map>
+#include <set>
 #include <deque>
+#include <mutex>
+#include <atomic>
 #include <thread>
 #include <vector>
 #include <memory>
 #include <utility>
 #include <functional>
+#include <unordered_map>
+#include <condition_variable>
 
 #include "Worker.h"
+#include "VarsSet.h"
 
 class Scheduler;
 
 class SchedulerWorkerMessage {
 public:
+    // Pull: worker takes messages from the shared queue itself (decentralized mode)
     enum Type {
-        Exit = 100, Process = 10, LazyExit = 1
+        Exit = 100, Process = 10, Pull = 5, LazyExit = 1
     };
 
+    static constexpr size_t LANES_COUNT = 3;
+
     SchedulerWorkerMessage(Type type, std::shared_ptr<void> message) :
             type(type), message(std::move(message)) { };
 
@@ -25,6 +35,14 @@ public:
         return type;
     }
 
+    size_t getLane() const {
+        switch (type) {
+            case Exit: return 0;
+            case Process: case Pull: return 1;
+            default: return 2;
+        }
+    }
+
     std::shared_ptr<void> getMessage() const {
         return message;
     }
@@ -40,9 +58,8 @@ private:
 
 class SchedulerWorker : public Worker<SchedulerWorkerMessage> {
 public:
-    SchedulerWorker(Scheduler& scheduler, int index, int varsCount) :
-            scheduler(scheduler), available(true), index(index), varsCount(varsCount),
-            readVars(varsCount, false), writeVars(varsCount, false) { }
+    SchedulerWorker(Scheduler& scheduler, int index) :
+            scheduler(scheduler), available(true), index(index) { }
 
     void stop(bool wait) {
         send(SchedulerWorkerMessage(wait ? SchedulerWorkerMessage::LazyExit : SchedulerWorkerMessage::Exit, std::shared_ptr<void>()));
@@ -53,6 +70,14 @@ public:
         send(SchedulerWorkerMessage(SchedulerWorkerMessage::Process, std::move(message)));
     }
 
+    void pull() {
+        send(SchedulerWorkerMessage(SchedulerWorkerMessage::Pull, std::shared_ptr<void>()));
+    }
+
+    int getIndex() const {
+        return index;
+    }
+
     bool isAvailable() const {
         return available;
     }
@@ -61,16 +86,16 @@ public:
         available = val;
     }
 
-    const std::vector<bool> getReadVars() const {
+    const VarsSet& getReadVars() const {
         return readVars;
     }
 
-    const std::vector<bool> getWriteVars() const {
+    const VarsSet& getWriteVars() const {
         return writeVars;
     }
 
     void clearVars();
-    void setVars(const std::vector<bool>&, const std::vector<bool>&);
+    void setVars(VarsSet, VarsSet);
 
 protected:
     bool process(SchedulerWorkerMessage& msg) override;
@@ -79,9 +104,9 @@ private:
     Scheduler& scheduler;
 
     bool available;
-    int index, varsCount;
-    std::vector<bool> readVars;
-    std::vector<bool> writeVars;
+    int index;
+    VarsSet readVars;
+    VarsSet writeVars;
 };
 
 class SchedulerMessage {
@@ -91,6 +116,8 @@ public:
         Exit = 1000, Release = 100, Reprocess = 10, Process = 15, LazyExit = 1
     };
 
+    static constexpr size_t LANES_COUNT = 5;
+
     SchedulerMessage(Type type, int index, std::shared_ptr<void> message) :
             type(type), senderIndex(index), message(std::move(message)) { };
 
@@ -98,6 +125,16 @@ public:
         return type;
     }
 
+    size_t getLane() const {
+        switch (type) {
+            case Exit: return 0;
+            case Release: return 1;
+            case Process: return 2;
+            case Reprocess: return 3;
+            default: return 4;
+        }
+    }
+
     int getSenderIndex() const {
         return senderIndex;
     }
@@ -116,26 +153,114 @@ private:
     std::shared_ptr<void> message;
 };
 
+// Lock state of one variable. Variables form a trie (nested paths), so besides the read (S) and write (X) locks
+// the node counts intention locks (IS / IX) of messages touching the variables below it.
+struct VarLock {
+    int readers = 0;
+    bool writer = false;
+    int intentReaders = 0;
+    int intentWriters = 0;
+};
+
+// Conflict policies - tell whether a variable can be read / written by a new message (or a variable below it).
+// RWLocking: standard compatibility of IS, IX, S and X locks.
+struct RWLockingPolicy {
+    static bool isReadBlocked(const VarLock& lock) {
+        return lock.writer || lock.intentWriters > 0;
+    }
+
+    static bool isWriteBlocked(const VarLock& lock) {
+        return lock.writer || lock.readers > 0 || lock.intentReaders > 0 || lock.intentWriters > 0;
+    }
+
+    static bool isIntentReadBlocked(const VarLock& lock) {
+        return lock.writer;
+    }
+
+    static bool isIntentWriteBlocked(const VarLock& lock) {
+        return lock.writer || lock.readers > 0;
+    }
+};
+
+// WLocking: only writes are locked, readers work with the read-only copy of the state.
+struct WLockingPolicy {
+    static bool isReadBlocked(const VarLock&) {
+        return false;
+    }
+
+    static bool isWriteBlocked(const VarLock& lock) {
+        return lock.writer || lock.intentWriters > 0;
+    }
+
+    static bool isIntentReadBlocked(const VarLock&) {
+        return false;
+    }
+
+    static bool isIntentWriteBlocked(const VarLock& lock) {
+        return lock.writer;
+    }
+};
+
+// Counters of the scheduler thread, they can be read after the scheduler is stopped.
+struct SchedulerStats {
+    long long decisions = 0;
+    long long decisionsNanos = 0;
+    long long releases = 0;
+    long long releasesNanos = 0;
+    long long reschedules = 0;
+    long long parks = 0;
+    long long wakeups = 0;
+    long long cpuNanos = 0;
+};
+
 class Scheduler : public Worker<SchedulerMessage> {
 public:
+    // Ordered: conflicting messages run in the submission order (dependency DAG built from read / write sets)
+    // Optimistic: nothing is locked, the implementation validates its accesses and retries on conflict
     enum Type {
-        RWLocking, WLocking
+        RWLocking, WLocking, Ordered, Optimistic
     };
 
-    Scheduler(Type, int, int);
+    // Central: scheduler thread dispatches messages to workers
+    // Decentralized: workers pull messages from a shared queue and claim variables in the atomic lock table
+    enum Mode {
+        Central, Decentralized
+    };
+
+    // maximal number of blocked messages parked while the following ones are dispatched (0 disables parking)
+    static constexpr int DEFAULT_LOOKAHEAD = 16;
+
+    Scheduler(Type, int, int, int lookahead = DEFAULT_LOOKAHEAD);
     ~Scheduler();
 
     void start() override;
     virtual void stop(bool);
 
     void schedule(std::shared_ptr<void> message) {
-        send(SchedulerMessage(SchedulerMessage::Process, -1, std::move(message)));
+        if (mode == Decentralized) pushShared(std::move(message));
+        else send(SchedulerMessage(SchedulerMessage::Process, -1, std::move(message)));
     }
 
     Type getType() const {
         return type;
     }
 
+    Mode getMode() const {
+        return mode;
+    }
+
+    // has to be called before start
+    void setMode(Mode);
+
+    bool isSnapshotReads() const {
+        return snapshotReads;
+    }
+
+    // RWLocking: read-only messages lock nothing and read the last committed snapshot of the state
+    void setSnapshotReads(bool val) {
+        snapshotReads = val;
+    }
+
     int getVarsCount() const {
         return varsCount;
     }
@@ -144,7 +269,26 @@ public:
         return workers.size();
     }
 
+    int getLookahead() const {
+        return lookahead;
+    }
+
+    const SchedulerStats& getStats() const {
+        return stats;
+    }
+
 protected:
+    // parent variable of every variable (-1 for top level ones), variables are flat by default
+    void setVarParents(std::vector<int>);
+
+    int getVarParent(int var) const {
+        return parents[var];
+    }
+
+    const std::vector<int>& getVarChildren(int var) const {
+        return children[var];
+    }
+
     void reschedule(std::shared_ptr<void> message) {
         send(SchedulerMessage(SchedulerMessage::Reprocess, -1, std::move(message)));
     }
@@ -157,18 +301,99 @@ protected:
         send(SchedulerMessage(SchedulerMessage::Release, index, std::shared_ptr<void>()));
     }
 
+    void workerPull(int);
+
+    bool isWorkerOnSnapshot(int) const;
+
     virtual void workerProcess(int, std::shared_ptr<void>) = 0;
-    virtual void updateReadonlyState(const std::vector<bool> &) = 0;
+    virtual void updateReadonlyState(const VarsSet&) = 0;
 
-    virtual std::pair<std::vector<bool>, std::vector<bool> > getMessageVars(std::shared_ptr<void>) = 0;
+    virtual std::pair<VarsSet, VarsSet> getMessageVars(std::shared_ptr<void>) = 0;
 
 private:
+    struct ParkedMessage {
+        std::shared_ptr<void> message;
+        VarsSet readVars;
+        VarsSet writeVars;
+        std::vector<int> waitingVars;
+    };
+
+    // message of the Ordered mode with edges to the messages that have to wait for it
+    struct OrderedNode {
+        std::shared_ptr<void> message;
+        VarsSet readVars;
+        VarsSet writeVars;
+        int pendingCount = 0;
+        std::vector<long long> successors;
+    };
+
+    // last writer and readers after it, only unfinished messages are kept
+    struct VarOrder {
+        long long lastWriter = -1;
+        std::vector<long long> readers;
+    };
+
+    bool processOrdered(SchedulerMessage&);
+    void addOrderedNode(std::shared_ptr<void>);
+    void finishOrderedNode(long long);
+    void dispatchOrderedNodes();
+
+    std::pair<VarsSet, VarsSet> getLockedVars(std::shared_ptr<void>);
+    VarsSet withDescendants(const VarsSet&) const;
+
     SchedulerWorker* getAvailableWorker();
-    bool isSchedulable(const std::vector<bool>&, const std::vector<bool>&);
+    template <class Policy> bool isSchedulable(const VarsSet&, const VarsSet&, std::vector<int>*) const;
+
+    void dispatch(SchedulerWorker*, std::shared_ptr<void>, VarsSet, VarsSet);
+    void park(std::shared_ptr<void>, VarsSet, VarsSet);
+    void wakeParked(std::set<long long>&);
+
+    void pushShared(std::shared_ptr<void>);
+    bool claimVars(const VarsSet&, const VarsSet&);
+    void releaseVars(const VarsSet&, const VarsSet&);
+
+    void lockVars(const VarsSet&, const VarsSet&);
+    void unlockVars(const VarsSet&, const VarsSet&, std::set<long long>&);
+    void recordCpuTime();
 
     Type type;
+    Mode mode;
+    bool snapshotReads;
     int varsCount;
+    int lookahead;
     std::vector<SchedulerWorker*> workers;
+
+    // lock state of every variable, only variables touched by a message (and their ancestors) are visited
+    std::vector<VarLock> locks;
+    std::vector<int> parents;
+    std::vector<std::vector<int> > children;
+
+    // blocked messages (ordered by arrival) and the lists of parked messages waiting for each variable
+    long long nextParkedId;
+    std::map<long long, ParkedMessage> parked;
+    std::vector<std::vector<long long> > waitLists;
+    std::set<long long> readyParked;
+
+    // dependency DAG of the Ordered mode
+    long long nextNodeId;
+    std::unordered_map<long long, OrderedNode> nodes;
+    std::set<long long> readyNodes;
+    std::vector<VarOrder> varOrders;
+    std::vector<long long> workerNodes;
+
+    // decentralized mode - shared queue and lock table (readers count, -1 when written)
+    std::deque<std::shared_ptr<void> > sharedQueue;
+    std::mutex sharedMutex;
+    std::condition_variable sharedCond;
+    long long sharedGeneration;
+    bool sharedExit;
+    bool sharedExitNow;
+    std::vector<std::atomic<int> > atomicLocks;
+    std::mutex readonlyMutex;
+
+    bool (Scheduler::*isSchedulableFunc)(const VarsSet&, const VarsSet&, std::vector<int>*) const;
+
+    SchedulerStats stats;
 };
 
 #endif
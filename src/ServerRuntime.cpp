@@ -35,8 +35,8 @@ static u32string getRandomString(int length, int onesCount) {
     return res;
 }
 
-ServerRuntime::ServerRuntime(const std::string& filePath, Scheduler::Type type, int workers) :
-        ProgramRuntime(filePath, type, workers) {
+ServerRuntime::ServerRuntime(const std::string& filePath, Scheduler::Type type, int workers, bool optimized) :
+        ProgramRuntime(filePath, type, workers, optimized) {
     // registering read messages
     registerMessageGenerator("readOneRandom", 10, [] {
         return generateMessage(U"readOneRandom", U"work", getRandomString(4, 1), U"0000");
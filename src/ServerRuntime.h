@@ -5,7 +5,7 @@
 
 class ServerRuntime : public ProgramRuntime {
 public:
-    explicit ServerRuntime(const std::string& filePath, Scheduler::Type type, int workers);
+    explicit ServerRuntime(const std::string& filePath, Scheduler::Type type, int workers, bool optimized = true);
 
 protected:
     std::shared_ptr<ExecObject> createInitMessage() const override;
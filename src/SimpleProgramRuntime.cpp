@@ -10,6 +10,7 @@
 #include "LangParserBaseVisitor.h"
 
 #include "ProgramAnalyzer.h"
+#include "ProgramOptimizer.h"
 #include "SimpleProgramRuntime.h"
 
 using namespace std;
@@ -166,8 +167,18 @@ shared_ptr<Program> parseFile(string filePath) {
 }
 
 // SimpleProgramRuntime class
-SimpleProgramRuntime::SimpleProgramRuntime(string filePath) :
+SimpleProgramRuntime::SimpleProgramRuntime(string filePath, bool optimized) :
         ProgramExecutor(parseFile(filePath)), global(make_shared<ExecObject>()) {
     // running analyzer which populate props in the program with analyzed data
-    ProgramAnalyzer(getProgram()).analyze();
+    ProgramAnalyzer analyzer(getProgram());
+    analyzer.analyze();
+
+    // optimizer uses the analyzed data, the rewritten program is analyzed again
+    if (optimized) {
+        ProgramOptimizer(getProgram()).optimize();
+        analyzer.analyze();
+    }
+
+    analyzer.print();
+    link();
 }
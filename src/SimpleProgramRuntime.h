@@ -8,7 +8,8 @@
 
 class SimpleProgramRuntime : public ProgramExecutor {
 public:
-    explicit SimpleProgramRuntime(std::string);
+    // the analyzed program is optimized unless it is turned off (to compare the runs)
+    explicit SimpleProgramRuntime(std::string, bool optimized = true);
 
 protected:
     std::shared_ptr<ExecObject> getReadGlobal() const override {
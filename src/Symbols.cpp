@@ -0,0 +1,76 @@
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "Symbols.h"
+
+using namespace std;
+
+static const size_t CHUNK_SIZE = 1024;
+static const size_t CHUNKS_COUNT = 4096;
+
+static mutex symbolsMutex;
+static atomic<string*> chunks[CHUNKS_COUNT];
+static int symbolsCount = 0;
+
+int Symbols::intern(const string& name) {
+    static unordered_map<string, int> ids;
+
+    // names seen by the thread are resolved without the lock
+    thread_local unordered_map<string, int> threadIds;
+
+    auto threadIdIt = threadIds.find(name);
+    if (threadIdIt != threadIds.end()) return threadIdIt->second;
+
+    lock_guard<mutex> lock(symbolsMutex);
+
+    auto idIt = ids.find(name);
+    if (idIt != ids.end()) {
+        threadIds.emplace(name, idIt->second);
+        return idIt->second;
+    }
+
+    size_t chunk = symbolsCount / CHUNK_SIZE;
+    if (chunk >= CHUNKS_COUNT) throw logic_error("Too many field names.");
+
+    // names are never moved, chunks are allocated when needed and published before the id
+    if (!chunks[chunk].load()) chunks[chunk].store(new string[CHUNK_SIZE]);
+    chunks[chunk].load()[symbolsCount % CHUNK_SIZE] = name;
+
+    ids.emplace(name, symbolsCount);
+    threadIds.emplace(name, symbolsCount);
+    return symbolsCount++;
+}
+
+const string& Symbols::getName(int id) {
+    return chunks[id / CHUNK_SIZE].load(memory_order_acquire)[id % CHUNK_SIZE];
+}
+
+const FieldPath& Symbols::internPath(const string& path) {
+    // runtimes use only a few distinct paths, so the split paths are kept for the next lookups
+    thread_local unordered_map<string, FieldPath> threadPaths;
+
+    auto pathIt = threadPaths.find(path);
+    if (pathIt != threadPaths.end()) return pathIt->second;
+
+    auto& res = threadPaths[path];
+
+    size_t start = 0;
+    while (true) {
+        size_t dotPos = path.find('.', start);
+        res.push_back(intern(path.substr(start, dotPos == string::npos ? string::npos : dotPos - start)));
+
+        if (dotPos == string::npos) return res;
+        start = dotPos + 1;
+    }
+}
+
+string Symbols::getPathName(const FieldPath& path) {
+    string res;
+    for (int id : path) {
+        if (!res.empty()) res += '.';
+        res += getName(id);
+    }
+    return res;
+}
@@ -0,0 +1,23 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <string>
+#include <vector>
+
+// dotted path split into interned field names
+typedef std::vector<int> FieldPath;
+
+// Process-wide table of interned field names. Every name gets a small id once, ids are never released, so they
+// can be stored in the program and in the objects. New names are interned under a lock, names already seen by
+// the thread and the names of the ids are looked up without it.
+class Symbols {
+public:
+    static int intern(const std::string&);
+    static const std::string& getName(int);
+
+    // split path is cached by the calling thread
+    static const FieldPath& internPath(const std::string&);
+    static std::string getPathName(const FieldPath&);
+};
+
+#endif
@@ -17,8 +17,7 @@ using namespace std;
 std::random_device randomDevice{};
 std::mt19937 randomEngine{randomDevice()};
 
-int probGenerate(vector<bool>& reads, vector<bool>& writes, normal_distribution<double> distribution) {
-    int varsCount = (int)reads.size();
+int probGenerate(VarsSet& reads, VarsSet& writes, int varsCount, normal_distribution<double> distribution) {
     if (varsCount == 0) return 0;
 
     // building roulette count of variables
@@ -26,20 +25,20 @@ int probGenerate(vector<bool>& reads, vector<bool>& writes, normal_distribution<
     int count = max(0, min(2 * varsCount, (int)round(randVal)));
 
     // distributing randomly
-    uniform_int_distribution<> uniDistribution(0, varsCount * 2);
+    uniform_int_distribution<> uniDistribution(0, varsCount * 2 - 1);
     for (int i = 0; i < count; i++) {
         while (true) {
             int index = uniDistribution(randomEngine);
             if (index >= varsCount) {
                 index -= varsCount;
-                if (!writes[index]) {
-                    writes[index] = true;
+                if (!writes.contains(index)) {
+                    writes.insert(index);
                     break;
                 }
             }
             else {
-                if (!reads[index]) {
-                    reads[index] = true;
+                if (!reads.contains(index)) {
+                    reads.insert(index);
                     break;
                 }
             }
@@ -49,20 +48,19 @@ int probGenerate(vector<bool>& reads, vector<bool>& writes, normal_distribution<
     return count;
 }
 
-TestMessage::TestMessage(int varsCount, double param) : readVars(varsCount, false), writeVars(varsCount, false) {
-    probGenerate(readVars, writeVars, normal_distribution<double>(varsCount / 2.0, sqrt(varsCount) / param));
+TestMessage::TestMessage(int varsCount, double param, int touchedCount) {
+    // by default message touches about half of the variables, otherwise about touchedCount of them
+    double mean = touchedCount > 0 ? touchedCount : varsCount / 2.0;
+    probGenerate(readVars, writeVars, varsCount, normal_distribution<double>(mean, sqrt(touchedCount > 0 ? mean : varsCount) / param));
 
-    readVarsCount = 0;
-    for (bool val : readVars) readVarsCount += val;
-
-    writeVarsCount = 0;
-    for (bool val : writeVars) writeVarsCount += val;
+    readVarsCount = (int)readVars.size();
+    writeVarsCount = (int)writeVars.size();
 
     // set process time based on message impact
     processTime = max(readVarsCount, 1) * 2 + max(writeVarsCount, 1) * 4;
 }
 
-vector<shared_ptr<TestMessage> > TestMessage::generateMessages(int count, int varsCount, double generationParam) {
+vector<shared_ptr<TestMessage> > TestMessage::generateMessages(int count, int varsCount, double generationParam, int touchedCount) {
     vector<shared_ptr<TestMessage> > messages;
 
     int totalProcessingTime = 0;
@@ -70,7 +68,7 @@ vector<shared_ptr<TestMessage> > TestMessage::generateMessages(int count, int va
     int totalReadsCount = 0;
     int totalWritesCount = 0;
     for (int i = 0; i < count; i++) {
-        auto msg = make_shared<TestMessage>(varsCount, generationParam);
+        auto msg = make_shared<TestMessage>(varsCount, generationParam, touchedCount);
 
         totalReadsCount += msg->getReadVarsCount();
         totalWritesCount += msg->getWriteVarsCount();
@@ -89,8 +87,9 @@ vector<shared_ptr<TestMessage> > TestMessage::generateMessages(int count, int va
 }
 
 // SimpleProgramRuntime
-TestRuntime::TestRuntime(Scheduler::Type type, int workersCount, int varsCount, vector<shared_ptr<TestMessage> > messages)
-        : Scheduler(type, workersCount, varsCount), messages(move(messages)) {
+TestRuntime::TestRuntime(Scheduler::Type type, int workersCount, int varsCount, vector<shared_ptr<TestMessage> > messages,
+                         int lookahead)
+        : Scheduler(type, workersCount, varsCount, lookahead), messages(move(messages)) {
 }
 
 void TestRuntime::workerProcess(int index, shared_ptr<void> msg) {
@@ -105,11 +104,11 @@ void TestRuntime::workerProcess(int index, shared_ptr<void> msg) {
     }
 }
 
-void TestRuntime::updateReadonlyState(const std::vector<bool> &) {
+void TestRuntime::updateReadonlyState(const VarsSet&) {
     // nothing is needed here, because we have no state
 }
 
-std::pair< std::vector<bool>, std::vector<bool> > TestRuntime::getMessageVars(std::shared_ptr<void> msg) {
+std::pair<VarsSet, VarsSet> TestRuntime::getMessageVars(std::shared_ptr<void> msg) {
     return std::make_pair(
             static_pointer_cast<TestMessage>(msg)->getReadVars(),
             static_pointer_cast<TestMessage>(msg)->getWriteVars()
@@ -139,14 +138,23 @@ double TestRuntime::run(double refTime) {
 
     lineStream << "========= ";
     lineStream << messages.size() << "*(" << getVarsCount() << ") ";
-    lineStream << "on " << (getType() == Scheduler::RWLocking ? "RW" : "W") << "x";
+    const char* typeNames[] = { "RW", "W", "O", "OPT" };
+    lineStream << "on " << typeNames[getType()] << "x";
     lineStream << getWorkersCount();
+    if (getLookahead() == 0) lineStream << " without parking";
+    if (getMode() == Scheduler::Decentralized) lineStream << " decentralized";
     lineStream << " =========";
 
     cout << lineStream.str() << endl;
     cout << "Computation took: " << elapsed.count() << " milliseconds" << endl;
     cout << "Total computation cost: " << expectedTime << " milliseconds" << endl;
 
+    auto& stats = getStats();
+    cout << "Avg. scheduling cost: " << stats.decisionsNanos / (double)max(stats.decisions, 1LL) << " nanoseconds" << endl;
+    cout << "Avg. release cost: " << stats.releasesNanos / (double)max(stats.releases, 1LL) << " nanoseconds" << endl;
+    cout << "Reschedules: " << stats.reschedules << ", parked: " << stats.parks << ", woken: " << stats.wakeups << endl;
+    if (getMode() == Scheduler::Central) cout << "Scheduler thread CPU time: " << stats.cpuNanos / 1000000.0 << " milliseconds" << endl;
+
     double gain = (refTime - elapsed.count()) / refTime;
     cout << "Performance gain: " << (refTime <= 0 ? 0.0 : gain * 100.0) << "%" << endl;
 
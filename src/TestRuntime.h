@@ -8,13 +8,13 @@
 
 class TestMessage {
 public:
-    TestMessage(int varsCount, double);
+    TestMessage(int varsCount, double, int touchedCount = 0);
 
-    const std::vector<bool> &getReadVars() const {
+    const VarsSet& getReadVars() const {
         return readVars;
     }
 
-    const std::vector<bool> &getWriteVars() const {
+    const VarsSet& getWriteVars() const {
         return writeVars;
     }
 
@@ -30,26 +30,27 @@ public:
         return writeVarsCount;
     }
 
-    static std::vector<std::shared_ptr<TestMessage> > generateMessages(int, int, double);
+    static std::vector<std::shared_ptr<TestMessage> > generateMessages(int, int, double, int touchedCount = 0);
 
 private:
     int processTime;
     int readVarsCount;
     int writeVarsCount;
-    std::vector<bool> readVars;
-    std::vector<bool> writeVars;
+    VarsSet readVars;
+    VarsSet writeVars;
 };
 
 class TestRuntime : public Scheduler {
 public:
-    TestRuntime(Scheduler::Type, int, int, std::vector<std::shared_ptr<TestMessage> >);
+    TestRuntime(Scheduler::Type, int, int, std::vector<std::shared_ptr<TestMessage> >,
+                int lookahead = Scheduler::DEFAULT_LOOKAHEAD);
 
     double run(double);
 
 protected:
     void workerProcess(int, std::shared_ptr<void>) override;
-    void updateReadonlyState(const std::vector<bool> &) override;
-    std::pair<std::vector<bool>, std::vector<bool> > getMessageVars(std::shared_ptr<void>) override;
+    void updateReadonlyState(const VarsSet&) override;
+    std::pair<VarsSet, VarsSet> getMessageVars(std::shared_ptr<void>) override;
 
 private:
     std::vector<std::shared_ptr<TestMessage> > messages;
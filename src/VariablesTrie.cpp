@@ -0,0 +1,47 @@
+#include "VariablesTrie.h"
+
+using namespace std;
+
+VariablesTrie::VariablesTrie(const vector<string>& variables) : nodes(1), varNodes(variables.size(), -1), parents(variables.size(), -1) {
+    for (int var = 0; var < (int)variables.size(); var++) {
+        int node = ROOT;
+        for (int field : Symbols::internPath(variables[var])) {
+            auto childIt = nodes[node].children.find(field);
+            if (childIt == nodes[node].children.end()) {
+                nodes[node].children.emplace(field, (int)nodes.size());
+                node = (int)nodes.size();
+                nodes.emplace_back();
+            }
+            else node = childIt->second;
+        }
+        nodes[node].var = var;
+        varNodes[var] = node;
+    }
+
+    // parent is the last variable on the path, variable is nested in the nodes below it
+    for (int var = 0; var < (int)variables.size(); var++) {
+        vector<int> nested;
+        int node = ROOT;
+        for (int field : Symbols::internPath(variables[var])) {
+            node = nodes[node].children.at(field);
+            if (node != varNodes[var] && nodes[node].var >= 0) {
+                parents[var] = nodes[node].var;
+                nested.clear();
+            }
+            else nested.push_back(node);
+        }
+        for (int nestedNode : nested) nodes[nestedNode].nestedVars.push_back(var);
+    }
+}
+
+size_t VariablesTrie::walkAncestors(const FieldPath& path, int& node) const {
+    node = ROOT;
+
+    size_t res = 0;
+    for (; res < path.size(); res++) {
+        auto childIt = nodes[node].children.find(path[res]);
+        if (childIt == nodes[node].children.end() || nodes[childIt->second].children.empty()) break;
+        node = childIt->second;
+    }
+    return res;
+}
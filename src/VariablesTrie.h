@@ -0,0 +1,71 @@
+#ifndef VARIABLES_TRIE_H
+#define VARIABLES_TRIE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <unordered_map>
+
+#include "Symbols.h"
+
+// Global variables of the program by their interned field names. Node 0 is the root (the whole global state),
+// every prefix of a variable path has its node. Nodes with children are the ancestors of the variables - they are
+// locked only by the intention locks, so the writers of the sibling variables modify them at the same time.
+class VariablesTrie {
+public:
+    static constexpr int ROOT = 0;
+
+    explicit VariablesTrie(const std::vector<std::string>&);
+
+    int getVarsCount() const {
+        return (int)varNodes.size();
+    }
+
+    // closest variable the variable is nested in, -1 for the top level ones
+    int getParent(int var) const {
+        return parents[var];
+    }
+
+    int getVarNode(int var) const {
+        return varNodes[var];
+    }
+
+    int getVar(int node) const {
+        return nodes[node].var;
+    }
+
+    bool isAncestor(int node) const {
+        return !nodes[node].children.empty();
+    }
+
+    // node of the field below the node, -1 when there is no variable below it
+    int getChild(int node, int field) const {
+        auto childIt = nodes[node].children.find(field);
+        return childIt == nodes[node].children.end() ? -1 : childIt->second;
+    }
+
+    const std::unordered_map<int, int>& getChildren(int node) const {
+        return nodes[node].children;
+    }
+
+    // closest variables at or below the node
+    const std::vector<int>& getNestedVars(int node) const {
+        return nodes[node].nestedVars;
+    }
+
+    // number of the leading prefixes of the path which are the ancestors of the variables, the node of the last one
+    size_t walkAncestors(const FieldPath&, int&) const;
+
+private:
+    struct Node {
+        int var = -1;
+        std::vector<int> nestedVars;
+        std::unordered_map<int, int> children;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> varNodes;
+    std::vector<int> parents;
+};
+
+#endif
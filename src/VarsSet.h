@@ -0,0 +1,112 @@
+#ifndef VARS_SET_H
+#define VARS_SET_H
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+// Sorted set of variable indexes. Messages usually touch only a few variables, so the first
+// INLINE_SIZE indexes are stored inline and the heap is used only for bigger sets.
+class VarsSet {
+public:
+    static constexpr size_t INLINE_SIZE = 8;
+
+    VarsSet() : count(0) { }
+
+    VarsSet(const VarsSet& other) : count(0) {
+        *this = other;
+    }
+
+    VarsSet& operator=(const VarsSet& other) {
+        if (this == &other) return *this;
+
+        count = other.count;
+        if (count <= INLINE_SIZE) {
+            std::copy(other.begin(), other.end(), inlineIds);
+            heapIds.clear();
+        }
+        else {
+            heapIds.assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    VarsSet(VarsSet&& other) noexcept : count(other.count), heapIds(std::move(other.heapIds)) {
+        if (count <= INLINE_SIZE) std::copy(other.inlineIds, other.inlineIds + count, inlineIds);
+        other.count = 0;
+    }
+
+    VarsSet& operator=(VarsSet&& other) noexcept {
+        count = other.count;
+        heapIds = std::move(other.heapIds);
+        if (count <= INLINE_SIZE) std::copy(other.inlineIds, other.inlineIds + count, inlineIds);
+        other.count = 0;
+        return *this;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    const int* begin() const {
+        return count <= INLINE_SIZE ? inlineIds : heapIds.data();
+    }
+
+    const int* end() const {
+        return begin() + count;
+    }
+
+    int operator[](size_t index) const {
+        return begin()[index];
+    }
+
+    bool contains(int id) const {
+        return std::binary_search(begin(), end(), id);
+    }
+
+    void insert(int id) {
+        // appending is the common case - ids are mostly generated in increasing order
+        if (count > 0 && end()[-1] >= id) {
+            if (contains(id)) return;
+
+            insertSorted(id);
+            return;
+        }
+
+        if (count < INLINE_SIZE) inlineIds[count] = id;
+        else {
+            if (count == INLINE_SIZE) heapIds.assign(inlineIds, inlineIds + INLINE_SIZE);
+            heapIds.push_back(id);
+        }
+        count += 1;
+    }
+
+    void clear() {
+        count = 0;
+        heapIds.clear();
+    }
+
+private:
+    void insertSorted(int id) {
+        if (count < INLINE_SIZE) {
+            int* pos = std::upper_bound(inlineIds, inlineIds + count, id);
+            std::copy_backward(pos, inlineIds + count, inlineIds + count + 1);
+            *pos = id;
+        }
+        else {
+            if (count == INLINE_SIZE) heapIds.assign(inlineIds, inlineIds + INLINE_SIZE);
+            heapIds.insert(std::upper_bound(heapIds.begin(), heapIds.end(), id), id);
+        }
+        count += 1;
+    }
+
+    size_t count;
+    int inlineIds[INLINE_SIZE];
+    std::vector<int> heapIds;
+};
+
+#endif
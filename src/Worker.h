@@ -36,7 +36,7 @@ public:
     }
 
     void send(T&& msg) {
-        queue.push(msg);
+        queue.push(std::move(msg));
     }
 
 protected:
@@ -1,13 +1,30 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
 #include <string>
+#include <fstream>
+#include <vector>
 #include <iostream>
+#include <algorithm>
+#include <functional>
 
+#include "MemoCache.h"
+#include "BytecodeVM.h"
 #include "GuiRuntime.h"
+#include "QueueTest.h"
 #include "TestRuntime.h"
 #include "ServerRuntime.h"
+#include "BuiltInFunction.h"
+#include "AllocationCounter.h"
 #include "SimpleProgramRuntime.h"
 
 using namespace std;
 
+// allocations per operation, the builds without COUNT_ALLOCATIONS do not count them
+static string formatAllocations(long long allocations, double count) {
+    return AllocationCounter::isEnabled() ? to_string(allocations / count) : string("n/a");
+}
+
 void runSchedulerTest(int msgsCount, int varsCount) {
     auto messages = TestMessage::generateMessages(msgsCount, varsCount, 1.0);
 
@@ -18,6 +35,768 @@ void runSchedulerTest(int msgsCount, int varsCount) {
 
     TestRuntime(Scheduler::WLocking, 2, varsCount, messages).run(ref);
     TestRuntime(Scheduler::WLocking, 4, varsCount, messages).run(ref);
+
+    TestRuntime(Scheduler::Ordered, 2, varsCount, messages).run(ref);
+    TestRuntime(Scheduler::Ordered, 4, varsCount, messages).run(ref);
+
+    // reference runs with blocked messages rescheduled instead of parked
+    TestRuntime(Scheduler::RWLocking, 4, varsCount, messages, 0).run(ref);
+    TestRuntime(Scheduler::WLocking, 4, varsCount, messages, 0).run(ref);
+}
+
+void runSchedulerSweepTest(int msgsCount, int maxVarsCount, int touchedCount) {
+    vector<int> varsCounts;
+    for (int varsCount = 10; varsCount < maxVarsCount; varsCount *= 10) varsCounts.push_back(varsCount);
+    varsCounts.push_back(maxVarsCount);
+
+    vector<pair<double, double> > costs;
+    for (int varsCount : varsCounts) {
+        auto messages = TestMessage::generateMessages(msgsCount, varsCount, 1.0, touchedCount);
+
+        double ref = TestRuntime(Scheduler::RWLocking, 1, varsCount, messages).run(-1);
+
+        TestRuntime rwRuntime(Scheduler::RWLocking, 4, varsCount, messages);
+        rwRuntime.run(ref);
+
+        TestRuntime wRuntime(Scheduler::WLocking, 4, varsCount, messages);
+        wRuntime.run(ref);
+
+        costs.emplace_back(
+                rwRuntime.getStats().decisionsNanos / (double)max(rwRuntime.getStats().decisions, 1LL),
+                wRuntime.getStats().decisionsNanos / (double)max(wRuntime.getStats().decisions, 1LL)
+        );
+    }
+
+    cout << "===== Scheduling cost per message (" << touchedCount << " touched variables) =====" << endl;
+    for (size_t i = 0; i < varsCounts.size(); i++) {
+        cout << "  - " << varsCounts[i] << " variables: RWx4 " << costs[i].first << " ns, Wx4 " << costs[i].second << " ns" << endl;
+    }
+    cout << "===============================" << endl << endl;
+}
+
+void runSchedulerScalingTest(int msgsCount, int varsCount, int touchedCount) {
+    auto messages = TestMessage::generateMessages(msgsCount, varsCount, 1.0, touchedCount);
+
+    double ref = TestRuntime(Scheduler::RWLocking, 1, varsCount, messages).run(-1);
+
+    vector<int> workersCounts = { 1, 2, 4, 8, 16, 32, 64 };
+    vector<pair<double, double> > times;
+    for (int workersCount : workersCounts) {
+        double centralTime = TestRuntime(Scheduler::RWLocking, workersCount, varsCount, messages).run(ref);
+
+        TestRuntime runtime(Scheduler::RWLocking, workersCount, varsCount, messages);
+        runtime.setMode(Scheduler::Decentralized);
+        double decentralizedTime = runtime.run(ref);
+
+        times.emplace_back(centralTime, decentralizedTime);
+    }
+
+    cout << "===== Scaling of RW scheduling (" << msgsCount << " messages, " << varsCount << " variables) =====" << endl;
+    for (size_t i = 0; i < workersCounts.size(); i++) {
+        cout << "  - " << workersCounts[i] << " workers: central " << times[i].first << " ms, decentralized "
+             << times[i].second << " ms" << endl;
+    }
+    cout << "===============================" << endl << endl;
+}
+
+string runServerMessages(Scheduler::Type type, int workers, int msgsCount, Scheduler::Mode mode = Scheduler::Central,
+                         ProgramExecutor::Engine engine = ProgramExecutor::Interpreter) {
+    // same seed gives same messages for every run
+    srand(42);
+
+    ServerRuntime runtime("codes/Server.lang", type, workers);
+    runtime.setMode(mode);
+    runtime.setEngine(engine);
+    return runtime.runMessages(runtime.generateMessages(msgsCount));
+}
+
+void runOrderTest(int msgsCount) {
+    auto ref = runServerMessages(Scheduler::RWLocking, 1, msgsCount);
+    auto ordered = runServerMessages(Scheduler::Ordered, 4, msgsCount);
+    auto decentralized = runServerMessages(Scheduler::RWLocking, 4, msgsCount, Scheduler::Decentralized);
+    auto optimistic = runServerMessages(Scheduler::Optimistic, 4, msgsCount);
+    auto bytecode = runServerMessages(Scheduler::RWLocking, 4, msgsCount, Scheduler::Central, ProgramExecutor::Bytecode);
+
+    cout << "======== Global state =========" << endl;
+    cout << ref << endl;
+    cout << "===============================" << endl << endl;
+
+    cout << "===== Order test (" << msgsCount << " messages) =====" << endl;
+    cout << "  - Ox4 matches 1 worker run: " << (ordered == ref ? "yes" : "no") << endl;
+    if (ordered != ref) cout << ordered << endl;
+    cout << "  - RWx4 decentralized matches 1 worker run: " << (decentralized == ref ? "yes" : "no") << endl;
+    if (decentralized != ref) cout << decentralized << endl;
+    cout << "  - optimistic x4 matches 1 worker run: " << (optimistic == ref ? "yes" : "no") << endl;
+    if (optimistic != ref) cout << optimistic << endl;
+    cout << "  - RWx4 bytecode matches 1 worker run: " << (bytecode == ref ? "yes" : "no") << endl;
+    if (bytecode != ref) cout << bytecode << endl;
+    cout << "===============================" << endl << endl;
+}
+
+template <class R> void runPredicatesTestOn(const string& filePath, int msgsCount) {
+    srand(42);
+
+    R runtime(filePath, Scheduler::RWLocking, 4);
+    auto messages = runtime.generateMessages(msgsCount);
+
+    auto measure = [&](const function<pair<VarsSet, VarsSet>(shared_ptr<ExecValue>)>& func, vector<pair<VarsSet, VarsSet> >& res) {
+        auto startTime = chrono::high_resolution_clock::now();
+        for (auto& msg : messages) res.push_back(func(msg));
+        chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+        return elapsed.count() / messages.size();
+    };
+
+    vector<pair<VarsSet, VarsSet> > interpreted, compiled, cached, memoized;
+    double interpretedCost = measure([&](shared_ptr<ExecValue> msg) { return runtime.getInterpretedMessageVars(msg); }, interpreted);
+    double compiledCost = measure([&](shared_ptr<ExecValue> msg) { return runtime.getCompiledMessageVars(msg); }, compiled);
+    double cachedCost = measure([&](shared_ptr<ExecValue> msg) { return runtime.getCachedMessageVars(msg); }, cached);
+
+    // called program functions of the predicates are pure, their results are cached instead of the decisions
+    runtime.setMemoCapacity(MemoCache::DEFAULT_CAPACITY);
+    double memoizedCost = measure([&](shared_ptr<ExecValue> msg) { return runtime.getCompiledMessageVars(msg); }, memoized);
+
+    auto isSame = [](const pair<VarsSet, VarsSet>& l, const pair<VarsSet, VarsSet>& r) {
+        return l.first.size() == r.first.size() && l.second.size() == r.second.size() &&
+               equal(l.first.begin(), l.first.end(), r.first.begin()) &&
+               equal(l.second.begin(), l.second.end(), r.second.begin());
+    };
+
+    int mismatches = 0;
+    for (size_t i = 0; i < messages.size(); i++) {
+        if (!isSame(interpreted[i], compiled[i]) || !isSame(interpreted[i], cached[i]) ||
+            !isSame(interpreted[i], memoized[i])) mismatches += 1;
+    }
+
+    cout << "===== Access predicates of " << filePath << " (" << messages.size() << " messages) =====" << endl;
+    cout << "  - interpreted: " << interpretedCost << " ns per message" << endl;
+    cout << "  - compiled: " << compiledCost << " ns per message" << endl;
+    cout << "  - compiled with decision cache: " << cachedCost << " ns per message" << endl;
+    cout << "  - compiled with memoized calls: " << memoizedCost << " ns per message (hits "
+         << runtime.getMemoCache()->getHits() << ", misses " << runtime.getMemoCache()->getMisses() << ")" << endl;
+    cout << "  - speedup: " << interpretedCost / compiledCost << "x (" << interpretedCost / cachedCost << "x with cache)" << endl;
+    cout << "  - cache hits: " << runtime.getAccessPredicates().getCacheHits() << ", misses: "
+         << runtime.getAccessPredicates().getCacheMisses() << endl;
+    cout << "  - constant variants: " << runtime.getAccessPredicates().getConstantVariantsCount() << " of "
+         << runtime.getAccessPredicates().getVariantsCount() << endl;
+    cout << "  - mismatches: " << mismatches << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runPredicatesTest(int msgsCount) {
+    runPredicatesTestOn<ServerRuntime>("codes/Server.lang", msgsCount);
+    runPredicatesTestOn<GuiRuntime>("codes/Gui.lang", msgsCount);
+}
+
+void printBytecodeResult(const string& name, double interpretedCost, double bytecodeCost, double statements, bool matches) {
+    cout << "===== " << name << " =====" << endl;
+    cout << "  - interpreter: " << interpretedCost << " ns (" << statements * 1000.0 / interpretedCost << " M statements/s)" << endl;
+    cout << "  - bytecode VM: " << bytecodeCost << " ns (" << statements * 1000.0 / bytecodeCost << " M statements/s)" << endl;
+    cout << "  - statements: " << statements << endl;
+    cout << "  - speedup: " << interpretedCost / bytecodeCost << "x" << endl;
+    cout << "  - results match: " << (matches ? "yes" : "no") << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runBytecodeCallTest(ProgramExecutor& executor, const string& name, const vector<TaggedValue>& args, int callsCount) {
+    auto function = executor.getProgram()->getFunction(name);
+
+    auto measure = [&](ProgramExecutor::Engine engine, string& res) {
+        executor.setEngine(engine);
+
+        TaggedValue value;
+        auto startTime = chrono::high_resolution_clock::now();
+        for (int i = 0; i < callsCount; i++) value = executor.execCall(*function, args);
+        chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+
+        res = value.toString();
+        return elapsed.count() / callsCount;
+    };
+
+    string interpreted, bytecode;
+    double interpretedCost = measure(ProgramExecutor::Interpreter, interpreted);
+
+    long long statements = executor.getBytecodeVM() ? executor.getBytecodeVM()->getExecutedStatements() : 0;
+    double bytecodeCost = measure(ProgramExecutor::Bytecode, bytecode);
+    statements = executor.getBytecodeVM()->getExecutedStatements() - statements;
+
+    printBytecodeResult("Call of " + name + " (" + to_string(callsCount) + " calls)", interpretedCost, bytecodeCost,
+                        statements / (double)callsCount, interpreted == bytecode);
+}
+
+void runBytecodeServerTest(int msgsCount) {
+    auto measure = [&](ProgramExecutor::Engine engine, string& res, long long& statements) {
+        srand(42);
+
+        ServerRuntime runtime("codes/Server.lang", Scheduler::RWLocking, 1);
+        runtime.setEngine(engine);
+        auto messages = runtime.generateMessages(msgsCount);
+
+        // busy waiting of the simulated databases would hide the cost of the execution
+        runtime.overrideBuiltInFunction(BuiltInFunction("_sleep", 2, [](const BuiltInArguments& args) {
+            return args[1];
+        }));
+
+        auto startTime = chrono::high_resolution_clock::now();
+        res = runtime.runMessages(messages);
+        chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+
+        if (runtime.getBytecodeVM()) statements = runtime.getBytecodeVM()->getExecutedStatements();
+        return elapsed.count() / msgsCount;
+    };
+
+    string interpreted, bytecode;
+    long long statements = 0;
+    double interpretedCost = measure(ProgramExecutor::Interpreter, interpreted, statements);
+    double bytecodeCost = measure(ProgramExecutor::Bytecode, bytecode, statements);
+
+    printBytecodeResult("Server messages without sleeping (" + to_string(msgsCount) + " messages)", interpretedCost,
+                        bytecodeCost, statements / (double)(msgsCount + 1), interpreted == bytecode);
+}
+
+void runBytecodeTest(int callsCount) {
+    SimpleProgramRuntime runtime("codes/Test.lang");
+
+    runBytecodeCallTest(runtime, "fac", { TaggedValue::makeInteger(20) }, callsCount);
+    runBytecodeCallTest(runtime, "check2", {
+            TaggedValue::makeString(u32string(100, U'a')), TaggedValue::makeChar(U'b'), TaggedValue::makeInteger(0)
+    }, callsCount / 10);
+
+    runBytecodeServerTest(callsCount);
+}
+
+void runValuesTest(int msgsCount) {
+    vector<string> lines;
+    vector<pair<Scheduler::Type, ProgramExecutor::Engine> > configs = {
+        { Scheduler::RWLocking, ProgramExecutor::Interpreter },
+        { Scheduler::RWLocking, ProgramExecutor::Bytecode },
+        { Scheduler::Optimistic, ProgramExecutor::Bytecode }
+    };
+
+    for (auto& config : configs) {
+        auto engine = config.second;
+        srand(42);
+
+        ServerRuntime runtime("codes/Server.lang", config.first, config.first == Scheduler::Optimistic ? 2 : 1);
+        runtime.setEngine(engine);
+        auto messages = runtime.generateMessages(msgsCount);
+
+        runtime.overrideBuiltInFunction(BuiltInFunction("_sleep", 2, [](const BuiltInArguments& args) {
+            return args[1];
+        }));
+
+        long long allocations = AllocationCounter::getCount();
+        long long clones = ExecObject::getClonesCount();
+        long long bytes = ExecObject::getCopiedBytes();
+        auto startTime = chrono::high_resolution_clock::now();
+        runtime.runMessages(messages);
+        chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+        allocations = AllocationCounter::getCount() - allocations;
+        clones = ExecObject::getClonesCount() - clones;
+        bytes = ExecObject::getCopiedBytes() - bytes;
+
+        lines.push_back(string(engine == ProgramExecutor::Interpreter ? "interpreter" : "bytecode VM") +
+                        (config.first == Scheduler::Optimistic ? " (2 optimistic workers)" : "") + ": " +
+                        formatAllocations(allocations, msgsCount) + " allocations, " +
+                        to_string(clones / (double)msgsCount) + " object copies (" +
+                        to_string(bytes / (double)msgsCount) + " bytes), " +
+                        to_string(elapsed.count() / msgsCount) + " ns per message");
+    }
+
+    cout << "===== Execution of server messages without sleeping (" << msgsCount << " messages) =====" << endl;
+    for (auto& line : lines) cout << "  - " << line << endl;
+    cout << "===============================" << endl << endl;
+
+    auto measure = [&](const string& name, const vector<TaggedValue>& args) {
+        auto& function = *findBuiltInFunction(name);
+
+        long long allocations = AllocationCounter::getCount();
+        auto startTime = chrono::high_resolution_clock::now();
+        for (int i = 0; i < msgsCount * 100; i++) function(BuiltInArguments(args.data(), args.size()));
+        chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+        allocations = AllocationCounter::getCount() - allocations;
+
+        cout << "  - " << name << ": " << elapsed.count() / (msgsCount * 100) << " ns, "
+             << formatAllocations(allocations, msgsCount * 100.0) << " allocations per call" << endl;
+    };
+
+    cout << "===== Built-in function calls =====" << endl;
+    measure("_add", { TaggedValue::makeInteger(1), TaggedValue::makeInteger(2) });
+    measure("_eq", { TaggedValue::makeString(U"work"), TaggedValue::makeString(U"init") });
+    measure("_ch", { TaggedValue::makeString(U"0101"), TaggedValue::makeInteger(2) });
+    cout << "===============================" << endl << endl;
+}
+
+void runLatencyTest(int msgsCount) {
+    vector<string> lines;
+    for (auto engine : { ProgramExecutor::Interpreter, ProgramExecutor::Bytecode }) {
+        for (int workers : { 1, 2, 4, 16 }) {
+            srand(42);
+
+            ServerRuntime runtime("codes/Server.lang", Scheduler::RWLocking, workers);
+            runtime.setEngine(engine);
+            runtime.setLatenciesTracked(true);
+            runtime.overrideBuiltInFunction(BuiltInFunction("_sleep", 2, [](const BuiltInArguments& args) {
+                return args[1];
+            }));
+            auto messages = runtime.generateMessages(msgsCount);
+
+            long long allocations = AllocationCounter::getCount();
+            runtime.runMessages(messages);
+            allocations = AllocationCounter::getCount() - allocations;
+
+            // latencies of the messages in the workers, not waiting in the queues
+            auto latencies = runtime.getLatencies();
+            lines.push_back(string(engine == ProgramExecutor::Interpreter ? "interpreter" : "bytecode VM") + ", " +
+                            to_string(workers) + " workers: " +
+                            formatAllocations(allocations, latencies.size()) + " allocations per message, p50 " +
+                            to_string(latencies[latencies.size() / 2]) + " ns, p99 " +
+                            to_string(latencies[latencies.size() * 99 / 100]) + " ns");
+        }
+    }
+
+    cout << "===== Server messages latency without sleeping (" << msgsCount << " messages) =====" << endl;
+    for (auto& line : lines) cout << "  - " << line << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runMemoCallTest(ProgramExecutor& executor, const string& name, const vector<vector<TaggedValue> >& argsList, int callsCount) {
+    auto function = executor.getProgram()->getFunction(name);
+
+    // repeated traffic - the calls cycle through the list of arguments
+    auto measure = [&](ProgramExecutor::Engine engine, size_t capacity, string& res) {
+        executor.setEngine(engine);
+        executor.setMemoCapacity(capacity);
+
+        auto startTime = chrono::high_resolution_clock::now();
+        for (int i = 0; i < callsCount; i++) res += executor.execCall(*function, argsList[i % argsList.size()]).toString();
+        chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+        return elapsed.count() / callsCount;
+    };
+
+    cout << "===== Calls of " << name << " (" << callsCount << " calls, " << argsList.size() << " different arguments) =====" << endl;
+    for (auto engine : { ProgramExecutor::Interpreter, ProgramExecutor::Bytecode }) {
+        string plain, memoized;
+        double plainCost = measure(engine, 0, plain);
+        double memoizedCost = measure(engine, MemoCache::DEFAULT_CAPACITY, memoized);
+
+        auto memo = executor.getMemoCache();
+        cout << "  - " << (engine == ProgramExecutor::Interpreter ? "interpreter" : "bytecode VM") << ": "
+             << plainCost << " ns, memoized " << memoizedCost << " ns (" << plainCost / memoizedCost << "x, hits "
+             << memo->getHits() << ", misses " << memo->getMisses() << "), results match: "
+             << (plain == memoized ? "yes" : "no") << endl;
+    }
+    cout << "===============================" << endl << endl;
+
+    executor.setMemoCapacity(0);
+}
+
+void runMemoServerTest(int msgsCount) {
+    vector<string> lines;
+    for (auto engine : { ProgramExecutor::Interpreter, ProgramExecutor::Bytecode }) {
+        for (int workers : { 1, 4 }) {
+            auto measure = [&](size_t capacity, string& res, string& stats) {
+                srand(42);
+
+                ServerRuntime runtime("codes/Server.lang", Scheduler::RWLocking, workers);
+                runtime.setEngine(engine);
+                runtime.setMemoCapacity(capacity);
+                runtime.overrideBuiltInFunction(BuiltInFunction("_sleep", 2, [](const BuiltInArguments& args) {
+                    return args[1];
+                }));
+                auto messages = runtime.generateMessages(msgsCount);
+
+                auto startTime = chrono::high_resolution_clock::now();
+                res = runtime.runMessages(messages);
+                chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+
+                if (runtime.getMemoCache()) {
+                    stats = "hits " + to_string(runtime.getMemoCache()->getHits()) + ", misses " +
+                            to_string(runtime.getMemoCache()->getMisses());
+                }
+                return elapsed.count() / msgsCount;
+            };
+
+            string plain, memoized, stats;
+            double plainCost = measure(0, plain, stats);
+            double memoizedCost = measure(MemoCache::DEFAULT_CAPACITY, memoized, stats);
+
+            lines.push_back(string(engine == ProgramExecutor::Interpreter ? "interpreter" : "bytecode VM") + ", " +
+                            to_string(workers) + " workers: " + to_string(plainCost) + " ns, memoized " +
+                            to_string(memoizedCost) + " ns per message (" + stats + "), results match: " +
+                            (plain == memoized ? "yes" : "no"));
+        }
+    }
+
+    cout << "===== Server messages without sleeping (" << msgsCount << " messages) =====" << endl;
+    for (auto& line : lines) cout << "  - " << line << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runMemoTest(int callsCount) {
+    SimpleProgramRuntime runtime("codes/Test.lang");
+
+    vector<vector<TaggedValue> > facArgs;
+    for (int i = 1; i <= 20; i++) facArgs.push_back({ TaggedValue::makeInteger(i) });
+    runMemoCallTest(runtime, "fac", facArgs, callsCount);
+
+    SimpleProgramRuntime serverRuntime("codes/Server.lang");
+
+    // bits of the read and write masks as the server messages have them
+    vector<vector<TaggedValue> > bitsArgs;
+    for (int mask = 0; mask < 16; mask++) {
+        u32string bits;
+        for (int i = 0; i < 4; i++) bits += (mask & (1 << i)) ? U'1' : U'0';
+        for (int i = 0; i < 4; i++) bitsArgs.push_back({ TaggedValue::makeString(bits), TaggedValue::makeInteger(i) });
+    }
+    runMemoCallTest(serverRuntime, "isBitSet", bitsArgs, callsCount);
+
+    runMemoServerTest(callsCount);
+}
+
+template <class R> void runOptimizerTestOn(const string& filePath, int msgsCount) {
+    vector<string> lines;
+    string results[2];
+    for (bool optimized : { false, true }) {
+        for (auto engine : { ProgramExecutor::Interpreter, ProgramExecutor::Bytecode }) {
+            srand(42);
+
+            R runtime(filePath, Scheduler::RWLocking, 1, optimized);
+            runtime.setEngine(engine);
+            runtime.overrideBuiltInFunction(BuiltInFunction("_sleep", 2, [](const BuiltInArguments& args) {
+                return args[1];
+            }));
+            auto messages = runtime.generateMessages(msgsCount);
+
+            // access predicates are built from the (optimized) statements
+            auto startTime = chrono::high_resolution_clock::now();
+            for (auto& msg : messages) runtime.getCompiledMessageVars(msg);
+            chrono::duration<double, nano> predicatesElapsed = chrono::high_resolution_clock::now() - startTime;
+
+            startTime = chrono::high_resolution_clock::now();
+            string res = runtime.runMessages(messages);
+            chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+
+            string line = string(optimized ? "optimized" : "original") + ", " +
+                          (engine == ProgramExecutor::Interpreter ? "interpreter" : "bytecode VM") + ": " +
+                          to_string(elapsed.count() / msgsCount) + " ns per message, predicates " +
+                          to_string(predicatesElapsed.count() / msgsCount) + " ns per message";
+            if (engine == ProgramExecutor::Bytecode && runtime.getBytecodeVM()) {
+                line += ", " + to_string(runtime.getBytecodeVM()->getExecutedStatements() / (double)(msgsCount + 1)) +
+                        " statements per message";
+            }
+            lines.push_back(line);
+
+            if (results[optimized].empty()) results[optimized] = res;
+            else if (results[optimized] != res) results[optimized] = "engines differ";
+        }
+    }
+
+    cout << "===== Optimizer on " << filePath << " without sleeping (" << msgsCount << " messages) =====" << endl;
+    for (auto& line : lines) cout << "  - " << line << endl;
+    cout << "  - results match: " << (results[0] == results[1] ? "yes" : "no") << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runOptimizerTest(int msgsCount) {
+    runOptimizerTestOn<ServerRuntime>("codes/Server.lang", msgsCount);
+    runOptimizerTestOn<GuiRuntime>("codes/Gui.lang", msgsCount);
+}
+
+// main with the chain of the message type handlers, every handler writes its own variable
+void writeHandlersProgram(const string& filePath, int handlersCount) {
+    ofstream file(filePath);
+    file << "def main(msg)" << endl;
+    for (int i = 0; i < handlersCount; i++) {
+        file << "    local.test = _eq(local.msg.type, \"type" << i << "\")" << endl;
+        file << "    if local.test" << endl;
+        file << "        global.handler" << i << " = local.msg.value" << endl;
+        file << "        local.res = global.handler" << i << endl;
+        file << "    end" << endl;
+    }
+    file << "    return local.res" << endl;
+    file << "end" << endl;
+}
+
+void runDispatchTest(int msgsCount) {
+    vector<string> lines;
+    for (int handlersCount : { 2, 10, 25, 50, 100 }) {
+        string filePath = "dispatch-" + to_string(handlersCount) + ".lang";
+        writeHandlersProgram(filePath, handlersCount);
+
+        srand(42);
+        vector<shared_ptr<ExecValue> > messages;
+        for (int i = 0; i < msgsCount; i++) {
+            auto msg = make_shared<ExecObject>();
+            msg->setValueByPath("type", TaggedValue::makeString(fromUTF8("type" + to_string(rand() % handlersCount))));
+            msg->setValueByPath("value", TaggedValue::makeInteger(i));
+            messages.push_back(msg);
+        }
+
+        // chains of the conditions and the dispatch tables built by the optimizer
+        double costs[2][3];
+        vector<string> results[2];
+        vector<pair<VarsSet, VarsSet> > vars[2];
+        for (bool optimized : { false, true }) {
+            ProgramRuntime runtime(filePath, Scheduler::RWLocking, 1, optimized);
+
+            int i = 0;
+            for (auto engine : { ProgramExecutor::Interpreter, ProgramExecutor::Bytecode }) {
+                runtime.setEngine(engine);
+
+                auto startTime = chrono::high_resolution_clock::now();
+                for (auto& msg : messages) results[optimized].push_back(runtime.exec(msg)->toString());
+                chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+                costs[optimized][i++] = elapsed.count() / msgsCount;
+            }
+
+            auto startTime = chrono::high_resolution_clock::now();
+            for (auto& msg : messages) vars[optimized].push_back(runtime.getCompiledMessageVars(msg));
+            chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+            costs[optimized][2] = elapsed.count() / msgsCount;
+        }
+        remove(filePath.c_str());
+
+        bool matches = results[0] == results[1];
+        for (int i = 0; i < msgsCount; i++) {
+            auto& l = vars[0][i];
+            auto& r = vars[1][i];
+            if (l.first.size() != r.first.size() || l.second.size() != r.second.size() ||
+                !equal(l.first.begin(), l.first.end(), r.first.begin()) ||
+                !equal(l.second.begin(), l.second.end(), r.second.begin())) matches = false;
+        }
+
+        lines.push_back(to_string(handlersCount) + " handlers: interpreter " + to_string(costs[0][0]) + " -> " +
+                        to_string(costs[1][0]) + " ns, bytecode VM " + to_string(costs[0][1]) + " -> " +
+                        to_string(costs[1][1]) + " ns, predicates " + to_string(costs[0][2]) + " -> " +
+                        to_string(costs[1][2]) + " ns per message, results match: " + (matches ? "yes" : "no"));
+    }
+
+    cout << "===== Message type handlers, conditions chain -> dispatch table (" << msgsCount << " messages) =====" << endl;
+    for (auto& line : lines) cout << "  - " << line << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runSpecializeTest(int msgsCount) {
+    vector<string> lines;
+    for (int handlersCount : { 2, 10, 100 }) {
+        string filePath = "specialize-" + to_string(handlersCount) + ".lang";
+        writeHandlersProgram(filePath, handlersCount);
+
+        // every tenth message has an unknown type and goes through the generic main
+        srand(42);
+        vector<shared_ptr<ExecValue> > messages;
+        for (int i = 0; i < msgsCount; i++) {
+            auto msg = make_shared<ExecObject>();
+            string type = i % 10 == 9 ? "unknown" : "type" + to_string(rand() % handlersCount);
+            msg->setValueByPath("type", TaggedValue::makeString(fromUTF8(type)));
+            msg->setValueByPath("value", TaggedValue::makeInteger(i));
+            messages.push_back(msg);
+        }
+
+        // generic main with the cached predicates and the variants of main with their constant access sets
+        double costs[2][2];
+        vector<string> results[2];
+        vector<pair<VarsSet, VarsSet> > vars[2];
+        int constantVariants = 0, variantsCount = 0;
+        for (bool optimized : { false, true }) {
+            ProgramRuntime runtime(filePath, Scheduler::RWLocking, 1, optimized);
+            runtime.setEngine(ProgramExecutor::Bytecode);
+
+            auto startTime = chrono::high_resolution_clock::now();
+            for (auto& msg : messages) vars[optimized].push_back(runtime.getCachedMessageVars(msg));
+            chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+            costs[optimized][0] = elapsed.count() / msgsCount;
+
+            startTime = chrono::high_resolution_clock::now();
+            for (auto& msg : messages) results[optimized].push_back(runtime.exec(msg)->toString());
+            elapsed = chrono::high_resolution_clock::now() - startTime;
+            costs[optimized][1] = elapsed.count() / msgsCount;
+
+            if (optimized) {
+                constantVariants = runtime.getAccessPredicates().getConstantVariantsCount();
+                variantsCount = runtime.getAccessPredicates().getVariantsCount();
+            }
+        }
+        remove(filePath.c_str());
+
+        bool matches = results[0] == results[1];
+        for (int i = 0; i < msgsCount; i++) {
+            auto& l = vars[0][i];
+            auto& r = vars[1][i];
+            if (l.first.size() != r.first.size() || l.second.size() != r.second.size() ||
+                !equal(l.first.begin(), l.first.end(), r.first.begin()) ||
+                !equal(l.second.begin(), l.second.end(), r.second.begin())) matches = false;
+        }
+
+        lines.push_back(to_string(handlersCount) + " handlers: scheduling " + to_string(costs[0][0]) + " -> " +
+                        to_string(costs[1][0]) + " ns, bytecode VM " + to_string(costs[0][1]) + " -> " +
+                        to_string(costs[1][1]) + " ns per message, constant variants " + to_string(constantVariants) +
+                        " of " + to_string(variantsCount) + ", results match: " + (matches ? "yes" : "no"));
+    }
+
+    cout << "===== Message type handlers, generic main -> specialized variants (" << msgsCount << " messages) =====" << endl;
+    for (auto& line : lines) cout << "  - " << line << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runAnalyzerTest(int msgsCount) {
+    vector<string> lines;
+    for (int handlersCount : { 10, 30, 100, 300, 1000 }) {
+        // every handler counts the handled messages, the count after the chain guards the last write - its
+        // expression nests the conditions of all the handlers
+        string filePath = "analyzer-" + to_string(handlersCount) + ".lang";
+        {
+            ofstream file(filePath);
+            file << "def main(msg)" << endl;
+            file << "    local.count = 0" << endl;
+            for (int i = 0; i < handlersCount; i++) {
+                file << "    local.test = _eq(local.msg.type, \"type" << i << "\")" << endl;
+                file << "    if local.test" << endl;
+                file << "        global.handler" << i << " = local.msg.value" << endl;
+                file << "        local.count = _add(local.count, 1)" << endl;
+                file << "    end" << endl;
+            }
+            file << "    local.handled = _gt(local.count, 0)" << endl;
+            file << "    if local.handled" << endl;
+            file << "        global.handled = local.count" << endl;
+            file << "    end" << endl;
+            file << "    return local.count" << endl;
+            file << "end" << endl;
+        }
+
+        srand(42);
+        vector<shared_ptr<ExecValue> > messages;
+        for (int i = 0; i < msgsCount; i++) {
+            auto msg = make_shared<ExecObject>();
+            msg->setValueByPath("type", TaggedValue::makeString(fromUTF8("type" + to_string(rand() % (handlersCount + 1)))));
+            msg->setValueByPath("value", TaggedValue::makeInteger(i));
+            messages.push_back(msg);
+        }
+
+        // printed analysis of the big programs would hide the results
+        auto coutBuffer = cout.rdbuf(nullptr);
+        auto startTime = chrono::high_resolution_clock::now();
+        ProgramRuntime runtime(filePath, Scheduler::RWLocking, 1, false);
+        chrono::duration<double, milli> analysisTime = chrono::high_resolution_clock::now() - startTime;
+        cout.rdbuf(coutBuffer);
+        cout.clear();
+        remove(filePath.c_str());
+
+        vector<pair<VarsSet, VarsSet> > interpreted, compiled;
+        startTime = chrono::high_resolution_clock::now();
+        for (auto& msg : messages) interpreted.push_back(runtime.getInterpretedMessageVars(msg));
+        chrono::duration<double, nano> interpretedCost = chrono::high_resolution_clock::now() - startTime;
+
+        startTime = chrono::high_resolution_clock::now();
+        for (auto& msg : messages) compiled.push_back(runtime.getCompiledMessageVars(msg));
+        chrono::duration<double, nano> compiledCost = chrono::high_resolution_clock::now() - startTime;
+
+        bool matches = true;
+        for (int i = 0; i < msgsCount; i++) {
+            auto& l = interpreted[i];
+            auto& r = compiled[i];
+            if (l.first.size() != r.first.size() || l.second.size() != r.second.size() ||
+                !equal(l.first.begin(), l.first.end(), r.first.begin()) ||
+                !equal(l.second.begin(), l.second.end(), r.second.begin())) matches = false;
+        }
+
+        lines.push_back(to_string(handlersCount) + " handlers: analysis " + to_string(analysisTime.count()) + " ms, " +
+                        to_string(runtime.getAccessPredicates().getNodesCount()) + " predicate nodes, interpreted " +
+                        to_string(interpretedCost.count() / msgsCount) + " ns, compiled " +
+                        to_string(compiledCost.count() / msgsCount) + " ns per message, sets match: " + (matches ? "yes" : "no"));
+    }
+
+    cout << "===== Analysis of the sequential handlers (" << msgsCount << " messages) =====" << endl;
+    for (auto& line : lines) cout << "  - " << line << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runStartupTest(int maxFunctionsCount) {
+    vector<string> lines;
+    for (int functionsCount = 10; functionsCount <= maxFunctionsCount; functionsCount *= 10) {
+        // tree of the functions writing their own variables, every tenth function also calls itself
+        string filePath = "startup-" + to_string(functionsCount) + ".lang";
+        {
+            ofstream file(filePath);
+            for (int i = 0; i < functionsCount; i++) {
+                file << "def f" << i << "(x)" << endl;
+                file << "    global.v" << i << " = local.x" << endl;
+                if (2 * i + 1 < functionsCount) file << "    local.a = f" << 2 * i + 1 << "(local.x)" << endl;
+                if (2 * i + 2 < functionsCount) file << "    local.b = f" << 2 * i + 2 << "(local.x)" << endl;
+                if (i % 10 == 0) file << "    local.c = f" << i << "(local.x)" << endl;
+                file << "    return local.x" << endl;
+                file << "end" << endl << endl;
+            }
+            file << "def main(msg)" << endl;
+            file << "    local.res = f0(local.msg.value)" << endl;
+            file << "    return local.res" << endl;
+            file << "end" << endl;
+        }
+
+        // printed analysis of the big programs would hide the results
+        auto coutBuffer = cout.rdbuf(nullptr);
+        auto startTime = chrono::high_resolution_clock::now();
+        ProgramRuntime runtime(filePath, Scheduler::RWLocking, 1, false);
+        chrono::duration<double, milli> startupTime = chrono::high_resolution_clock::now() - startTime;
+        cout.rdbuf(coutBuffer);
+        cout.clear();
+        remove(filePath.c_str());
+
+        int recursiveCount = 0;
+        for (auto& function : runtime.getProgram()->getFunctions()) {
+            if (function->isRecursive()) recursiveCount += 1;
+        }
+
+        lines.push_back(to_string(functionsCount) + " functions: startup " + to_string(startupTime.count()) + " ms, " +
+                        to_string(recursiveCount) + " recursive functions, " +
+                        to_string(runtime.getProgram()->getFunction("main")->getAllVariables().size()) + " variables of main");
+    }
+
+    cout << "===== Startup of the programs with many functions =====" << endl;
+    for (auto& line : lines) cout << "  - " << line << endl;
+    cout << "===============================" << endl << endl;
+}
+
+void runObjectsTest(int accessCount) {
+    cout << "===== Deep path access (" << accessCount << " accesses, depth 4) =====" << endl;
+
+    for (int width : { 3, 16 }) {
+        // every level has the given number of fields, the path goes through the last one
+        auto root = make_shared<ExecObject>();
+        string path;
+        for (int depth = 0; depth < 4; depth++) {
+            string prefix = path.empty() ? "" : path + ".";
+            for (int i = 0; i < width; i++) {
+                root->setValueByPath(prefix + "field" + to_string(i), depth < 3 ? TaggedValue::makeObject(make_shared<ExecObject>()) : TaggedValue::makeInteger(i));
+            }
+            path = prefix + "field" + to_string(width - 1);
+        }
+        auto fields = Symbols::internPath(path);
+
+        auto measure = [&](const string& name, const function<void(int)>& access) {
+            long long allocations = AllocationCounter::getCount();
+            auto startTime = chrono::high_resolution_clock::now();
+            for (int i = 0; i < accessCount; i++) access(i);
+            chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - startTime;
+            allocations = AllocationCounter::getCount() - allocations;
+
+            cout << "  - " << width << " fields per object, " << name << ": " << elapsed.count() / accessCount << " ns, "
+                 << formatAllocations(allocations, accessCount) << " allocations per access" << endl;
+        };
+
+        long long sum = 0;
+        measure("getFieldByPath", [&](int) { sum += static_pointer_cast<ExecInteger>(root->getFieldByPath(path))->getValue(); });
+        measure("setFieldByPath", [&](int i) { root->setFieldByPath(path, make_shared<ExecInteger>(i)); });
+        measure("getValueByPath (interned)", [&](int) { sum += root->getValueByPath(fields).getInteger(); });
+        measure("setValueByPath (interned)", [&](int i) { root->setValueByPath(fields, TaggedValue::makeInteger(i)); });
+
+        if (sum < 0) cout << sum << endl;
+    }
+    cout << "===============================" << endl << endl;
+}
+
+void runQueueTest(int msgsCount, int producersCount) {
+    QueueTest(msgsCount, producersCount).run();
 }
 
 void runServerTest(int seconds) {
@@ -29,6 +808,14 @@ void runServerTest(int seconds) {
 
     cout << ">>>>>> Testing 4 workers for " << seconds << " seconds:" << endl;
     ServerRuntime("codes/Server.lang", Scheduler::RWLocking, 4).run(seconds * 1000);
+
+    cout << ">>>>>> Testing 4 workers without snapshot reads for " << seconds << " seconds:" << endl;
+    ServerRuntime lockingRuntime("codes/Server.lang", Scheduler::RWLocking, 4);
+    lockingRuntime.setSnapshotReads(false);
+    lockingRuntime.run(seconds * 1000);
+
+    cout << ">>>>>> Testing 4 optimistic workers for " << seconds << " seconds:" << endl;
+    ServerRuntime("codes/Server.lang", Scheduler::Optimistic, 4).run(seconds * 1000);
 }
 
 void runGuiTest(int seconds) {
@@ -40,6 +827,17 @@ void runGuiTest(int seconds) {
 
     cout << ">>>>>> Testing 4 workers for " << seconds << " seconds:" << endl;
     GuiRuntime("codes/Gui.lang", Scheduler::WLocking, 4).run(seconds * 1000);
+
+    cout << ">>>>>> Testing 4 RW locking workers for " << seconds << " seconds:" << endl;
+    GuiRuntime("codes/Gui.lang", Scheduler::RWLocking, 4).run(seconds * 1000);
+
+    cout << ">>>>>> Testing 4 RW locking workers without snapshot reads for " << seconds << " seconds:" << endl;
+    GuiRuntime lockingRuntime("codes/Gui.lang", Scheduler::RWLocking, 4);
+    lockingRuntime.setSnapshotReads(false);
+    lockingRuntime.run(seconds * 1000);
+
+    cout << ">>>>>> Testing 4 optimistic workers for " << seconds << " seconds:" << endl;
+    GuiRuntime("codes/Gui.lang", Scheduler::Optimistic, 4).run(seconds * 1000);
 }
 
 void runInterpreter(const string& programPath, const string& strArg) {
@@ -60,7 +858,67 @@ int main(int argc, char *argv[]) {
     if (argc > 1 && string(argv[1]) == "--test-scheduler") {
         int msgsCount = (argc > 2 ? stoi(argv[2]) : 1000);
         int varsCount = (argc > 3 ? stoi(argv[3]) : 10);
-        runSchedulerTest(msgsCount, varsCount);
+        if (argc > 4) runSchedulerSweepTest(msgsCount, varsCount, stoi(argv[4]));
+        else runSchedulerTest(msgsCount, varsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-queue") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 1000000);
+        int producersCount = (argc > 3 ? stoi(argv[3]) : 4);
+        runQueueTest(msgsCount, producersCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-scaling") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 1000);
+        int varsCount = (argc > 3 ? stoi(argv[3]) : 1000);
+        int touchedCount = (argc > 4 ? stoi(argv[4]) : 4);
+        runSchedulerScalingTest(msgsCount, varsCount, touchedCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-predicates") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 100000);
+        runPredicatesTest(msgsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-bytecode") {
+        int callsCount = (argc > 2 ? stoi(argv[2]) : 10000);
+        runBytecodeTest(callsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-values") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 10000);
+        runValuesTest(msgsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-latency") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 10000);
+        runLatencyTest(msgsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-memo") {
+        int callsCount = (argc > 2 ? stoi(argv[2]) : 10000);
+        runMemoTest(callsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-optimizer") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 10000);
+        runOptimizerTest(msgsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-dispatch") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 100000);
+        runDispatchTest(msgsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-analyzer") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 10000);
+        runAnalyzerTest(msgsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-startup") {
+        int functionsCount = (argc > 2 ? stoi(argv[2]) : 10000);
+        runStartupTest(functionsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-specialize") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 100000);
+        runSpecializeTest(msgsCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-objects") {
+        int accessCount = (argc > 2 ? stoi(argv[2]) : 1000000);
+        runObjectsTest(accessCount);
+    }
+    else if (argc > 1 && string(argv[1]) == "--test-order") {
+        int msgsCount = (argc > 2 ? stoi(argv[2]) : 200);
+        runOrderTest(msgsCount);
     }
     else if (argc > 1 && string(argv[1]) == "--test-server") {
         int seconds = (argc > 2 ? stoi(argv[2]) : 10);